@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "MeshModel.h"
+
+// Geometry of the loaded models by source file, so opening a file again adds an instance instead
+// of a copy. Entries are weak: geometry lives as long as some instance draws it, and a file that
+// changed on disk since is loaded again.
+class AssetCache
+{
+public:
+	static AssetCache& Instance();
+
+	// A new instance of the geometry loaded from filePath, null if there is none or the file changed
+	std::shared_ptr<MeshModel> CreateInstance(const std::string& filePath);
+	// Hands out model's geometry for filePath from now on
+	void Add(const std::string& filePath, const MeshModel& model);
+	size_t GetAssetCount();
+
+private:
+	struct Entry
+	{
+		int64_t time;
+		std::weak_ptr<MeshGeometry> geometry;
+	};
+
+	// Canonical path and modification time
+	static bool GetKey(const std::string& filePath, std::string& path, int64_t& time);
+	void RemoveExpired();
+
+	std::mutex mutex;
+	std::map<std::string, Entry> entries;
+};
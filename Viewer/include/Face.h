@@ -1,18 +1,18 @@
 #pragma once
-#include "vector"
-#include <string>
 #include <glm/glm.hpp>
 
+// One triangle's OBJ indices, copied out of a FaceTable
 class Face
 {
 public:
-	Face(std::istream& issLine);
+	// Indices are 1-based as in the OBJ file, 0 marks a missing index
+	Face(const int* vertexIndices, const int* textureIndices, const int* normalIndices);
 	int GetVertexIndex(int index) const;
 	int GetNormalIndex(int index) const;
 	int GetTextureIndex(int index) const;
 
 private:
-	std::vector<int> vertex_indices;
-	std::vector<int> normal_indices;
-	std::vector<int> texture_indices;
-};
\ No newline at end of file
+	int vertex_indices[3];
+	int normal_indices[3];
+	int texture_indices[3];
+};
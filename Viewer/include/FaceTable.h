@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+#include "Face.h"
+
+// Triangle list stored as flat index arrays, three entries per triangle.
+// Indices are 1-based as in the OBJ file, 0 marks a missing index.
+// The texture and normal arrays stay empty until some corner actually references one.
+class FaceTable
+{
+public:
+	FaceTable();
+
+	void AddTriangle(const int* vertexIndices, const int* textureIndices, const int* normalIndices);
+	void Append(const FaceTable& other);
+	// Replaces the table with whole index arrays, e.g. from a binary format. An attribute array is
+	// either empty or as long as vertexIndices.
+	void Assign(std::vector<int> vertexIndices, std::vector<int> textureIndices, std::vector<int> normalIndices);
+	// The attribute arrays are only reserved when asked for, they may never be needed
+	void Reserve(size_t faceCount, bool textureIndices = false, bool normalIndices = false);
+	void Clear();
+
+	size_t GetFacesCount() const;
+	Face GetFace(size_t face) const;
+	int GetVertexIndex(size_t face, int corner) const;
+	// For remapping positions in place, three entries per face
+	std::vector<int>& GetVertexIndices();
+	int GetTextureIndex(size_t face, int corner) const;
+	int GetNormalIndex(size_t face, int corner) const;
+	bool HasTextureIndices() const;
+	bool HasNormalIndices() const;
+	size_t GetMemoryUsage() const;
+
+private:
+	static void AppendIndices(std::vector<int>& target, const std::vector<int>& source, size_t targetSize, size_t sourceSize);
+
+	std::vector<int> vertex_indices;
+	std::vector<int> texture_indices;
+	std::vector<int> normal_indices;
+};
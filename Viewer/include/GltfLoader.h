@@ -0,0 +1,95 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include "MappedFile.h"
+#include "MeshModel.h"
+#include "ObjParser.h"
+
+// Part of the BIN chunk that goes into a vertex buffer at offset
+struct GltfRange
+{
+	const char* data;
+	size_t size;
+	size_t offset;
+};
+
+// One primitive of a glTF mesh, ready for CreateExternalBuffers. The buffer view ranges its accessors read are
+// packed one after the other, so attributes from distant views do not drag the bytes between them along.
+// indexData points into the mapped file, or at the indices the reader had to make (8 bit or missing).
+struct GltfPrimitive
+{
+	std::string name;
+	std::vector<VertexAttribute> attributes;
+	std::vector<GltfRange> ranges;
+	size_t vertexBytes = 0;
+	size_t vertexCount = 0;
+	const void* indexData = nullptr;
+	size_t indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+	std::vector<GLushort> shortIndices;
+	std::vector<GLuint> intIndices;
+	// From the POSITION accessor's min and max, which glTF requires
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+	int material = -1;
+};
+
+// A primitive placed by a node, a mesh used by several nodes shares its primitives' geometry
+struct GltfInstance
+{
+	size_t primitive;
+	glm::mat4 transform;
+};
+
+struct GltfMaterial
+{
+	glm::vec3 ambient = glm::vec3(0.0f);
+	glm::vec3 diffuse = glm::vec3(1.0f);
+	glm::vec3 specular = glm::vec3(0.0f);
+	// Base color texture, an index into images
+	int image = -1;
+};
+
+// Encoded image bytes (PNG, JPEG) inside the BIN chunk
+struct GltfImage
+{
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+};
+
+struct GltfScene
+{
+	MappedFile file;
+	std::vector<GltfPrimitive> primitives;
+	std::vector<GltfInstance> instances;
+	std::vector<GltfMaterial> materials;
+	std::vector<GltfImage> images;
+};
+
+// Upload position of a scene that goes to the GPU over several frames
+struct GltfUpload
+{
+	size_t nextInstance = 0;
+	std::vector<std::shared_ptr<MeshModel>> models;
+	// The first instance of a primitive creates its buffers, the others share them
+	std::vector<std::shared_ptr<MeshModel>> owners;
+	std::vector<std::shared_ptr<Texture2D>> textures;
+	std::vector<bool> decoded;
+	size_t bytes = 0;
+	double milliseconds = 0.0;
+};
+
+// Binary glTF 2.0 (.glb). Accessors map onto glVertexAttribPointer formats and buffer views go to the GPU
+// as they are, so loading touches no vertex on the CPU. Materials become Ka/Kd/Ks and a texture, nodes
+// become model transforms.
+class GltfLoader
+{
+public:
+	// Worker thread: maps the file and resolves the JSON chunk into primitives, instances and materials
+	static bool Read(const std::string& filePath, GltfScene& scene, ObjParseProgress* progress = nullptr);
+	// GL thread: one model per instance, named after the file and the mesh. Uploads instances until budget runs
+	// out and returns true once every instance has its model.
+	static bool Upload(const GltfScene& scene, const std::string& modelName, GltfUpload& upload, size_t& budget);
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Just enough JSON for glTF: a parsed document as a tree of values.
+// Objects keep their members in file order and are searched linearly, glTF objects are small.
+class JsonValue
+{
+public:
+	enum class Type
+	{
+		Null,
+		Bool,
+		Number,
+		String,
+		Array,
+		Object
+	};
+
+	// Returns false and leaves value null on a syntax error
+	static bool Parse(const char* begin, const char* end, JsonValue& value);
+
+	Type GetType() const;
+	bool IsNull() const;
+	// Missing members and values of another type read as the fallback
+	double GetNumber(double fallback = 0.0) const;
+	bool GetBool(bool fallback = false) const;
+	const std::string& GetString() const;
+	// Array elements or object members
+	size_t GetSize() const;
+	const JsonValue& operator[](size_t index) const;
+	// A literal 0 would be ambiguous between the index and the key otherwise
+	const JsonValue& operator[](int index) const;
+	// Member of an object, a null value when there is none
+	const JsonValue& operator[](const char* key) const;
+	bool Has(const char* key) const;
+	const std::string& GetKey(size_t index) const;
+
+private:
+	friend class JsonReader;
+
+	Type type = Type::Null;
+	bool boolean = false;
+	double number = 0.0;
+	std::string text;
+	std::vector<JsonValue> elements;
+	std::vector<std::string> keys;
+};
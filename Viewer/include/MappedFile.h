@@ -0,0 +1,34 @@
+#pragma once
+#include <string>
+#include <cstddef>
+
+// Read-only view of a whole file mapped into memory.
+// The data stays valid until Close() is called or the object is destroyed.
+class MappedFile
+{
+public:
+	MappedFile();
+	explicit MappedFile(const std::string& filePath);
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	virtual ~MappedFile();
+
+	bool Open(const std::string& filePath);
+	void Close();
+	bool IsOpen() const;
+	const char* GetData() const;
+	size_t GetSize() const;
+
+private:
+	const char* data;
+	size_t size;
+	bool isOpen;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+};
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Process memory figures for load reports.
+// They cover the whole process, loads that overlap show up in each other's numbers.
+class MemoryStats
+{
+public:
+	static size_t GetResidentBytes();
+	// Largest resident size since the last ResetPeak (or since the process started where it cannot be reset)
+	static size_t GetPeakResidentBytes();
+	static void ResetPeak();
+	// Calls to the global operator new so far
+	static uint64_t GetAllocationCount();
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <unordered_map>
+#include <vector>
+#include "FaceTable.h"
+#include "MeshModel.h"
+
+// New vertices and indices produced by one MeshBuilder::Build call.
+// The indices only reference vertices of this batch or of earlier ones.
+struct MeshBatch
+{
+	const Vertex* vertices;
+	size_t firstVertex;
+	size_t vertexCount;
+	const GLuint* indices;
+	size_t firstIndex;
+	size_t indexCount;
+	// Known before the first batch: exact final index count and a guess of the vertex count
+	size_t totalIndexCount;
+	size_t vertexEstimate;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+using MeshBatchCallback = std::function<void(const MeshBatch&)>;
+
+// Turns OBJ face corners into indexed vertices. Corners that share the same
+// (position, texture, normal) indices become one vertex. Faces can be processed
+// in several steps, data from earlier steps never changes afterwards.
+class MeshBuilder
+{
+public:
+	MeshBuilder(const FaceTable& faces, const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& textureCoords);
+
+	// Processes up to faceCount more faces and returns what was added
+	MeshBatch Build(size_t faceCount);
+	bool IsDone() const;
+
+	std::vector<Vertex>& GetVertices();
+	std::vector<GLuint>& GetIndices();
+	// False when the file has no normals, the vertices then have zero normals
+	bool HasNormals() const;
+	bool HasTextureCoords() const;
+	// OBJ position index of every vertex, only recorded when HasNormals is false
+	const std::vector<GLuint>& GetVertexPositions() const;
+
+private:
+	struct CornerKey
+	{
+		int vertexIndex;
+		int textureIndex;
+		int normalIndex;
+
+		bool operator==(const CornerKey& other) const;
+	};
+
+	struct CornerKeyHash
+	{
+		size_t operator()(const CornerKey& key) const;
+	};
+
+	// One table node per distinct corner, millions for a large model. They come from an
+	// arena that lives as long as the build and is given back in one piece at the end.
+	struct CornerLookup
+	{
+		CornerLookup(size_t vertexEstimate, size_t cornerCount);
+
+		std::pmr::monotonic_buffer_resource arena;
+		std::pmr::unordered_map<CornerKey, GLuint, CornerKeyHash> cornerToVertex;
+	};
+
+	const FaceTable& faces;
+	const std::vector<glm::vec3>& positions;
+	const std::vector<glm::vec3>& normals;
+	const std::vector<glm::vec2>& textureCoords;
+	bool hasTextureCoords;
+	bool hasNormals;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	size_t nextFace;
+	std::unique_ptr<CornerLookup> lookup;
+	std::vector<Vertex> modelVertices;
+	std::vector<GLuint> modelIndices;
+	std::vector<GLuint> vertexPositions;
+};
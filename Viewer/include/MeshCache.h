@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+#include "MeshModel.h"
+
+// Binary cache of a model's final GPU data, stored next to the source file as "<file>.meshbin".
+// An entry only matches the source path, size and modification time it was built from.
+class MeshCache
+{
+public:
+	static const uint32_t Version = 7;
+
+	// How the stored data was processed, an entry only matches the same flags
+	static const uint32_t Optimized = 1;
+	static const uint32_t Tangents = 2;
+	static const uint32_t Welded = 4;
+
+	MeshCache();
+	static std::string GetCachePath(const std::string& modelPath);
+
+	// Maps the cache entry of modelPath. Fails if it is missing, stale or from another version,
+	// or if it was built with other flags, level of detail settings (lodKey) or normal and weld settings (normalKey).
+	// The returned pointers stay valid as long as this object is open.
+	bool Open(const std::string& modelPath, uint32_t flags = 0, uint32_t lodKey = 0, uint32_t normalKey = 0);
+	void Close();
+	// Indices are stored as 16 bit when every vertex can be addressed that way.
+	// The lods index ranges refer to indexData, which holds every level. tangentData has vertexCount entries if it is set.
+	// The bounds are stored so a warm load does not have to walk the vertices for them.
+	static bool Write(const std::string& modelPath, const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount,
+		const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t flags = 0, uint32_t lodKey = 0, uint32_t normalKey = 0, const std::vector<LodLevel>& lods = {}, const glm::vec4* tangentData = nullptr);
+
+	const Vertex* GetVertices() const;
+	size_t GetVertexCount() const;
+	const void* GetIndices() const;
+	size_t GetIndexCount() const;
+	uint32_t GetIndexSize() const;
+	GLenum GetIndexType() const;
+	const std::vector<LodLevel>& GetLods() const;
+	// One per vertex, null when the entry has none
+	const glm::vec4* GetTangents() const;
+	const glm::vec3& GetBoundsMin() const;
+	const glm::vec3& GetBoundsMax() const;
+
+private:
+	MappedFile file;
+	const Vertex* vertices;
+	size_t vertexCount;
+	const void* indices;
+	size_t indexCount;
+	uint32_t indexSize;
+	const glm::vec4* tangents;
+	std::vector<LodLevel> lods;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
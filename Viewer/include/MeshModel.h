@@ -1,9 +1,9 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <string>
-#include "Face.h"
+#include <cstdint>
+#include "FaceTable.h"
 #include <glad/glad.h>
-#include "Utils.h"
 #include <vector>
 #include <string>
 #include <iostream>
@@ -11,8 +11,11 @@
 #include <sstream>
 #include <random>
 #include <memory>
+#include <functional>
 #include <glm/gtc/matrix_transform.hpp>
 
+class Texture2D;
+
 struct Vertex
 {
 	glm::vec3 position;
@@ -20,12 +23,164 @@ struct Vertex
 	glm::vec2 textureCoords;
 };
 
+// Compressed vertex layout, 16 bytes instead of 32: position as 16 bit unorm inside the
+// model's bounding cube, normal as signed 10:10:10:2, texture coords as half floats
+struct QuantizedVertex
+{
+	GLushort position[4];
+	GLuint normal;
+	GLushort textureCoords[2];
+};
+
+// One attribute of an External vertex layout: the arguments of its glVertexAttribPointer call
+struct VertexAttribute
+{
+	GLuint index;
+	GLint size;
+	GLenum type;
+	GLboolean normalized;
+	GLsizei stride;
+	size_t offset;
+};
+
+enum class VertexFormat
+{
+	Float,
+	Quantized,
+	// Whatever layout the file had, described by the geometry's attributes (e.g. glTF accessors)
+	External
+};
+
+// Largest differences between the float vertices and what the quantized ones decode to
+struct QuantizationError
+{
+	float maxPosition;
+	float maxNormalDegrees;
+	float maxTextureCoords;
+	float boundsDiagonal;
+};
+
+// How much of a model's geometry stays in RAM once it is on the GPU
+enum class MeshResidency
+{
+	// The OBJ arrays, the indexed vertices and the indices
+	Full,
+	// Vertex positions and indices, enough for picking and bounds
+	Compact,
+	// Nothing, the GPU buffers are the only copy
+	GpuOnly
+};
+
+// Which vertex array a draw binds: the whole vertex, or only the positions for depth and other passes that need nothing else
+enum class DrawPass
+{
+	Shaded,
+	PositionOnly
+};
+
+// Where the texture coordinates a model is drawn with come from
+enum class UvProjection
+{
+	// The model's own
+	None,
+	// Straight through the model along the thinnest axis of its bounds
+	Planar,
+	// Around the y axis through the center of the bounds, v runs along the axis
+	Cylindrical,
+	// Longitude and latitude around the center of the bounds
+	Spherical,
+	// Planar along whichever axis the normal points the most
+	Box
+};
+
+// The mesh cache entry a model's data can be read back from, no entry when modelPath is empty
+struct MeshCacheSource
+{
+	std::string modelPath;
+	uint32_t flags = 0;
+	uint32_t lodKey = 0;
+	uint32_t normalKey = 0;
+};
+
+// One level of detail: a range of modelIndices (and of the index buffer) over the shared vertices
+struct LodLevel
+{
+	size_t firstIndex;
+	size_t indexCount;
+	// Largest distance the simplification moved the surface, in model units
+	float error;
+};
+
+// Geometry read from one file and its GPU buffers. Every MeshModel instance of the file shares one
+// through a shared_ptr, the buffers are deleted with the last of them (on the GL thread).
+struct MeshGeometry
+{
+	MeshGeometry() = default;
+	MeshGeometry(const MeshGeometry&) = delete;
+	MeshGeometry& operator=(const MeshGeometry&) = delete;
+	~MeshGeometry();
+
+	GLuint vbo = 0;
+	GLuint vao = 0;
+	GLuint ibo = 0;
+	// Extra vertex stream (attribute 3), only for models loaded with tangents
+	GLuint tangentVbo = 0;
+	// Projected texture coords (attribute 2 instead of the vertex's own), only while a projection is set
+	GLuint uvVbo = 0;
+	UvProjection uvProjection = UvProjection::None;
+	// Second copy of the positions, tightly packed, with its own VAO over the same index buffer
+	GLuint positionVbo = 0;
+	GLuint positionVao = 0;
+	bool positionStream = false;
+	std::vector<Vertex> modelVertices;
+	std::vector<GLuint> modelIndices;
+	// Level 0 is the full mesh, the coarser levels follow it in modelIndices. Empty when there are none.
+	std::vector<LodLevel> lods;
+	// Tangent and handedness of every vertex, see NormalGenerator::GenerateTangents. Empty when there are none.
+	std::vector<glm::vec4> modelTangents;
+	size_t tangentCount = 0;
+	MeshCacheSource cacheSource;
+	// File the geometry was read from, empty for geometry that came from elsewhere
+	std::string sourcePath;
+	// The file had no normals, a cold load computed them
+	bool generatedNormals = false;
+
+	size_t vertexCount = 0;
+	size_t vertexCapacity = 0;
+	size_t residentVertexCount = 0;
+	size_t residentIndexCount = 0;
+	size_t indexCount = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+	VertexFormat vertexFormat = VertexFormat::Float;
+	// External layout: where each attribute is in vbo, and the size of vbo
+	std::vector<VertexAttribute> attributes;
+	size_t vertexBytes = 0;
+	glm::vec3 quantizeOrigin = glm::vec3(0.0f);
+	float quantizeScale = 1.0f;
+	glm::vec3 boundsMin = glm::vec3(0.0f);
+	glm::vec3 boundsMax = glm::vec3(0.0f);
+	MeshResidency residency = MeshResidency::Full;
+	std::vector<glm::vec3> compactPositions;
+	FaceTable faces;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> textureCoords;
+};
+
+// One instance of a model in the scene: its own transforms and material over shared geometry
 class MeshModel
 {
 public:
-	MeshModel(std::vector<Face> faces, std::vector<glm::vec3> vertices, std::vector<glm::vec3> normals, std::vector<glm::vec2> textureCoords, const std::string& model_name);
+	MeshModel(FaceTable faces, std::vector<glm::vec3> vertices, std::vector<glm::vec3> normals, std::vector<glm::vec2> textureCoords, const std::string& model_name);
+	// Takes vertex and index data that was already built, e.g. batch by batch by a MeshBuilder
+	MeshModel(FaceTable faces, std::vector<glm::vec3> vertices, std::vector<glm::vec3> normals, std::vector<glm::vec2> textureCoords,
+		std::vector<Vertex> modelVertices, std::vector<GLuint> modelIndices, const std::string& model_name);
+	// Model without CPU geometry, its GPU data comes from elsewhere (e.g. a mesh cache entry)
+	MeshModel(const std::string& model_name);
+	// Another instance of geometry that is already loaded, costs no I/O and no GPU memory
+	MeshModel(std::shared_ptr<MeshGeometry> geometry, const std::string& model_name);
 	virtual ~MeshModel();
-	const Face& GetFace(int index) const;
+	Face GetFace(int index) const;
 	int GetFacesCount() const;
 	const std::string& GetModelName() const;
 	std::vector<glm::vec3>& getVertices();
@@ -42,12 +197,17 @@ public:
 	float GetNormal(int index, int coordinate);
 	std::vector<glm::vec3> GetNormals();
 	int getVerticesSize()  {
-		return vertices.size();
+		return geometry->vertices.size();
 	}
 	glm::mat4x4 GetTransform()
 	{
 		return   localTransform * worldTransform;
 	}
+	// Model transform with the position dequantization folded in
+	glm::mat4x4 GetDrawTransform()
+	{
+		return GetTransform() * GetDequantizeTransform();
+	}
 	glm::vec3 GetColor()
 	{
 		return modelColor;
@@ -99,8 +259,84 @@ public:
 	}
 	glm::vec3 MeshModel::GetPosition();
 	GLuint GetVao() const;
+	// PositionOnly falls back to the full vertex array when the model has no position stream
+	GLuint GetVao(DrawPass pass) const;
 	const std::vector<Vertex>& GetModelVertices();
-	void MeshModel::SetPlane();
+	size_t GetVertexCount() const;
+	const std::vector<GLuint>& GetModelIndices() const;
+	size_t GetIndexCount() const;
+	GLenum GetIndexType() const;
+	size_t GetIndexSize() const;
+	static GLenum ChooseIndexType(size_t vertexCount);
+
+	// Must be set before CreateBuffers. Quantized positions are stored relative to the given bounds.
+	void SetVertexFormat(VertexFormat format, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	VertexFormat GetVertexFormat() const;
+	size_t GetVertexSize() const;
+	glm::mat4x4 GetDequantizeTransform() const;
+	QuantizedVertex QuantizeVertex(const Vertex& vertex) const;
+	Vertex DequantizeVertex(const QuantizedVertex& vertex) const;
+	QuantizationError MeasureQuantizationError(const Vertex* vertexData, size_t count) const;
+	static void ComputeBounds(const Vertex* vertexData, size_t count, glm::vec3& boundsMin, glm::vec3& boundsMax);
+	// Model space bounds, computed from modelVertices by the constructors that get CPU geometry
+	void SetBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	const glm::vec3& GetBoundsMin() const;
+	const glm::vec3& GetBoundsMax() const;
+
+	// GPU upload, only valid on the thread that owns the GL context.
+	// Index data passed to UploadIndices must already be in the buffer's index type.
+	void CreateBuffers(size_t vertexCount, size_t indexCount, GLenum indexType);
+	void UploadVertices(size_t first, size_t count, const Vertex* vertexData);
+	void UploadIndices(size_t first, size_t count, const void* indexData);
+	// Vertex data in an External layout goes up as it is, e.g. glTF buffer views straight from the mapped file.
+	// UploadModelData turns the model back into the Float layout.
+	void CreateExternalBuffers(const void* vertexData, size_t vertexBytes, size_t vertexCount, std::vector<VertexAttribute> attributes,
+		const void* indexData, size_t indexCount, GLenum indexType);
+	void UploadToGpu();
+	// Rewrites the existing buffers from modelVertices, modelIndices and modelTangents, the index buffer grows if needed
+	void UploadModelData();
+	// Creates or replaces the tangent stream, one tangent per vertex
+	void UploadTangents(const glm::vec4* tangentData, size_t count);
+	bool HasTangents() const;
+	bool IsUploaded() const;
+
+	// Streaming: the vertex buffer grows as batches arrive, the index buffer is sized up front
+	// by CreateBuffers. Only the indices uploaded so far are drawn.
+	void ReserveVertices(size_t capacity);
+	void AppendVertices(const Vertex* vertexData, size_t count);
+	void AppendIndices(const GLuint* indexData, size_t count);
+	size_t GetResidentIndexCount() const;
+	// Draws source's geometry from now on, e.g. the final data of a streamed model once it is on the GPU
+	void AdoptGeometry(const MeshModel& source);
+
+	// Computes texture coords once into their own 8 byte per vertex stream, None goes back to the
+	// model's own. Applies to every instance of the geometry. Needs the CPU positions for a moment,
+	// a GpuOnly model reads them back.
+	void SetUvProjection(UvProjection mode);
+	UvProjection GetUvProjection() const;
+
+	// Keeps the positions a second time on the GPU, 12 bytes per vertex (8 when quantized), so that
+	// position only passes fetch that instead of the whole vertex. Applies to every instance.
+	void SetPositionStream(bool enabled);
+	bool HasPositionStream() const;
+	size_t GetPositionSize() const;
+
+	// Frees the CPU data the mode does not keep, or brings it back with RestoreModelData.
+	// GetFace, getVertices and the other OBJ accessors need Full.
+	void SetResidency(MeshResidency mode);
+	MeshResidency GetResidency() const;
+	// Refills modelVertices and modelIndices from the mesh cache, or else by reading the GPU buffers
+	// back (GL thread only, quantized vertices come back with their quantization error)
+	bool RestoreModelData();
+	// Positions of the indexed vertices, only kept under Compact (Full has them in modelVertices)
+	const std::vector<glm::vec3>& GetCompactPositions() const;
+	size_t GetCpuMemoryUsage() const;
+	size_t GetGpuMemoryUsage() const;
+	// Residency, the buffers and the data above belong to the geometry, so they change for every instance
+	MeshGeometry& GetGeometry() const;
+	const std::shared_ptr<MeshGeometry>& GetSharedGeometry() const;
+	// Instances drawing this model's geometry, including this one
+	long GetInstanceCount() const;
 
 	bool worldAxes;
 	bool localAxes;
@@ -117,17 +353,25 @@ public:
 	glm::vec3 Kd;
 	glm::vec3 Ks;
 	glm::vec3 color;
-	GLuint vbo;
-	GLuint vao;
-	std::vector<Vertex> modelVertices;
+	// Drawn instead of the renderer's default texture when set
+	std::shared_ptr<Texture2D> texture;
 
 private:
-	std::vector<Face> faces;
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec3> normals;
+	void InitProperties();
+	void SetVertexAttributes();
+	bool HasVertexAttribute(GLuint index) const;
+	void RebuildObjData();
+	void ProjectUvs();
+	void ReleaseUvStream();
+	void UploadPositions();
+	void ReleasePositionStream();
+	// Calls use(positions, normals, stride) on the CPU vertices. Under Compact normals is null,
+	// GpuOnly reads the vertices back for the call. False when there was nothing to read.
+	bool WithVertexPositions(const std::function<void(const glm::vec3*, const glm::vec3*, size_t)>& use);
+
+	std::shared_ptr<MeshGeometry> geometry;
 	std::string model_name;
 	glm::vec3 modelColor;
-	std::vector<glm::vec2> textureCoords;
 
 	
 };
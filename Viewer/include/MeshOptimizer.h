@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include "MeshModel.h"
+
+// Post-transform vertex cache efficiency of an index buffer, simulated with a FIFO cache
+struct VertexCacheStats
+{
+	// Cache misses per triangle (ideal ~0.5, worst 3) and per vertex (ideal 1)
+	float acmr;
+	float atvr;
+};
+
+// Reorders an indexed triangle list for the GPU. Run in this order: vertex cache, overdraw, vertex fetch.
+class MeshOptimizer
+{
+public:
+	static const size_t CacheSize = 16;
+
+	static VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize = CacheSize);
+
+	// Tipsify (Sander et al. 2007): fans around recently used vertices so they are still in the cache.
+	// The input order is kept if it already simulates better.
+	static void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize = CacheSize);
+
+	// Splits the cache-ordered list into clusters and draws clusters that face outward first,
+	// so early-z rejects more of what comes later. A cluster may cost at most threshold times its ACMR.
+	static void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices, float threshold = 1.05f, size_t cacheSize = CacheSize);
+
+	// Renumbers the vertices in first-use order so the vertex fetch walks memory forward.
+	// Vertices no triangle uses are dropped. tangents, if given and not empty, is reordered along.
+	static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, std::vector<glm::vec4>* tangents = nullptr);
+};
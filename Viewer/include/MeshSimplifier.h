@@ -0,0 +1,15 @@
+#pragma once
+#include <vector>
+#include "MeshModel.h"
+
+// Quadric error metric edge-collapse simplification (Garland & Heckbert 1997).
+// Collapses move a vertex onto a neighbour, so every level reuses the original vertex array
+// and only the index list changes. Vertices on open borders or on attribute seams
+// (same position, different normal or texture coords) never move.
+class MeshSimplifier
+{
+public:
+	// Writes a triangle list with at most targetIndexCount indices, or as close as the locked
+	// vertices allow. Returns the largest collapse error as a distance in model units.
+	static float Simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, size_t targetIndexCount, std::vector<GLuint>& result);
+};
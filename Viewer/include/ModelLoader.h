@@ -0,0 +1,129 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "GltfLoader.h"
+#include "MeshCache.h"
+#include "MeshModel.h"
+#include "ObjParser.h"
+#include "Utils.h"
+
+class Scene;
+
+// Loads models without blocking the frame loop. Parsing and vertex building run on the
+// thread pool, the GL upload is spread over several frames on the main thread by Update().
+class ModelLoader
+{
+public:
+	enum class LoadState
+	{
+		Reading,
+		Streaming,
+		Uploading,
+		Done,
+		Cancelled,
+		Failed
+	};
+
+	struct StreamBatch
+	{
+		std::vector<Vertex> vertices;
+		std::vector<GLuint> indices;
+	};
+
+	struct LoadJob
+	{
+		std::string filePath;
+		std::string modelName;
+		bool streaming = false;
+		bool quantize = false;
+		bool positionStream = false;
+		MeshLoadOptions options;
+		MeshResidency residency = MeshResidency::Full;
+		// Another instance of geometry that was already loaded, the model is set from the start
+		bool instance = false;
+		// Reload: the finished geometry replaces this model's instead of becoming a model of its own
+		std::shared_ptr<MeshModel> target;
+		std::atomic<LoadState> state{ LoadState::Reading };
+		ObjParseProgress progress;
+		std::chrono::steady_clock::time_point startTime;
+		double firstPixelTime = -1.0;
+
+		// Streaming: batches built by the worker wait here for Update.
+		// builtModel holds the finished CPU data once the last batch was queued.
+		std::mutex batchMutex;
+		std::deque<StreamBatch> batches;
+		size_t streamIndexCount = 0;
+		size_t streamVertexEstimate = 0;
+		glm::vec3 streamBoundsMin;
+		glm::vec3 streamBoundsMax;
+		std::shared_ptr<MeshModel> builtModel;
+		bool inScene = false;
+
+		// Filled in by the worker before the state becomes Uploading
+		std::shared_ptr<MeshModel> model;
+		MeshCache cache;
+		std::vector<GLushort> shortIndices;
+		const Vertex* vertexSource = nullptr;
+		const void* indexSource = nullptr;
+		const glm::vec4* tangentSource = nullptr;
+		size_t vertexCount = 0;
+		size_t indexCount = 0;
+		GLenum indexType = GL_UNSIGNED_INT;
+		// GLB files: the resolved scene, uploaded a primitive at a time. It brings one model per node
+		// primitive, model is the first of them.
+		std::shared_ptr<GltfScene> gltf;
+		GltfUpload gltfUpload;
+		std::vector<std::shared_ptr<MeshModel>> gltfModels;
+
+		// Main thread upload position
+		size_t verticesUploaded = 0;
+		size_t indicesUploaded = 0;
+	};
+
+	// Upload budget per frame, large models take several frames to reach the GPU
+	static const size_t UploadBytesPerFrame = 16 << 20;
+
+	// Put models in the scene while they load and draw whatever already reached the GPU
+	bool streaming;
+	// Upload new models in the 16 byte QuantizedVertex layout
+	bool quantizeVertices;
+	// Give new models a position only stream for depth passes
+	bool positionStreams;
+	// Optimization and levels of detail for new models
+	MeshLoadOptions meshOptions;
+	// What new models keep in RAM once they are on the GPU
+	MeshResidency residency;
+
+	ModelLoader();
+	virtual ~ModelLoader();
+	ModelLoader(const ModelLoader&) = delete;
+	ModelLoader& operator=(const ModelLoader&) = delete;
+
+	void Load(const std::string& filePath);
+	// Reads the file of model again with the current meshOptions and swaps the result into model, which keeps
+	// its place in the scene, transforms and material. False if the model does not come from a file.
+	bool Reload(const std::shared_ptr<MeshModel>& model);
+	void Cancel(size_t jobIndex);
+
+	// Main thread only: continues the GL uploads and adds finished models to the scene
+	void Update(Scene& scene);
+
+	size_t GetJobCount() const;
+	const LoadJob& GetJob(size_t jobIndex) const;
+	static float GetProgress(const LoadJob& job);
+	static const char* GetStateName(const LoadJob& job);
+
+private:
+	static void ReadJob(const std::shared_ptr<LoadJob>& job);
+	static bool UploadStep(LoadJob& job, MeshModel& model, size_t& budget);
+	static bool StreamStep(LoadJob& job, Scene& scene, size_t& budget);
+	static bool GltfStep(LoadJob& job, size_t& budget);
+	static void ReportTimes(LoadJob& job);
+
+	std::vector<std::shared_ptr<LoadJob>> jobs;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include "MeshModel.h"
+
+// How much each face adds to the normal of a vertex it touches
+enum class NormalWeighting
+{
+	// Face area, large faces dominate
+	Area,
+	// Angle of the face at the vertex, independent of how the surface is triangulated
+	Angle
+};
+
+// Vertex normals for meshes that come without them, and tangent frames for normal mapping
+class NormalGenerator
+{
+public:
+	// positionOf maps every vertex to the surface point it sits on, vertices that only differ in
+	// texture coords share one. The faces around a point are smoothed in groups, a face joins the first
+	// group whose mean normal is within creaseAngle degrees of its own, so a vertex can end up with
+	// several normals: it is then split and indices are updated. Runs in parallel on the thread pool and needs no atomics: every
+	// point gathers from its own faces and writes only its own corners.
+	static void Generate(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, const std::vector<GLuint>& positionOf, size_t positionCount,
+		float creaseAngle, NormalWeighting weighting);
+
+	// One tangent per vertex along increasing u, in the xyz of the result, with the handedness in w:
+	// bitangent = w * cross(normal, tangent). Follows MikkTSpace: face tangents are projected into the
+	// plane of the vertex normal and weighted by their angle at the vertex, and a vertex shared by
+	// mirrored and regular texture space is split. Only the first baseIndexCount indices (the full mesh)
+	// contribute, coarser levels of detail after them are remapped to the split vertices as well.
+	static void GenerateTangents(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, size_t baseIndexCount, std::vector<glm::vec4>& tangents);
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <atomic>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "FaceTable.h"
+
+// Geometry read from an OBJ file (or a PLY or STL file, see PlyParser and StlParser), in file order.
+// Face indices are resolved to positive 1-based indices (negative OBJ indices included)
+// and polygons are triangulated.
+struct ObjData
+{
+	FaceTable faces;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec3> normals;
+	std::vector<glm::vec2> textureCoords;
+	size_t unknownLines = 0;
+};
+
+// Lets another thread follow a running parse and stop it
+struct ObjParseProgress
+{
+	std::atomic<size_t> bytesDone{ 0 };
+	std::atomic<size_t> bytesTotal{ 0 };
+	std::atomic<bool> cancelled{ false };
+
+	float GetFraction() const
+	{
+		size_t total = bytesTotal;
+		return total > 0 ? (float)bytesDone / (float)total : 0.0f;
+	}
+};
+
+// OBJ tokenizer that works in place on the raw file bytes.
+// Numbers are read with std::from_chars, so there is no per-line string or stream.
+class ObjParser
+{
+public:
+	// Returns false if the file could not be opened or the parse was cancelled
+	static bool ParseFile(const std::string& filePath, ObjData& data, size_t* fileSize = nullptr, ObjParseProgress* progress = nullptr);
+
+	// Splits the text into newline-aligned chunks that are parsed on the thread pool.
+	// The result is the same for any chunk count.
+	static bool Parse(const char* begin, const char* end, ObjData& data, size_t chunkCount = 1, ObjParseProgress* progress = nullptr);
+	static size_t GetDefaultChunkCount(size_t byteCount);
+};
@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+#include "ObjParser.h"
+
+// Binary PLY reader, little and big endian. Vertices become positions with optional normals
+// (nx ny nz) and texture coords (u v, s t or texture_u texture_v), face lists are triangulated as fans.
+// Every PLY vertex carries all of its attributes, so a corner uses the same index into all three arrays.
+// Numbers are read straight from the mapped file, vertex ranges are decoded on the thread pool.
+class PlyParser
+{
+public:
+	// Returns false if the file could not be opened, is not binary PLY, or the parse was cancelled
+	static bool ParseFile(const std::string& filePath, ObjData& data, size_t* fileSize = nullptr, ObjParseProgress* progress = nullptr);
+	static bool Parse(const char* begin, const char* end, ObjData& data, ObjParseProgress* progress = nullptr);
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+
+// Inner loops of the software rasterizer, from the slowest to the fastest
+enum class RasterKernel
+{
+	Scalar,
+	// 4 pixels at once
+	Sse41,
+	// 8 pixels at once, with masked depth loads and stores
+	Avx2
+};
+
+// One triangle over a rectangle of pixels, on a grid of 1 / SubpixelScale pixel. Edge i is twice the signed
+// area of a point and the side opposite corner i, positive inside, and the three add up to area at every point.
+// stepX and stepY are how much an edge changes per subpixel to the right and up, so per pixel it changes by
+// SubpixelScale times that. Edges, tests and depth are at the center of pixel (originX, originY), the corner
+// of the rectangle as set up. The rectangle may be narrowed afterwards, which leaves every pixel's values as they were.
+struct EdgeSetup
+{
+	// Exact edges at the origin, for the barycentrics
+	int64_t edges[3];
+	int32_t stepX[3];
+	int32_t stepY[3];
+	// What the kernels test: pixel (originX + dx, originY + dy) is covered when tests[i] + dx * stepX[i] + dy * stepY[i]
+	// is not negative for all three edges. It is the edge minus the tie bias divided by SubpixelScale and
+	// rounded down, clamped where the sign can no longer change over the rectangle, which keeps it in 32 bits.
+	int32_t tests[3];
+	float area;
+	float depth;
+	float depthStepX;
+	float depthStepY;
+	int originX;
+	int originY;
+	int minX;
+	int minY;
+	int maxX;
+	int maxY;
+};
+
+// Pixels drawn by the watertightness test
+struct WatertightResult
+{
+	// Pixels covered by exactly one front and one back facing triangle, as every pixel of the sphere should be
+	size_t pixels = 0;
+	size_t drawnTwice = 0;
+	// Covered from one side only, the other has a crack there
+	size_t missed = 0;
+	int frames = 0;
+};
+
+// Coverage mask of Width pixels of a row after the depth test, bit i is pixel x + i. x is a multiple of Width.
+struct RasterBlock
+{
+	static const int Width = 8;
+
+	int x;
+	int y;
+	unsigned mask;
+};
+
+// Coverage and depth test of one triangle. Vertices are snapped to SubpixelBits of subpixel precision and
+// the edges are evaluated in integers, with the top-left rule for pixel centers exactly on an edge: they
+// belong to the triangle when the edge is a left edge, or a horizontal edge above the inside. Two triangles
+// that share an edge therefore cover every pixel along it exactly once, and every kernel covers exactly
+// the same pixels. Depth is interpolated in floats with the same operations in every kernel.
+class RasterKernels
+{
+public:
+	static const int SubpixelBits = 8;
+	static const int SubpixelScale = 1 << SubpixelBits;
+	// Vertices must be within this many pixels of the origin, the edges then fit their integers
+	static const int GuardBand = 1 << 13;
+	// Largest side of the rectangle a triangle is set up over
+	static const int MaxRectangle = 64;
+
+	// Rounds a screen position in pixels to the subpixel grid
+	static glm::ivec2 Snap(const glm::vec2& screen);
+	// The pixels whose centers are inside the bounds of the snapped triangle. False when it has no area.
+	static bool GetPixelBounds(const glm::ivec2* vertices, int& minX, int& minY, int& maxX, int& maxY);
+	// Sets up the snapped triangle over the pixels of [minX, maxX] x [minY, maxY] whose centers are inside its
+	// bounds. False when there are none or the triangle has no area. Either winding works, edges / area are
+	// the barycentric coordinates of the corners in both.
+	static bool SetupTriangle(const glm::ivec2* vertices, const glm::vec3& depth, int minX, int minY, int maxX, int maxY, EdgeSetup& setup);
+	// Writes the depth of every pixel of the rectangle that is inside all three edges, closer than what
+	// depthBuffer has and not beyond the far plane, and lists the blocks with such pixels. blocks needs
+	// GetMaxBlocks of the rectangle's size. Returns the number of blocks. depthBuffer has width pixels per row.
+	// The rectangle must lie in one tile whose left edge is a multiple of RasterBlock::Width: a kernel may
+	// rewrite the depth of other pixels of a block with the value they have, but never outside the tile.
+	static size_t Rasterize(RasterKernel kernel, const EdgeSetup& setup, float* depthBuffer, int width, RasterBlock* blocks);
+	static size_t GetMaxBlocks(int width, int height);
+	// Row fills for clearing: count RGB pixels, or count depths
+	static void FillColor(float* pixels, size_t count, const glm::vec3& color);
+	static void FillDepth(float* depths, size_t count, float depth);
+	static bool IsSupported(RasterKernel kernel);
+	// The fastest kernel this CPU runs
+	static RasterKernel GetBest();
+	static const char* GetName(RasterKernel kernel);
+	// Millions of covered pixels per second over a fixed set of triangles of all sizes in one tile,
+	// 0 when the CPU does not run the kernel
+	static double Benchmark(RasterKernel kernel);
+	// Counts how many times the kernel covers each pixel of a closed sphere of small triangles, in frames
+	// random orientations over a width x height screen. The vertices are rounded to a quarter pixel, so
+	// that many edges run exactly through pixel centers.
+	static WatertightResult TestWatertight(RasterKernel kernel, int width, int height, int frames);
+};
@@ -2,6 +2,7 @@
 #include "Scene.h"
 #include "ShaderProgram.h"
 #include "Texture2D.h"
+#include "SoftwareRasterizer.h"
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -19,6 +20,8 @@ public:
 	virtual ~Renderer();
 	void Render(Scene& scene);
 	void SwapBuffers();
+	// Clears color_buffer and z_buffer for the next Render. The CPU rasterizer clears its tiles as it draws
+	// them, and a frame it does not draw skips the clear when the buffer already holds that color.
 	void ClearColorBuffer(const glm::vec3& color);
 	int GetViewportWidth() const;
 	int GetViewportHeight() const;
@@ -27,6 +30,7 @@ public:
 	void LoadTextures();
 	ShaderProgram lightShader;
 	ShaderProgram colorShader;
+	ShaderProgram depthShader;
 	Texture2D texture1;
 	Texture2D texture_normalmap;
 
@@ -37,9 +41,22 @@ private:
 	void CreateBuffers(int w, int h);
 	void CreateOpenglBuffer();
 	void InitOpenglRendering();
+	float GetProjectedDiameter(MeshModel& model, Camera& camera) const;
+	LodLevel SelectLod(Scene& scene, MeshModel& model, Camera& camera, bool recordStats) const;
+	void DrawDepthPass(MeshModel& model, Camera& camera, const LodLevel& lod, DrawPass pass);
+	double TimeDepthPass(MeshModel& model, Camera& camera, const LodLevel& lod, DrawPass pass, int repeats);
+	// Draws every model into color_buffer and z_buffer on the CPU instead of through GL
+	void RenderSoftware(Scene& scene, const std::vector<LodLevel>& lods);
+	// Runs the clear of ClearColorBuffer on the whole color_buffer, for frames the CPU rasterizer does not draw
+	void FlushClear();
 
 	float* color_buffer;
 	float* z_buffer;
+	glm::vec3 pending_clear_color;
+	bool clear_pending;
+	// False while color_buffer holds nothing but cleared_color
+	bool color_buffer_drawn;
+	glm::vec3 cleared_color;
 	int viewport_width;
 	int viewport_height;
 	GLuint gl_screen_tex;
@@ -51,5 +68,9 @@ private:
 	bool paint_triangle;
 	bool gray_scale;
 	bool color_with_buffer;
+	SoftwareRasterizer rasterizer;
+	// scene.normal_map_file as last loaded into texture_normalmap, and whether that worked
+	std::string normal_map_loaded;
+	bool normal_map_ready;
 
 };
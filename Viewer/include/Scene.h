@@ -6,6 +6,7 @@
 #include "Camera.h"
 #include "Light.h"
 #include "MeshModel.h"
+#include "SoftwareRasterizer.h"
 using namespace std;
 
 class Scene {
@@ -13,9 +14,11 @@ public:
 	Scene();
 
 	void AddModel(const shared_ptr<MeshModel>& mesh_model);
+	void RemoveModel(const shared_ptr<MeshModel>& mesh_model);
 	int GetModelCount() const;
 	MeshModel& GetModel(int index) const;
 	MeshModel& GetActiveModel() const;
+	const shared_ptr<MeshModel>& GetActiveModelPointer() const;
 	void AddCamera(const shared_ptr<Camera>& camera);
 	int GetCameraCount() const;
 	Camera& GetCamera(int index);
@@ -48,9 +51,35 @@ public:
 	bool more_than_1_light;
 	bool blur;
 	bool normal_map;
+	// Tangent space normal map image, the renderer loads it when the name changes
+	string normal_map_file;
 	bool toon_shading;
 	float levels;
 	bool use_texture;
+	// Level of detail: level i+1 is drawn once the model's projected diameter drops below lod_thresholds[i] pixels
+	bool use_lod;
+	vector<float> lod_thresholds;
+	// What the renderer picked in the last frame
+	int lod_level_drawn;
+	float lod_screen_size;
+	// Depth only pass before the shaded one, it binds the model's position stream when there is one
+	bool depth_prepass;
+	// Set to time the depth pass once with each vertex array, the renderer clears it and fills in the times
+	bool benchmark_depth_pass;
+	double depth_pass_ms_full;
+	double depth_pass_ms_positions;
+	// Rasterize on the CPU into the renderer's color and depth buffers, with the times of the last frame
+	bool software_rendering;
+	double software_frame_ms;
+	RasterStats software_stats;
+	RasterKernel software_kernel;
+	bool software_hierarchical_depth;
+	// Set to measure every raster kernel once, the renderer clears it and fills in millions of pixels per second
+	bool benchmark_raster_kernels;
+	double raster_kernel_mpixels[3];
+	// Set to count the pixels the selected kernel draws twice or misses on a closed mesh, the renderer clears it
+	bool test_raster_watertight;
+	WatertightResult raster_watertight;
 
 
 private:
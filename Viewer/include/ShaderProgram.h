@@ -21,6 +21,8 @@ public:
 		PROGRAM
 	};
 
+	// Fixes an input's attribute index, takes effect when loadShaders links the program
+	void bindAttribLocation(GLuint index, const GLchar* name);
 	bool loadShaders(const char* vsFilename, const char* fsFilename);
 	void use();
 
@@ -45,5 +47,6 @@ private:
 
 	GLuint programHandle;
 	std::map<string, GLint> uniformLocations;
+	std::map<string, GLuint> attribLocations;
 };
 #endif // SHADER_H
\ No newline at end of file
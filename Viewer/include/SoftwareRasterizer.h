@@ -0,0 +1,164 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "MeshModel.h"
+#include "RasterKernels.h"
+
+// Shading inputs of one draw
+struct RasterMaterial
+{
+	glm::vec3 ambient;
+	glm::vec3 diffuse;
+	glm::vec3 specular;
+	// Lit by a light at the eye when the scene has no lighting
+	glm::vec3 color;
+};
+
+// Phong lighting from one point light, the same terms as the GL path
+struct RasterLighting
+{
+	bool enabled = false;
+	glm::vec3 position = glm::vec3(0.0f);
+	glm::vec3 ambient = glm::vec3(0.0f);
+	glm::vec3 diffuse = glm::vec3(0.0f);
+	glm::vec3 specular = glm::vec3(0.0f);
+	float shininess = 1.0f;
+	glm::vec3 eye = glm::vec3(0.0f);
+};
+
+// Milliseconds per stage of the last frame
+struct RasterStats
+{
+	double vertexMs = 0.0;
+	double binMs = 0.0;
+	double rasterMs = 0.0;
+	size_t triangles = 0;
+	// Triangles that reached a bin, after clipping and dropping the ones that cover no pixel center
+	size_t binnedTriangles = 0;
+	// Triangle and tile pairs, a triangle is binned into every tile its bounds touch
+	size_t binEntries = 0;
+	// Rejected by the hierarchical depth before any per-pixel work: triangle and tile pairs, DepthBlock
+	// squares of the triangles that were not, and the pixels of the triangles' rectangles in both
+	size_t rejectedTriangles = 0;
+	size_t rejectedBlocks = 0;
+	size_t rejectedPixels = 0;
+	unsigned threads = 0;
+};
+
+// Triangle rasterizer on the CPU. Draw transforms the vertices and sorts the triangles into
+// TileSize square screen tiles, both in parallel on the thread pool. End then rasterizes and shades
+// every tile as one job: a tile only writes its own pixels, so the jobs need no locks, and it walks
+// its triangles in submission order, so the image does not depend on the threads. Coverage and depth
+// run in a RasterKernels kernel, the pixels it passes on are shaded one by one. Triangles are clipped to
+// the kernels' guard band, so that large ones near the eye still snap to the fixed point grid exactly.
+// Each tile also keeps the farthest depth of every DepthBlock square, to reject the triangles and the
+// blocks of them that are behind it before the kernel tests their pixels.
+class SoftwareRasterizer
+{
+public:
+	static const int TileSize = 64;
+	// Side of the squares the hierarchical depth keeps the farthest stored depth of
+	static const int DepthBlock = 8;
+
+	SoftwareRasterizer();
+
+	// Starts a frame into RGB float color and one depth per pixel, rows bottom up as in GL.
+	// Depth is NDC z, smaller is closer, the buffers are not cleared here.
+	void Begin(float* colorBuffer, float* depthBuffer, int width, int height, const RasterLighting& lighting);
+	// Clears the frame's color to color and its depth to infinity. Only tags the tiles: End fills the color of
+	// each tile in its job, and the depth of a tile once triangles reach it, in this frame or a later one.
+	void Clear(const glm::vec3& color);
+	// Triangles indices[0, indexCount) of vertices, which must stay valid until End. Triangles are
+	// clipped against the near plane and drawn from both sides.
+	void Draw(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+		const glm::mat4& model, const glm::mat4& viewProjection, const RasterMaterial& material);
+	void End();
+	// Inner loop for coverage and depth, the fastest one the CPU runs unless set. Falls back to that one
+	// when the CPU does not run the kernel.
+	void SetKernel(RasterKernel kernel);
+	RasterKernel GetKernel() const;
+	// Skips triangles and blocks of them that are behind everything already drawn there, on by default
+	void SetHierarchicalDepth(bool enabled);
+	const RasterStats& GetStats() const;
+
+private:
+	// Clip space for the edge functions and depth, world space for the lighting
+	struct RasterVertex
+	{
+		glm::vec4 clip;
+		glm::vec3 world;
+		glm::vec3 normal;
+	};
+
+	// Indices into the draw's vertices, or into the chunk's clipped ones when ClippedVertex is set
+	struct BinnedTriangle
+	{
+		uint32_t vertices[3];
+		uint16_t tileMin[2];
+		uint16_t tileMax[2];
+	};
+
+	// The triangles of one binning job and its counting sort by tile: bin t is
+	// binTriangles[binStart[t], binStart[t + 1])
+	struct BinChunk
+	{
+		size_t draw;
+		std::vector<BinnedTriangle> triangles;
+		std::vector<RasterVertex> clipped;
+		std::vector<uint32_t> binStart;
+		std::vector<uint32_t> binTriangles;
+	};
+
+	struct DepthRejections
+	{
+		size_t triangles = 0;
+		size_t blocks = 0;
+		size_t pixels = 0;
+	};
+
+	struct DrawState
+	{
+		std::vector<RasterVertex> vertices;
+		RasterMaterial material;
+	};
+
+	static const uint32_t ClippedVertex = 0x80000000u;
+	// The near plane and the four sides of the guard band
+	static const int ClipPlaneCount = 5;
+	static_assert(TileSize <= RasterKernels::MaxRectangle, "a tile is one rectangle of the raster kernels");
+	static_assert((TileSize / DepthBlock) * (TileSize / DepthBlock) <= 64, "a tile's depth blocks are bits of a 64 bit mask");
+	static_assert(DepthBlock % RasterBlock::Width == 0, "a raster block is in one depth block");
+
+	void BinTriangles(BinChunk& chunk, const GLuint* indices, size_t firstTriangle, size_t lastTriangle);
+	void EmitTriangle(BinChunk& chunk, const RasterVertex* const* vertices, const uint32_t* references);
+	void RasterizeTile(int tile, DepthRejections& rejections, RasterBlock* blocks);
+	// Of the DepthBlock square from (minX, minY), cut off at the tile's last pixels
+	float GetFarthestDepth(int minX, int minY, int tileMaxX, int tileMaxY) const;
+	void ShadePixel(const DrawState& draw, const RasterVertex* const* vertices, const glm::vec3& weights, float* color) const;
+
+	float* colorBuffer;
+	float* depthBuffer;
+	int width;
+	int height;
+	int tilesX;
+	int tilesY;
+	RasterLighting lighting;
+	glm::vec4 clipPlanes[ClipPlaneCount];
+	// Kept from frame to frame so that their memory is reused, the first drawCount and chunkCount are live
+	std::vector<DrawState> draws;
+	std::vector<BinChunk> chunks;
+	// One kernel output buffer per thread rasterizing tiles
+	std::vector<std::vector<RasterBlock>> blockBuffers;
+	size_t drawCount;
+	size_t chunkCount;
+	RasterKernel kernel;
+	bool hierarchicalDepth;
+	// A tile's color or depth is cleared when its generation is clearGeneration
+	glm::vec3 clearColor;
+	uint32_t clearGeneration;
+	std::vector<uint32_t> colorGenerations;
+	std::vector<uint32_t> depthGenerations;
+	bool clearPending;
+	RasterStats stats;
+};
@@ -0,0 +1,14 @@
+#pragma once
+#include <string>
+#include "ObjParser.h"
+
+// Binary STL reader. Every triangle has its own three positions and a facet normal, so the
+// mesh is unwelded: corners only share the normal of their face. The facet normals are dropped
+// when any of them is zero, the load then generates normals instead.
+class StlParser
+{
+public:
+	// Returns false if the file could not be opened, is not binary STL, or the parse was cancelled
+	static bool ParseFile(const std::string& filePath, ObjData& data, size_t* fileSize = nullptr, ObjParseProgress* progress = nullptr);
+	static bool Parse(const char* begin, const char* end, ObjData& data, ObjParseProgress* progress = nullptr);
+};
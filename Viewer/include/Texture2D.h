@@ -12,12 +12,14 @@ public:
 	virtual ~Texture2D();
 
 	bool loadTexture(const string& fileName, bool generateMipMaps = true);
+	bool loadTexture(const unsigned char* data, size_t size, bool generateMipMaps = true);
 	void bind(GLuint texUnit = 0);
 	void unbind(GLuint texUnit = 0);
 
 private:
 	Texture2D(const Texture2D& rhs) {}
 	Texture2D& operator = (const Texture2D& rhs) {}
+	void createTexture(const unsigned char* imageData, int width, int height, bool generateMipMaps);
 
 	GLuint mTexture;
 };
@@ -0,0 +1,36 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads shared by the loaders and the software renderer.
+class ThreadPool
+{
+public:
+	explicit ThreadPool(unsigned threadCount);
+	virtual ~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Pool sized to the number of hardware threads
+	static ThreadPool& Instance();
+
+	unsigned GetThreadCount() const;
+	void Enqueue(std::function<void()> job);
+
+	// Runs task(i) for every i in [0, count) and returns once all of them finished.
+	// The calling thread takes part, so it is safe to call from inside a pool job.
+	void ParallelFor(size_t count, const std::function<void(size_t)>& task);
+
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	bool stopping;
+};
@@ -1,13 +1,55 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <string>
+#include <memory>
+#include <vector>
+#include "MeshBuilder.h"
 #include "MeshModel.h"
+#include "NormalGenerator.h"
+
+class MeshCache;
+struct ObjData;
+struct ObjParseProgress;
+
+// What a cold load does with the built mesh. Entries in the mesh cache only match the same options.
+struct MeshLoadOptions
+{
+	// Run OptimizeMeshModel
+	bool optimize = false;
+	// Triangle budget of every extra level of detail as a fraction of the full mesh, finest first
+	std::vector<float> lodTriangleRatios;
+	// Files without normals get smooth ones. Faces meeting at more than creaseAngle degrees keep a hard edge.
+	bool generateNormals = true;
+	float creaseAngle = 60.0f;
+	NormalWeighting normalWeighting = NormalWeighting::Angle;
+	// Tangent stream for normal mapping, for files with texture coords
+	bool generateTangents = false;
+	// Merge positions closer than weldTolerance times the bounding box diagonal before indexing
+	bool weldVertices = false;
+	float weldTolerance = 1e-5f;
+};
 
 class Utils
 {
 public:
-	static glm::vec3 Vec3fFromStream(std::istream& issLine);
-	static glm::vec2 Vec2fFromStream(std::istream& issLine);
 	static std::shared_ptr<MeshModel> LoadMeshModel(const std::string& filePath);
+	// Parses and builds a model without any GL calls, so it can run on a worker thread.
+	// On a mesh cache hit the model is empty and cache holds the mapped data to upload.
+	// Returns null if the file cannot be read or the load was cancelled.
+	// With onBatch set, a cold load builds the vertices in steps and passes each one on as soon as it is ready.
+	// The finished model is then optimized and gets its levels of detail as options asks (streamed batches keep the file order).
+	static std::shared_ptr<MeshModel> ReadMeshModel(const std::string& filePath, MeshCache& cache, ObjParseProgress* progress = nullptr,
+		const MeshBatchCallback& onBatch = nullptr, const MeshLoadOptions& options = MeshLoadOptions());
+	// Vertex cache, overdraw and vertex fetch ordering, prints ACMR/ATVR before and after
+	static void OptimizeMeshModel(MeshModel& model);
+	// Simplifies the full mesh once per ratio, in parallel, appends the levels to modelIndices and fills model.lods.
+	// Levels that cannot get below the previous one's triangle count are left out.
+	static void GenerateLods(MeshModel& model, const std::vector<float>& triangleRatios);
+	// Loads filePath without the mesh cache and only prints what OptimizeMeshModel achieves
+	static bool PrintOptimizationReport(const std::string& filePath);
 	static std::string GetFileName(const std::string& filePath);
+	// Lower case, without the dot, empty when there is none
+	static std::string GetFileExtension(const std::string& filePath);
+	// Reads .obj, .ply or .stl by extension, anything else is read as OBJ
+	static bool ParseModelFile(const std::string& filePath, ObjData& data, size_t* fileSize = nullptr, ObjParseProgress* progress = nullptr);
 };
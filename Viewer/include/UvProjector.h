@@ -0,0 +1,19 @@
+#pragma once
+#include <vector>
+#include "MeshModel.h"
+
+// Texture coordinates computed from the geometry, for models whose own are missing or unwanted.
+// Everything is relative to the model's bounding box, so a texture covers the model once.
+class UvProjector
+{
+public:
+	// Writes count coordinates to uvs. positions and normals are read every stride bytes, so they can
+	// point into an array of Vertex or of plain vec3. normals may be null, Box then picks the face
+	// from the direction of the vertex seen from the center of the bounds.
+	// Runs in parallel on the thread pool, the loops have no branches or library calls in them
+	// so the compiler can vectorize them.
+	static void Project(UvProjection mode, const glm::vec3* positions, const glm::vec3* normals, size_t stride, size_t count,
+		const glm::vec3& boundsMin, const glm::vec3& boundsMax, glm::vec2* uvs);
+
+	static const char* GetName(UvProjection mode);
+};
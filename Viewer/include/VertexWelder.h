@@ -0,0 +1,16 @@
+#pragma once
+#include <vector>
+#include <glm/glm.hpp>
+
+// Merges positions that repeat under different indices, e.g. in CAD exports written face by face,
+// so that index dedup and smooth normals see one point where the file has several
+class VertexWelder
+{
+public:
+	// Every position moves onto the lowest indexed one within tolerance of it (chains of close positions
+	// end up on one), the unused ones are removed and the 1-based face indices are remapped. tolerance is a
+	// fraction of the bounding box diagonal, 0 merges exact duplicates only. Positions are bucketed in a
+	// hash grid of cells several tolerances wide and each one compares against the cells its tolerance
+	// reaches, usually just its own. Runs in parallel on the thread pool. Returns how many positions were merged away.
+	static size_t Weld(std::vector<glm::vec3>& positions, std::vector<int>& vertexIndices, float tolerance);
+};
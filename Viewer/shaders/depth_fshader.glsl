@@ -0,0 +1,8 @@
+#version 150
+
+out vec4 fColor;
+
+void main() 
+{ 
+   fColor = vec4(0.0);
+} 
@@ -0,0 +1,66 @@
+#version 150
+
+struct Material
+{
+    sampler2D textureMap;
+    sampler2D normalMap;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+in  vec3 fragPosition;
+in  vec3 fragNormal;
+in  vec2 fragTexCoord;
+in  vec4 fragTangent;
+out vec4 fColor;
+
+uniform Material material;
+uniform bool Lighting;
+uniform bool UseTexture;
+uniform bool UseNormalMap;
+uniform bool ToonShading;
+uniform float levels;
+
+uniform vec3 AmbientLight;
+uniform vec3 DiffuseLight;
+uniform vec3 SpecularLight;
+uniform int Alpha;
+uniform vec3 LightPosition;
+uniform vec3 CameraPosition;
+
+float Quantize(float intensity)
+{
+    return ToonShading ? floor(intensity * levels) / levels : intensity;
+}
+
+void main()
+{
+    vec3 baseColor = UseTexture ? texture(material.textureMap, fragTexCoord).rgb : vec3(1.0);
+    if (!Lighting)
+    {
+        fColor = vec4(UseTexture ? baseColor : material.diffuse, 1.0);
+        return;
+    }
+
+    vec3 normal = normalize(fragNormal);
+    if (UseNormalMap)
+    {
+        // Tangent space to world space, bitangent = w * cross(normal, tangent)
+        vec3 tangent = normalize(fragTangent.xyz - normal * dot(normal, fragTangent.xyz));
+        vec3 bitangent = fragTangent.w * cross(normal, tangent);
+        vec3 mapped = texture(material.normalMap, fragTexCoord).rgb * 2.0 - 1.0;
+        normal = normalize(mat3(tangent, bitangent, normal) * mapped);
+    }
+
+    vec3 toLight = normalize(LightPosition - fragPosition);
+    vec3 toCamera = normalize(CameraPosition - fragPosition);
+    vec3 reflected = reflect(-toLight, normal);
+    float diffuse = Quantize(max(dot(normal, toLight), 0.0));
+    float specular = Quantize(pow(max(dot(reflected, toCamera), 0.0), float(Alpha)));
+
+    vec3 color = AmbientLight * material.ambient * baseColor
+        + DiffuseLight * material.diffuse * baseColor * diffuse
+        + SpecularLight * material.specular * specular;
+    fColor = vec4(color, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 150
+
+in  vec3 vPosition;
+in  vec3 vNormal;
+in  vec2 vTexCoord;
+in  vec4 vTangent;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+out vec3 fragPosition;
+out vec3 fragNormal;
+out vec2 fragTexCoord;
+out vec4 fragTangent;
+
+void main()
+{
+    vec4 worldPosition = model * vec4(vPosition, 1.0);
+    mat3 normalMatrix = transpose(inverse(mat3(model)));
+    fragPosition = worldPosition.xyz;
+    fragNormal = normalMatrix * vNormal;
+    fragTexCoord = vTexCoord;
+    // Tangents follow the surface like positions, the handedness in w stays as it is
+    fragTangent = vec4(mat3(model) * vTangent.xyz, vTangent.w);
+    gl_Position = projection * view * worldPosition;
+}
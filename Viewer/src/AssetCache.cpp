@@ -0,0 +1,76 @@
+#include "AssetCache.h"
+#include <filesystem>
+#include <system_error>
+#include "Utils.h"
+
+AssetCache& AssetCache::Instance()
+{
+	static AssetCache cache;
+	return cache;
+}
+
+bool AssetCache::GetKey(const std::string& filePath, std::string& path, int64_t& time)
+{
+	std::error_code error;
+	std::filesystem::path canonicalPath = std::filesystem::canonical(filePath, error);
+	if (error)
+	{
+		return false;
+	}
+	path = canonicalPath.generic_string();
+	time = static_cast<int64_t>(std::filesystem::last_write_time(canonicalPath, error).time_since_epoch().count());
+	return !error;
+}
+
+std::shared_ptr<MeshModel> AssetCache::CreateInstance(const std::string& filePath)
+{
+	std::string path;
+	int64_t time;
+	if (!GetKey(filePath, path, time))
+	{
+		return nullptr;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	auto entry = entries.find(path);
+	if (entry == entries.end() || entry->second.time != time)
+	{
+		return nullptr;
+	}
+	std::shared_ptr<MeshGeometry> geometry = entry->second.geometry.lock();
+	if (!geometry)
+	{
+		entries.erase(entry);
+		return nullptr;
+	}
+	return std::make_shared<MeshModel>(geometry, Utils::GetFileName(filePath));
+}
+
+void AssetCache::Add(const std::string& filePath, const MeshModel& model)
+{
+	std::string path;
+	int64_t time;
+	if (!GetKey(filePath, path, time))
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	RemoveExpired();
+	entries[path] = { time, model.GetSharedGeometry() };
+}
+
+size_t AssetCache::GetAssetCount()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	RemoveExpired();
+	return entries.size();
+}
+
+void AssetCache::RemoveExpired()
+{
+	for (auto entry = entries.begin(); entry != entries.end();)
+	{
+		entry = entry->second.geometry.expired() ? entries.erase(entry) : std::next(entry);
+	}
+}
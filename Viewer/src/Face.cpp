@@ -1,36 +1,12 @@
-#pragma once
-#include <istream>
 #include "Face.h"
 
-Face::Face(std::istream& issLine)
+Face::Face(const int* vertexIndices, const int* textureIndices, const int* normalIndices)
 {
-	vertex_indices  = { 0,0,0 };
-	normal_indices  = { 0,0,0 };
-	texture_indices = { 0,0,0 };
-
-	char c;
 	for (int i = 0; i < 3; i++)
 	{
-		issLine >> std::ws >> vertex_indices.at(i) >> std::ws;
-		if (issLine.peek() != '/')
-		{
-			continue;
-		}
-		
-		issLine >> c >> std::ws;
-		if (issLine.peek() == '/')
-		{
-			issLine >> c >> std::ws >> normal_indices.at(i);
-			continue;
-		}
-
-		issLine >> texture_indices.at(i);
-		if (issLine.peek() != '/')
-		{
-			continue;
-		}
-		
-		issLine >> c >> normal_indices.at(i);
+		vertex_indices[i] = vertexIndices[i];
+		normal_indices[i] = normalIndices[i];
+		texture_indices[i] = textureIndices[i];
 	}
 }
 
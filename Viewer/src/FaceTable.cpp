@@ -0,0 +1,141 @@
+#include "FaceTable.h"
+#include <utility>
+
+FaceTable::FaceTable()
+{
+}
+
+void FaceTable::AddTriangle(const int* vertexIndices, const int* textureIndices, const int* normalIndices)
+{
+	size_t size = vertex_indices.size();
+	vertex_indices.insert(vertex_indices.end(), vertexIndices, vertexIndices + 3);
+
+	// Back-fill missing attribute indices with 0 the first time one shows up
+	bool hasTexture = textureIndices[0] != 0 || textureIndices[1] != 0 || textureIndices[2] != 0;
+	if (hasTexture && texture_indices.empty())
+	{
+		texture_indices.assign(size, 0);
+	}
+	if (hasTexture || !texture_indices.empty())
+	{
+		texture_indices.insert(texture_indices.end(), textureIndices, textureIndices + 3);
+	}
+
+	bool hasNormal = normalIndices[0] != 0 || normalIndices[1] != 0 || normalIndices[2] != 0;
+	if (hasNormal && normal_indices.empty())
+	{
+		normal_indices.assign(size, 0);
+	}
+	if (hasNormal || !normal_indices.empty())
+	{
+		normal_indices.insert(normal_indices.end(), normalIndices, normalIndices + 3);
+	}
+}
+
+void FaceTable::Append(const FaceTable& other)
+{
+	size_t size = vertex_indices.size();
+	size_t otherSize = other.vertex_indices.size();
+	vertex_indices.insert(vertex_indices.end(), other.vertex_indices.begin(), other.vertex_indices.end());
+	AppendIndices(texture_indices, other.texture_indices, size, otherSize);
+	AppendIndices(normal_indices, other.normal_indices, size, otherSize);
+}
+
+void FaceTable::Assign(std::vector<int> vertexIndices, std::vector<int> textureIndices, std::vector<int> normalIndices)
+{
+	vertex_indices = std::move(vertexIndices);
+	texture_indices = std::move(textureIndices);
+	normal_indices = std::move(normalIndices);
+}
+
+void FaceTable::AppendIndices(std::vector<int>& target, const std::vector<int>& source, size_t targetSize, size_t sourceSize)
+{
+	if (target.empty() && source.empty())
+	{
+		return;
+	}
+	if (target.empty())
+	{
+		target.assign(targetSize, 0);
+	}
+	if (source.empty())
+	{
+		target.resize(targetSize + sourceSize, 0);
+	}
+	else
+	{
+		target.insert(target.end(), source.begin(), source.end());
+	}
+}
+
+void FaceTable::Reserve(size_t faceCount, bool textureIndices, bool normalIndices)
+{
+	vertex_indices.reserve(faceCount * 3);
+	if (textureIndices)
+	{
+		texture_indices.reserve(faceCount * 3);
+	}
+	if (normalIndices)
+	{
+		normal_indices.reserve(faceCount * 3);
+	}
+}
+
+void FaceTable::Clear()
+{
+	std::vector<int>().swap(vertex_indices);
+	std::vector<int>().swap(texture_indices);
+	std::vector<int>().swap(normal_indices);
+}
+
+size_t FaceTable::GetFacesCount() const
+{
+	return vertex_indices.size() / 3;
+}
+
+Face FaceTable::GetFace(size_t face) const
+{
+	int vertexIndices[3], textureIndices[3], normalIndices[3];
+	for (int corner = 0; corner < 3; corner++)
+	{
+		vertexIndices[corner] = GetVertexIndex(face, corner);
+		textureIndices[corner] = GetTextureIndex(face, corner);
+		normalIndices[corner] = GetNormalIndex(face, corner);
+	}
+	return Face(vertexIndices, textureIndices, normalIndices);
+}
+
+int FaceTable::GetVertexIndex(size_t face, int corner) const
+{
+	return vertex_indices[face * 3 + corner];
+}
+
+std::vector<int>& FaceTable::GetVertexIndices()
+{
+	return vertex_indices;
+}
+
+int FaceTable::GetTextureIndex(size_t face, int corner) const
+{
+	return texture_indices.empty() ? 0 : texture_indices[face * 3 + corner];
+}
+
+int FaceTable::GetNormalIndex(size_t face, int corner) const
+{
+	return normal_indices.empty() ? 0 : normal_indices[face * 3 + corner];
+}
+
+bool FaceTable::HasTextureIndices() const
+{
+	return !texture_indices.empty();
+}
+
+bool FaceTable::HasNormalIndices() const
+{
+	return !normal_indices.empty();
+}
+
+size_t FaceTable::GetMemoryUsage() const
+{
+	return (vertex_indices.capacity() + texture_indices.capacity() + normal_indices.capacity()) * sizeof(int);
+}
@@ -0,0 +1,651 @@
+#include "GltfLoader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include "Json.h"
+#include "Texture2D.h"
+
+namespace
+{
+	const uint32_t GlbMagic = 0x46546C67;
+	const uint32_t JsonChunk = 0x4E4F534A;
+	const uint32_t BinChunk = 0x004E4942;
+	const size_t GlbHeaderSize = 12;
+	const size_t ChunkHeaderSize = 8;
+	const int TrianglesMode = 4;
+	const size_t NoIndex = SIZE_MAX;
+
+	uint32_t LoadUint32(const char* p)
+	{
+		uint32_t value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	// Index into one of the document's arrays, NoIndex when it is missing
+	size_t GetIndex(const JsonValue& value)
+	{
+		double index = value.GetNumber(-1.0);
+		return index >= 0.0 ? (size_t)index : NoIndex;
+	}
+
+	// Byte offsets, lengths and counts, 0 when missing, clamped to what a double holds exactly
+	size_t GetSize(const JsonValue& value)
+	{
+		return (size_t)std::min(std::max(value.GetNumber(), 0.0), 9007199254740992.0);
+	}
+
+	// An accessor resolved down to bytes of the BIN chunk
+	struct Accessor
+	{
+		size_t offset;
+		size_t count;
+		GLenum type;
+		GLint size;
+		bool normalized;
+		// As in the file, 0 is tightly packed
+		GLsizei stride;
+		// Bytes from the first element to the end of the last one
+		size_t span;
+	};
+
+	GLint GetComponentCount(const std::string& type)
+	{
+		if (type == "SCALAR") return 1;
+		if (type == "VEC2") return 2;
+		if (type == "VEC3") return 3;
+		if (type == "VEC4") return 4;
+		return 0;
+	}
+
+	size_t GetComponentSize(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_BYTE:
+		case GL_UNSIGNED_BYTE:
+			return 1;
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT:
+			return 2;
+		case GL_UNSIGNED_INT:
+		case GL_FLOAT:
+			return 4;
+		default:
+			return 0;
+		}
+	}
+
+	// glTF component types are the GL enums, checked against the list glTF allows
+	bool ResolveAccessor(const JsonValue& document, size_t binSize, size_t index, Accessor& accessor)
+	{
+		const JsonValue& json = document["accessors"][index];
+		if (json.IsNull() || json.Has("sparse") || !json.Has("bufferView"))
+		{
+			std::cerr << "glTF accessor " << index << " is missing, sparse or has no buffer view" << std::endl;
+			return false;
+		}
+		const JsonValue& view = document["bufferViews"][GetIndex(json["bufferView"])];
+		if (view.IsNull() || view["buffer"].GetNumber(-1.0) != 0.0 || document["buffers"][0].Has("uri"))
+		{
+			std::cerr << "glTF accessor " << index << " is not in the GLB's BIN chunk" << std::endl;
+			return false;
+		}
+
+		accessor.type = (GLenum)GetSize(json["componentType"]);
+		accessor.size = GetComponentCount(json["type"].GetString());
+		accessor.normalized = json["normalized"].GetBool();
+		accessor.count = GetSize(json["count"]);
+		size_t elementSize = GetComponentSize(accessor.type) * accessor.size;
+		if (elementSize == 0 || accessor.count == 0 || accessor.count > binSize)
+		{
+			std::cerr << "glTF accessor " << index << " has an unsupported type or no elements" << std::endl;
+			return false;
+		}
+
+		// The spec allows strides of 4 to 252 bytes, GL takes them as they are
+		size_t stride = GetSize(view["byteStride"]);
+		if (stride != 0 && (stride < elementSize || stride > 252 || stride % 4 != 0))
+		{
+			std::cerr << "glTF accessor " << index << " has a byte stride of " << stride << std::endl;
+			return false;
+		}
+		accessor.stride = (GLsizei)stride;
+		if (stride == 0)
+		{
+			stride = elementSize;
+		}
+
+		// Compared by what is left so no sum can wrap around
+		size_t viewOffset = GetSize(view["byteOffset"]);
+		size_t viewLength = GetSize(view["byteLength"]);
+		size_t accessorOffset = GetSize(json["byteOffset"]);
+		if (viewOffset > binSize || viewLength > binSize - viewOffset || accessorOffset > viewLength
+			|| elementSize > viewLength - accessorOffset || accessor.count - 1 > (viewLength - accessorOffset - elementSize) / stride)
+		{
+			std::cerr << "glTF accessor " << index << " reads past its buffer view" << std::endl;
+			return false;
+		}
+		accessor.offset = viewOffset + accessorOffset;
+		accessor.span = (accessor.count - 1) * stride + elementSize;
+		return true;
+	}
+
+	// One pass over the indices as they are in the file, a vertex past the end would be drawn from outside the buffer
+	template<typename T>
+	bool IndicesInRange(const T* indices, size_t count, size_t vertexCount)
+	{
+		T largest = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			largest = std::max(largest, indices[i]);
+		}
+		return (size_t)largest < vertexCount;
+	}
+
+	glm::vec3 GetVec3(const JsonValue& array, const glm::vec3& fallback)
+	{
+		return array.GetSize() >= 3 ? glm::vec3(array[0].GetNumber(), array[1].GetNumber(), array[2].GetNumber()) : fallback;
+	}
+
+	glm::mat4 GetNodeMatrix(const JsonValue& node)
+	{
+		const JsonValue& matrix = node["matrix"];
+		if (matrix.GetSize() == 16)
+		{
+			glm::mat4 result;
+			for (int i = 0; i < 16; i++)
+			{
+				result[i / 4][i % 4] = (float)matrix[i].GetNumber();
+			}
+			return result;
+		}
+		const JsonValue& rotation = node["rotation"];
+		glm::quat quaternion(1.0f, 0.0f, 0.0f, 0.0f);
+		if (rotation.GetSize() == 4)
+		{
+			quaternion = glm::quat((float)rotation[3].GetNumber(), (float)rotation[0].GetNumber(), (float)rotation[1].GetNumber(), (float)rotation[2].GetNumber());
+		}
+		return glm::translate(glm::mat4(1.0f), GetVec3(node["translation"], glm::vec3(0.0f))) * glm::mat4_cast(quaternion) *
+			glm::scale(glm::mat4(1.0f), GetVec3(node["scale"], glm::vec3(1.0f)));
+	}
+
+	// Split into the model's world translation, rotation and scale so the transform controls start from the node's placement
+	void SetNodeTransform(MeshModel& model, const glm::mat4& transform)
+	{
+		glm::vec3 scale(glm::length(glm::vec3(transform[0])), glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2])));
+		if (glm::determinant(glm::mat3(transform)) < 0.0f)
+		{
+			scale.x = -scale.x;
+		}
+		glm::mat4 rotation(1.0f);
+		for (int axis = 0; axis < 3; axis++)
+		{
+			if (scale[axis] != 0.0f)
+			{
+				rotation[axis] = glm::vec4(glm::vec3(transform[axis]) / scale[axis], 0.0f);
+			}
+		}
+		model.SetWorldTranslate(glm::translate(glm::mat4(1.0f), glm::vec3(transform[3])));
+		model.SetWorldRotate(rotation);
+		model.SetWorldScale(glm::scale(glm::mat4(1.0f), scale));
+		// The node's own matrix, which keeps any shear the parts above cannot express
+		model.SetWorldTransform(transform);
+	}
+
+	// Phong has no metals: Kd is the base color, Ks goes from a dielectric's 4% to the base color as metallic rises
+	// and fades out with roughness
+	GltfMaterial ReadMaterial(const JsonValue& document, const JsonValue& json)
+	{
+		GltfMaterial material;
+		const JsonValue& pbr = json["pbrMetallicRoughness"];
+		const JsonValue& factor = pbr["baseColorFactor"];
+		glm::vec3 baseColor = GetVec3(factor, glm::vec3(1.0f));
+		float metallic = (float)pbr["metallicFactor"].GetNumber(1.0);
+		float roughness = (float)pbr["roughnessFactor"].GetNumber(1.0);
+		material.diffuse = baseColor;
+		material.ambient = baseColor * 0.1f;
+		material.specular = glm::mix(glm::vec3(0.04f), baseColor, metallic) * (1.0f - roughness);
+
+		const JsonValue& texture = pbr["baseColorTexture"];
+		if (!texture.IsNull())
+		{
+			const JsonValue& source = document["textures"][GetIndex(texture["index"])]["source"];
+			material.image = (int)source.GetNumber(-1.0);
+		}
+		return material;
+	}
+
+	bool ReadPrimitive(const JsonValue& document, const char* bin, size_t binSize, const JsonValue& json, GltfPrimitive& primitive)
+	{
+		if ((int)json["mode"].GetNumber(TrianglesMode) != TrianglesMode)
+		{
+			std::cerr << "Skipping glTF primitive " << primitive.name << ": only triangle lists are drawn" << std::endl;
+			return false;
+		}
+
+		// Only what the viewer's shaders read
+		const char* names[] = { "POSITION", "NORMAL", "TEXCOORD_0" };
+		const JsonValue& attributes = json["attributes"];
+		std::vector<Accessor> accessors;
+		for (GLuint index = 0; index < 3; index++)
+		{
+			if (!attributes.Has(names[index]))
+			{
+				continue;
+			}
+			Accessor accessor;
+			if (!ResolveAccessor(document, binSize, GetIndex(attributes[names[index]]), accessor))
+			{
+				return false;
+			}
+			bool floatVector = accessor.type == GL_FLOAT && accessor.size == (index == 2 ? 2 : 3);
+			if (!floatVector && !(index == 2 && accessor.size == 2 && accessor.normalized))
+			{
+				std::cerr << "Skipping glTF primitive " << primitive.name << ": " << names[index] << " has an unsupported format" << std::endl;
+				return false;
+			}
+			if (index == 0)
+			{
+				primitive.vertexCount = accessor.count;
+				const JsonValue& position = document["accessors"][GetIndex(attributes["POSITION"])];
+				primitive.boundsMin = GetVec3(position["min"], glm::vec3(0.0f));
+				primitive.boundsMax = GetVec3(position["max"], glm::vec3(0.0f));
+			}
+			else if (accessor.count != primitive.vertexCount)
+			{
+				std::cerr << "Skipping glTF primitive " << primitive.name << ": " << names[index] << " has another vertex count than POSITION" << std::endl;
+				return false;
+			}
+			primitive.attributes.push_back({ index, accessor.size, accessor.type, (GLboolean)accessor.normalized, accessor.stride, 0 });
+			accessors.push_back(accessor);
+		}
+		if (primitive.vertexCount == 0)
+		{
+			std::cerr << "Skipping glTF primitive " << primitive.name << ": no POSITION" << std::endl;
+			return false;
+		}
+
+		// Each distinct range of the BIN chunk goes into the vertex buffer once, interleaved attributes share one
+		std::vector<std::pair<size_t, size_t>> spans;
+		for (const Accessor& accessor : accessors)
+		{
+			spans.push_back({ accessor.offset, accessor.offset + accessor.span });
+		}
+		std::sort(spans.begin(), spans.end());
+		for (const std::pair<size_t, size_t>& span : spans)
+		{
+			if (!primitive.ranges.empty() && span.first <= (size_t)(primitive.ranges.back().data - bin) + primitive.ranges.back().size)
+			{
+				GltfRange& range = primitive.ranges.back();
+				range.size = std::max(range.size, span.second - (size_t)(range.data - bin));
+				continue;
+			}
+			// Ranges start on 4 bytes in the file and in the buffer, so every attribute keeps its alignment
+			size_t begin = span.first & ~(size_t)3;
+			size_t offset = primitive.ranges.empty() ? 0 : (primitive.ranges.back().offset + primitive.ranges.back().size + 3) & ~(size_t)3;
+			primitive.ranges.push_back({ bin + begin, span.second - begin, offset });
+		}
+		primitive.vertexBytes = primitive.ranges.back().offset + primitive.ranges.back().size;
+		for (size_t i = 0; i < accessors.size(); i++)
+		{
+			for (const GltfRange& range : primitive.ranges)
+			{
+				size_t begin = range.data - bin;
+				if (accessors[i].offset >= begin && accessors[i].offset < begin + range.size)
+				{
+					primitive.attributes[i].offset = range.offset + accessors[i].offset - begin;
+				}
+			}
+		}
+
+		if (!json.Has("indices"))
+		{
+			// Drawn as a triangle list over the vertices in order
+			primitive.indexCount = primitive.vertexCount - primitive.vertexCount % 3;
+			primitive.indexType = MeshModel::ChooseIndexType(primitive.vertexCount);
+			if (primitive.indexType == GL_UNSIGNED_SHORT)
+			{
+				primitive.shortIndices.resize(primitive.indexCount);
+				for (size_t i = 0; i < primitive.indexCount; i++)
+				{
+					primitive.shortIndices[i] = (GLushort)i;
+				}
+			}
+			else
+			{
+				primitive.intIndices.resize(primitive.indexCount);
+				for (size_t i = 0; i < primitive.indexCount; i++)
+				{
+					primitive.intIndices[i] = (GLuint)i;
+				}
+			}
+			return primitive.indexCount > 0;
+		}
+
+		Accessor indices;
+		if (!ResolveAccessor(document, binSize, GetIndex(json["indices"]), indices) || indices.size != 1 || indices.stride != 0)
+		{
+			std::cerr << "Skipping glTF primitive " << primitive.name << ": unreadable indices" << std::endl;
+			return false;
+		}
+		primitive.indexCount = indices.count - indices.count % 3;
+		const char* source = bin + indices.offset;
+		bool inRange = false;
+		if (indices.type == GL_UNSIGNED_BYTE)
+		{
+			// GL 3.2 can draw 8 bit indices, but they are slow on most hardware
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(source);
+			inRange = IndicesInRange(bytes, primitive.indexCount, primitive.vertexCount);
+			primitive.shortIndices.assign(bytes, bytes + primitive.indexCount);
+			primitive.indexType = GL_UNSIGNED_SHORT;
+		}
+		else if (indices.type == GL_UNSIGNED_SHORT || indices.type == GL_UNSIGNED_INT)
+		{
+			if (reinterpret_cast<uintptr_t>(source) % GetComponentSize(indices.type) != 0)
+			{
+				std::cerr << "Skipping glTF primitive " << primitive.name << ": indices are not aligned to their size" << std::endl;
+				return false;
+			}
+			inRange = indices.type == GL_UNSIGNED_SHORT ? IndicesInRange(reinterpret_cast<const GLushort*>(source), primitive.indexCount, primitive.vertexCount)
+				: IndicesInRange(reinterpret_cast<const GLuint*>(source), primitive.indexCount, primitive.vertexCount);
+			primitive.indexData = source;
+			primitive.indexType = indices.type;
+		}
+		else
+		{
+			std::cerr << "Skipping glTF primitive " << primitive.name << ": indices are not unsigned" << std::endl;
+			return false;
+		}
+		if (!inRange)
+		{
+			std::cerr << "Skipping glTF primitive " << primitive.name << ": indices point past the " << primitive.vertexCount << " vertices" << std::endl;
+			return false;
+		}
+		return primitive.indexCount > 0;
+	}
+}
+
+bool GltfLoader::Read(const std::string& filePath, GltfScene& scene, ObjParseProgress* progress)
+{
+	if (!scene.file.Open(filePath))
+	{
+		return false;
+	}
+	const char* data = scene.file.GetData();
+	size_t size = scene.file.GetSize();
+	if (progress != nullptr)
+	{
+		progress->bytesDone = 0;
+		progress->bytesTotal = size;
+	}
+	if (size < GlbHeaderSize + ChunkHeaderSize || LoadUint32(data) != GlbMagic || LoadUint32(data + 4) != 2)
+	{
+		std::cerr << filePath << " is not a binary glTF 2.0 file" << std::endl;
+		return false;
+	}
+
+	// The JSON chunk comes first, the BIN chunk (if any) right after it
+	const char* json = nullptr;
+	size_t jsonSize = 0;
+	const char* bin = nullptr;
+	size_t binSize = 0;
+	size_t length = std::min<size_t>(LoadUint32(data + 8), size);
+	for (size_t offset = GlbHeaderSize; offset + ChunkHeaderSize <= length;)
+	{
+		size_t chunkSize = LoadUint32(data + offset);
+		uint32_t chunkType = LoadUint32(data + offset + 4);
+		const char* chunk = data + offset + ChunkHeaderSize;
+		if (chunkSize > length - offset - ChunkHeaderSize)
+		{
+			break;
+		}
+		if (chunkType == JsonChunk && json == nullptr)
+		{
+			json = chunk;
+			jsonSize = chunkSize;
+		}
+		else if (chunkType == BinChunk && bin == nullptr)
+		{
+			bin = chunk;
+			binSize = chunkSize;
+		}
+		offset += ChunkHeaderSize + chunkSize;
+	}
+
+	JsonValue document;
+	if (json == nullptr || !JsonValue::Parse(json, json + jsonSize, document))
+	{
+		std::cerr << filePath << " has no readable JSON chunk" << std::endl;
+		return false;
+	}
+	const JsonValue& required = document["extensionsRequired"];
+	if (required.GetSize() > 0)
+	{
+		std::cerr << filePath << " needs glTF extensions the viewer does not have:";
+		for (size_t i = 0; i < required.GetSize(); i++)
+		{
+			std::cerr << " " << required[i].GetString();
+		}
+		std::cerr << std::endl;
+		return false;
+	}
+
+	// Primitives of every mesh, whether a node uses them or not is known once the nodes were walked
+	const JsonValue& meshes = document["meshes"];
+	std::vector<std::vector<size_t>> meshPrimitives(meshes.GetSize());
+	for (size_t mesh = 0; mesh < meshes.GetSize(); mesh++)
+	{
+		const JsonValue& primitives = meshes[mesh]["primitives"];
+		std::string meshName = meshes[mesh]["name"].GetString();
+		if (meshName.empty())
+		{
+			meshName = "mesh " + std::to_string(mesh);
+		}
+		for (size_t i = 0; i < primitives.GetSize(); i++)
+		{
+			if (progress != nullptr && progress->cancelled)
+			{
+				return false;
+			}
+			GltfPrimitive primitive;
+			primitive.name = primitives.GetSize() > 1 ? meshName + " #" + std::to_string(i) : meshName;
+			primitive.material = (int)primitives[i]["material"].GetNumber(-1.0);
+			if (bin != nullptr && ReadPrimitive(document, bin, binSize, primitives[i], primitive))
+			{
+				meshPrimitives[mesh].push_back(scene.primitives.size());
+				scene.primitives.push_back(std::move(primitive));
+			}
+		}
+	}
+
+	const JsonValue& materials = document["materials"];
+	for (size_t i = 0; i < materials.GetSize(); i++)
+	{
+		scene.materials.push_back(ReadMaterial(document, materials[i]));
+	}
+	const JsonValue& images = document["images"];
+	for (size_t i = 0; i < images.GetSize(); i++)
+	{
+		GltfImage image;
+		const JsonValue& view = document["bufferViews"][GetIndex(images[i]["bufferView"])];
+		size_t offset = GetSize(view["byteOffset"]);
+		size_t viewLength = GetSize(view["byteLength"]);
+		if (!view.IsNull() && bin != nullptr && offset + viewLength <= binSize)
+		{
+			image.data = reinterpret_cast<const unsigned char*>(bin + offset);
+			image.size = viewLength;
+		}
+		else
+		{
+			std::cerr << "glTF image " << i << " is not embedded in the BIN chunk, its material is drawn without it" << std::endl;
+		}
+		scene.images.push_back(image);
+	}
+
+	// Walk the default scene's node trees, or every root node when the file has no scenes
+	const JsonValue& nodes = document["nodes"];
+	std::vector<size_t> roots;
+	size_t sceneIndex = GetIndex(document["scene"]);
+	const JsonValue& sceneJson = document["scenes"][sceneIndex == NoIndex ? 0 : sceneIndex];
+	if (!sceneJson.IsNull())
+	{
+		for (size_t i = 0; i < sceneJson["nodes"].GetSize(); i++)
+		{
+			roots.push_back(GetIndex(sceneJson["nodes"][i]));
+		}
+	}
+	else
+	{
+		std::vector<bool> isChild(nodes.GetSize(), false);
+		for (size_t i = 0; i < nodes.GetSize(); i++)
+		{
+			for (size_t c = 0; c < nodes[i]["children"].GetSize(); c++)
+			{
+				size_t child = GetIndex(nodes[i]["children"][c]);
+				if (child < isChild.size())
+				{
+					isChild[child] = true;
+				}
+			}
+		}
+		for (size_t i = 0; i < nodes.GetSize(); i++)
+		{
+			if (!isChild[i])
+			{
+				roots.push_back(i);
+			}
+		}
+	}
+
+	struct PendingNode
+	{
+		size_t node;
+		glm::mat4 parent;
+		size_t depth;
+	};
+	std::vector<PendingNode> pending;
+	// Pushed in reverse, so the models come out in file order
+	for (size_t i = roots.size(); i-- > 0;)
+	{
+		pending.push_back({ roots[i], glm::mat4(1.0f), 0 });
+	}
+	while (!pending.empty())
+	{
+		PendingNode current = pending.back();
+		pending.pop_back();
+		const JsonValue& node = nodes[current.node];
+		// A valid file is a forest, deeper than the node count means a cycle
+		if (node.IsNull() || current.depth > nodes.GetSize())
+		{
+			continue;
+		}
+		glm::mat4 transform = current.parent * GetNodeMatrix(node);
+		size_t mesh = GetIndex(node["mesh"]);
+		if (node.Has("mesh") && mesh < meshPrimitives.size())
+		{
+			for (size_t primitive : meshPrimitives[mesh])
+			{
+				scene.instances.push_back({ primitive, transform });
+			}
+		}
+		const JsonValue& children = node["children"];
+		for (size_t c = children.GetSize(); c-- > 0;)
+		{
+			pending.push_back({ GetIndex(children[c]), transform, current.depth + 1 });
+		}
+	}
+
+	if (progress != nullptr)
+	{
+		progress->bytesDone = size;
+	}
+	if (scene.instances.empty())
+	{
+		std::cerr << filePath << " has no triangle meshes in its scene" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool GltfLoader::Upload(const GltfScene& scene, const std::string& modelName, GltfUpload& upload, size_t& budget)
+{
+	auto start = std::chrono::steady_clock::now();
+	if (upload.nextInstance == 0)
+	{
+		upload.owners.assign(scene.primitives.size(), nullptr);
+		upload.textures.assign(scene.images.size(), nullptr);
+		upload.decoded.assign(scene.images.size(), false);
+	}
+	for (; upload.nextInstance < scene.instances.size() && budget > 0; upload.nextInstance++)
+	{
+		const GltfInstance& instance = scene.instances[upload.nextInstance];
+		const GltfPrimitive& primitive = scene.primitives[instance.primitive];
+		std::string name = modelName + ": " + primitive.name;
+		std::shared_ptr<MeshModel> model;
+		std::shared_ptr<MeshModel>& owner = upload.owners[instance.primitive];
+		if (owner)
+		{
+			model = std::make_shared<MeshModel>(owner->GetSharedGeometry(), name);
+		}
+		else
+		{
+			model = std::make_shared<MeshModel>(name);
+			model->SetBounds(primitive.boundsMin, primitive.boundsMax);
+			const void* indexData = !primitive.shortIndices.empty() ? (const void*)primitive.shortIndices.data() :
+				!primitive.intIndices.empty() ? (const void*)primitive.intIndices.data() : primitive.indexData;
+			model->CreateExternalBuffers(nullptr, primitive.vertexBytes, primitive.vertexCount, primitive.attributes, indexData, primitive.indexCount, primitive.indexType);
+			glBindBuffer(GL_ARRAY_BUFFER, model->GetGeometry().vbo);
+			for (const GltfRange& range : primitive.ranges)
+			{
+				glBufferSubData(GL_ARRAY_BUFFER, range.offset, range.size, range.data);
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			size_t bytes = primitive.vertexBytes + primitive.indexCount * model->GetIndexSize();
+			upload.bytes += bytes;
+			budget -= std::min(budget, bytes);
+			owner = model;
+		}
+
+		if (primitive.material >= 0 && primitive.material < (int)scene.materials.size())
+		{
+			const GltfMaterial& material = scene.materials[primitive.material];
+			model->Ka = material.ambient;
+			model->Kd = material.diffuse;
+			model->Ks = material.specular;
+			if (material.image >= 0 && material.image < (int)scene.images.size() && scene.images[material.image].data != nullptr)
+			{
+				std::shared_ptr<Texture2D>& texture = upload.textures[material.image];
+				if (!upload.decoded[material.image])
+				{
+					upload.decoded[material.image] = true;
+					texture = std::make_shared<Texture2D>();
+					const GltfImage& image = scene.images[material.image];
+					if (!texture->loadTexture(image.data, image.size))
+					{
+						texture.reset();
+					}
+					// The encoded size stands in for the decode and the texel upload
+					budget -= std::min(budget, image.size);
+				}
+				model->texture = texture;
+			}
+		}
+		SetNodeTransform(*model, instance.transform);
+		upload.models.push_back(model);
+	}
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	upload.milliseconds += elapsed.count() * 1000.0;
+	if (upload.nextInstance < scene.instances.size())
+	{
+		return false;
+	}
+	std::cout << "Uploaded " << modelName << ": " << scene.primitives.size() << " primitives, " << upload.models.size() << " instances, " << upload.bytes / 1024 << " KB straight from the file in "
+		<< upload.milliseconds << " ms" << std::endl;
+	return true;
+}
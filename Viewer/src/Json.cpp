@@ -0,0 +1,336 @@
+#include "Json.h"
+#include <charconv>
+#include <cstring>
+
+namespace
+{
+	const JsonValue NullValue;
+	const std::string EmptyString;
+	// Deeper documents are rejected instead of running out of stack
+	const int MaxDepth = 256;
+}
+
+// Recursive descent over the raw bytes
+class JsonReader
+{
+public:
+	JsonReader(const char* begin, const char* end) : p(begin), end(end)
+	{
+	}
+
+	bool ReadDocument(JsonValue& value)
+	{
+		if (!ReadValue(value, 0))
+		{
+			return false;
+		}
+		SkipSpace();
+		return p == end;
+	}
+
+private:
+	void SkipSpace()
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+		{
+			p++;
+		}
+	}
+
+	bool Match(const char* word)
+	{
+		size_t length = std::strlen(word);
+		if ((size_t)(end - p) < length || std::memcmp(p, word, length) != 0)
+		{
+			return false;
+		}
+		p += length;
+		return true;
+	}
+
+	static void AppendUtf8(std::string& text, unsigned codePoint)
+	{
+		if (codePoint < 0x80)
+		{
+			text += (char)codePoint;
+		}
+		else if (codePoint < 0x800)
+		{
+			text += (char)(0xC0 | (codePoint >> 6));
+			text += (char)(0x80 | (codePoint & 0x3F));
+		}
+		else if (codePoint < 0x10000)
+		{
+			text += (char)(0xE0 | (codePoint >> 12));
+			text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+			text += (char)(0x80 | (codePoint & 0x3F));
+		}
+		else
+		{
+			text += (char)(0xF0 | (codePoint >> 18));
+			text += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+			text += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+			text += (char)(0x80 | (codePoint & 0x3F));
+		}
+	}
+
+	bool ReadHex(unsigned& value)
+	{
+		if (end - p < 4)
+		{
+			return false;
+		}
+		std::from_chars_result result = std::from_chars(p, p + 4, value, 16);
+		if (result.ptr != p + 4)
+		{
+			return false;
+		}
+		p += 4;
+		return true;
+	}
+
+	bool ReadString(std::string& text)
+	{
+		// p is on the opening quote
+		p++;
+		while (p < end && *p != '"')
+		{
+			if (*p != '\\')
+			{
+				text += *p++;
+				continue;
+			}
+			if (++p >= end)
+			{
+				return false;
+			}
+			char escape = *p++;
+			switch (escape)
+			{
+			case '"': text += '"'; break;
+			case '\\': text += '\\'; break;
+			case '/': text += '/'; break;
+			case 'b': text += '\b'; break;
+			case 'f': text += '\f'; break;
+			case 'n': text += '\n'; break;
+			case 'r': text += '\r'; break;
+			case 't': text += '\t'; break;
+			case 'u':
+			{
+				unsigned codePoint;
+				if (!ReadHex(codePoint))
+				{
+					return false;
+				}
+				// A surrogate pair is two escapes
+				unsigned low;
+				if (codePoint >= 0xD800 && codePoint < 0xDC00 && Match("\\u") && ReadHex(low))
+				{
+					codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+				}
+				AppendUtf8(text, codePoint);
+				break;
+			}
+			default:
+				return false;
+			}
+		}
+		if (p >= end)
+		{
+			return false;
+		}
+		p++;
+		return true;
+	}
+
+	bool ReadValue(JsonValue& value, int depth)
+	{
+		SkipSpace();
+		if (p >= end || depth > MaxDepth)
+		{
+			return false;
+		}
+
+		switch (*p)
+		{
+		case '{':
+		{
+			value.type = JsonValue::Type::Object;
+			p++;
+			SkipSpace();
+			if (p < end && *p == '}')
+			{
+				p++;
+				return true;
+			}
+			while (true)
+			{
+				SkipSpace();
+				if (p >= end || *p != '"')
+				{
+					return false;
+				}
+				value.keys.emplace_back();
+				if (!ReadString(value.keys.back()))
+				{
+					return false;
+				}
+				SkipSpace();
+				if (p >= end || *p != ':')
+				{
+					return false;
+				}
+				p++;
+				value.elements.emplace_back();
+				if (!ReadValue(value.elements.back(), depth + 1))
+				{
+					return false;
+				}
+				SkipSpace();
+				if (p < end && *p == ',')
+				{
+					p++;
+					continue;
+				}
+				if (p < end && *p == '}')
+				{
+					p++;
+					return true;
+				}
+				return false;
+			}
+		}
+		case '[':
+		{
+			value.type = JsonValue::Type::Array;
+			p++;
+			SkipSpace();
+			if (p < end && *p == ']')
+			{
+				p++;
+				return true;
+			}
+			while (true)
+			{
+				value.elements.emplace_back();
+				if (!ReadValue(value.elements.back(), depth + 1))
+				{
+					return false;
+				}
+				SkipSpace();
+				if (p < end && *p == ',')
+				{
+					p++;
+					continue;
+				}
+				if (p < end && *p == ']')
+				{
+					p++;
+					return true;
+				}
+				return false;
+			}
+		}
+		case '"':
+			value.type = JsonValue::Type::String;
+			return ReadString(value.text);
+		case 't':
+			value.type = JsonValue::Type::Bool;
+			value.boolean = true;
+			return Match("true");
+		case 'f':
+			value.type = JsonValue::Type::Bool;
+			return Match("false");
+		case 'n':
+			return Match("null");
+		default:
+		{
+			value.type = JsonValue::Type::Number;
+			std::from_chars_result result = std::from_chars(p, end, value.number);
+			if (result.ec != std::errc() || result.ptr == p)
+			{
+				return false;
+			}
+			p = result.ptr;
+			return true;
+		}
+		}
+	}
+
+	const char* p;
+	const char* end;
+};
+
+bool JsonValue::Parse(const char* begin, const char* end, JsonValue& value)
+{
+	value = JsonValue();
+	JsonReader reader(begin, end);
+	if (!reader.ReadDocument(value))
+	{
+		value = JsonValue();
+		return false;
+	}
+	return true;
+}
+
+JsonValue::Type JsonValue::GetType() const
+{
+	return type;
+}
+
+bool JsonValue::IsNull() const
+{
+	return type == Type::Null;
+}
+
+double JsonValue::GetNumber(double fallback) const
+{
+	return type == Type::Number ? number : fallback;
+}
+
+bool JsonValue::GetBool(bool fallback) const
+{
+	return type == Type::Bool ? boolean : fallback;
+}
+
+const std::string& JsonValue::GetString() const
+{
+	return type == Type::String ? text : EmptyString;
+}
+
+size_t JsonValue::GetSize() const
+{
+	return elements.size();
+}
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+	return index < elements.size() ? elements[index] : NullValue;
+}
+
+const JsonValue& JsonValue::operator[](int index) const
+{
+	return index >= 0 ? (*this)[(size_t)index] : NullValue;
+}
+
+const JsonValue& JsonValue::operator[](const char* key) const
+{
+	for (size_t i = 0; i < keys.size(); i++)
+	{
+		if (keys[i] == key)
+		{
+			return elements[i];
+		}
+	}
+	return NullValue;
+}
+
+bool JsonValue::Has(const char* key) const
+{
+	return !(*this)[key].IsNull();
+}
+
+const std::string& JsonValue::GetKey(size_t index) const
+{
+	return index < keys.size() ? keys[index] : EmptyString;
+}
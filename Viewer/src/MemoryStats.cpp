@@ -0,0 +1,104 @@
+#include "MemoryStats.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <cstdio>
+#include <cstring>
+#endif
+
+namespace
+{
+	std::atomic<uint64_t> allocationCount{ 0 };
+
+#ifndef _WIN32
+	// Reads a "<key>: <n> kB" line of /proc/self/status
+	size_t ReadStatusKilobytes(const char* key)
+	{
+		FILE* file = std::fopen("/proc/self/status", "r");
+		if (file == nullptr)
+		{
+			return 0;
+		}
+		size_t keyLength = std::strlen(key);
+		char line[256];
+		size_t kilobytes = 0;
+		while (std::fgets(line, sizeof(line), file) != nullptr)
+		{
+			if (std::strncmp(line, key, keyLength) == 0 && line[keyLength] == ':')
+			{
+				kilobytes = std::strtoull(line + keyLength + 1, nullptr, 10);
+				break;
+			}
+		}
+		std::fclose(file);
+		return kilobytes;
+	}
+#endif
+}
+
+// Counting replacements of the global allocation functions, the array and nothrow forms end up here too
+void* operator new(std::size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	void* memory = std::malloc(size > 0 ? size : 1);
+	if (memory == nullptr)
+	{
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+
+size_t MemoryStats::GetResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#else
+	return ReadStatusKilobytes("VmRSS") * 1024;
+#endif
+}
+
+size_t MemoryStats::GetPeakResidentBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.PeakWorkingSetSize : 0;
+#else
+	return ReadStatusKilobytes("VmHWM") * 1024;
+#endif
+}
+
+void MemoryStats::ResetPeak()
+{
+#ifndef _WIN32
+	// Linux resets the high water mark when "5" is written to clear_refs
+	FILE* file = std::fopen("/proc/self/clear_refs", "w");
+	if (file != nullptr)
+	{
+		std::fputs("5", file);
+		std::fclose(file);
+	}
+#endif
+}
+
+uint64_t MemoryStats::GetAllocationCount()
+{
+	return allocationCount.load(std::memory_order_relaxed);
+}
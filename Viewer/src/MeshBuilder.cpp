@@ -0,0 +1,141 @@
+#include "MeshBuilder.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+
+bool MeshBuilder::CornerKey::operator==(const CornerKey& other) const
+{
+	return vertexIndex == other.vertexIndex && textureIndex == other.textureIndex && normalIndex == other.normalIndex;
+}
+
+size_t MeshBuilder::CornerKeyHash::operator()(const CornerKey& key) const
+{
+	uint64_t hash = (uint32_t)key.vertexIndex * 0x9E3779B97F4A7C15ull;
+	hash ^= ((uint32_t)key.textureIndex + 0x7F4A7C15ull + (hash << 6) + (hash >> 2)) * 0xC2B2AE3D27D4EB4Full;
+	hash ^= ((uint32_t)key.normalIndex + 0x165667B19E3779F9ull + (hash << 6) + (hash >> 2)) * 0x94D049BB133111EBull;
+	return (size_t)(hash ^ (hash >> 31));
+}
+
+MeshBuilder::CornerLookup::CornerLookup(size_t vertexEstimate, size_t cornerCount) :
+	// Buckets for every corner so the table never rehashes, plus about one node
+	// (key, value, next pointer and cached hash) per expected vertex
+	arena(std::max<size_t>(cornerCount * sizeof(void*) + vertexEstimate * 48, 1024)),
+	cornerToVertex(&arena)
+{
+	cornerToVertex.reserve(cornerCount);
+}
+
+MeshBuilder::MeshBuilder(const FaceTable& faces, const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& normals, const std::vector<glm::vec2>& textureCoords) :
+	faces(faces),
+	positions(vertices),
+	normals(normals),
+	textureCoords(textureCoords),
+	nextFace(0)
+{
+	hasTextureCoords = textureCoords.size() > 0 && faces.HasTextureIndices();
+	hasNormals = normals.size() > 0 && faces.HasNormalIndices();
+
+	// Bounds of every position, so they hold before any vertex is built
+	boundsMin = glm::vec3(FLT_MAX);
+	boundsMax = glm::vec3(-FLT_MAX);
+	for (const glm::vec3& position : positions)
+	{
+		boundsMin = glm::min(boundsMin, position);
+		boundsMax = glm::max(boundsMax, position);
+	}
+	lookup = std::make_unique<CornerLookup>(positions.size(), faces.GetFacesCount() * 3);
+	// Usually every position is one vertex, only attribute seams add more
+	modelVertices.reserve(positions.size());
+	modelIndices.reserve(faces.GetFacesCount() * 3);
+	if (!hasNormals)
+	{
+		vertexPositions.reserve(positions.size());
+	}
+}
+
+MeshBatch MeshBuilder::Build(size_t faceCount)
+{
+	MeshBatch batch = {};
+	batch.firstVertex = modelVertices.size();
+	batch.firstIndex = modelIndices.size();
+	batch.totalIndexCount = faces.GetFacesCount() * 3;
+	batch.vertexEstimate = positions.size();
+	batch.boundsMin = boundsMin;
+	batch.boundsMax = boundsMax;
+
+	size_t lastFace = std::min(faces.GetFacesCount(), nextFace + faceCount);
+	for (; nextFace < lastFace; nextFace++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			CornerKey key;
+			key.vertexIndex = faces.GetVertexIndex(nextFace, j) - 1;
+			key.textureIndex = hasTextureCoords ? faces.GetTextureIndex(nextFace, j) - 1 : -1;
+			key.normalIndex = hasNormals ? faces.GetNormalIndex(nextFace, j) - 1 : -1;
+
+			// try_emplace only makes a node for a new corner, the arena never gets memory back
+			auto inserted = lookup->cornerToVertex.try_emplace(key, (GLuint)modelVertices.size());
+			if (inserted.second)
+			{
+				Vertex vertex = {};
+				vertex.position = positions[key.vertexIndex];
+				if (key.textureIndex >= 0)
+				{
+					vertex.textureCoords = textureCoords[key.textureIndex];
+				}
+				if (key.normalIndex >= 0)
+				{
+					vertex.normal = normals[key.normalIndex];
+				}
+				modelVertices.push_back(vertex);
+				if (!hasNormals)
+				{
+					vertexPositions.push_back((GLuint)key.vertexIndex);
+				}
+			}
+			modelIndices.push_back(inserted.first->second);
+		}
+	}
+
+	if (IsDone())
+	{
+		// The lookup table is only needed while corners are still coming in
+		lookup.reset();
+	}
+
+	batch.vertices = modelVertices.data() + batch.firstVertex;
+	batch.vertexCount = modelVertices.size() - batch.firstVertex;
+	batch.indices = modelIndices.data() + batch.firstIndex;
+	batch.indexCount = modelIndices.size() - batch.firstIndex;
+	return batch;
+}
+
+bool MeshBuilder::IsDone() const
+{
+	return nextFace >= faces.GetFacesCount();
+}
+
+std::vector<Vertex>& MeshBuilder::GetVertices()
+{
+	return modelVertices;
+}
+
+std::vector<GLuint>& MeshBuilder::GetIndices()
+{
+	return modelIndices;
+}
+
+bool MeshBuilder::HasNormals() const
+{
+	return hasNormals;
+}
+
+bool MeshBuilder::HasTextureCoords() const
+{
+	return hasTextureCoords;
+}
+
+const std::vector<GLuint>& MeshBuilder::GetVertexPositions() const
+{
+	return vertexPositions;
+}
@@ -0,0 +1,337 @@
+#include "MeshCache.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <vector>
+
+namespace
+{
+	const char CacheMagic[8] = { 'M', 'E', 'S', 'H', 'B', 'I', 'N', '\0' };
+	const size_t DataAlignment = 16;
+
+	// File layout: header, source path, then the vertex array, the index array, the
+	// level of detail table and the tangents, each starting on a DataAlignment boundary
+	struct MeshCacheHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint64_t vertexCount;
+		uint64_t indexCount;
+		uint32_t indexSize;
+		uint32_t pathLength;
+		uint32_t flags;
+		uint32_t lodCount;
+		uint32_t lodKey;
+		uint32_t normalKey;
+		uint64_t tangentCount;
+		float boundsMin[3];
+		float boundsMax[3];
+	};
+
+	struct MeshCacheLod
+	{
+		uint64_t firstIndex;
+		uint64_t indexCount;
+		float error;
+		uint32_t reserved;
+	};
+
+	struct SourceKey
+	{
+		std::string path;
+		uint64_t size;
+		int64_t time;
+	};
+
+	bool GetSourceKey(const std::string& modelPath, SourceKey& key)
+	{
+		std::error_code error;
+		std::filesystem::path path = std::filesystem::canonical(modelPath, error);
+		if (error)
+		{
+			return false;
+		}
+		key.path = path.generic_string();
+		key.size = std::filesystem::file_size(path, error);
+		if (error)
+		{
+			return false;
+		}
+		key.time = static_cast<int64_t>(std::filesystem::last_write_time(path, error).time_since_epoch().count());
+		return !error;
+	}
+
+	size_t AlignUp(size_t offset)
+	{
+		return (offset + DataAlignment - 1) / DataAlignment * DataAlignment;
+	}
+
+	// Sets offset to the aligned end and moves end past count elements, false if they do not fit in the file
+	bool PlaceArray(size_t fileSize, uint64_t count, size_t elementSize, size_t& end, size_t& offset)
+	{
+		offset = AlignUp(end);
+		if (offset > fileSize || elementSize == 0 || count > (fileSize - offset) / elementSize)
+		{
+			return false;
+		}
+		end = offset + static_cast<size_t>(count) * elementSize;
+		return true;
+	}
+}
+
+MeshCache::MeshCache() :
+	vertices(nullptr),
+	vertexCount(0),
+	indices(nullptr),
+	indexCount(0),
+	indexSize(0),
+	tangents(nullptr),
+	boundsMin(0.0f),
+	boundsMax(0.0f)
+{
+}
+
+std::string MeshCache::GetCachePath(const std::string& modelPath)
+{
+	return modelPath + ".meshbin";
+}
+
+bool MeshCache::Open(const std::string& modelPath, uint32_t flags, uint32_t lodKey, uint32_t normalKey)
+{
+	Close();
+
+	SourceKey key;
+	if (!GetSourceKey(modelPath, key) || !file.Open(GetCachePath(modelPath)))
+	{
+		return false;
+	}
+
+	MeshCacheHeader header;
+	if (file.GetSize() < sizeof(header))
+	{
+		Close();
+		return false;
+	}
+	std::memcpy(&header, file.GetData(), sizeof(header));
+
+	bool valid = std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) == 0 &&
+		header.version == Version &&
+		header.vertexSize == sizeof(Vertex) &&
+		header.sourceSize == key.size &&
+		header.sourceTime == key.time &&
+		header.pathLength == key.path.size() &&
+		header.flags == flags &&
+		header.lodKey == lodKey &&
+		header.normalKey == normalKey &&
+		(header.indexSize == 0 || header.indexSize == 2 || header.indexSize == 4);
+
+	// Each array starts at the next aligned offset after the last one that is there. Its count comes from the
+	// file, so it is checked against the bytes left before it moves the end along.
+	size_t fileSize = file.GetSize();
+	size_t pathOffset = sizeof(header);
+	size_t vertexOffset = 0;
+	size_t indexOffset = 0;
+	size_t lodOffset = 0;
+	size_t tangentOffset = 0;
+	size_t end = pathOffset + header.pathLength;
+	valid = valid && header.pathLength <= fileSize - pathOffset &&
+		PlaceArray(fileSize, header.vertexCount, sizeof(Vertex), end, vertexOffset) &&
+		(header.indexCount == 0 || PlaceArray(fileSize, header.indexCount, header.indexSize, end, indexOffset)) &&
+		(header.lodCount == 0 || PlaceArray(fileSize, header.lodCount, sizeof(MeshCacheLod), end, lodOffset)) &&
+		(header.tangentCount == 0 || PlaceArray(fileSize, header.tangentCount, sizeof(glm::vec4), end, tangentOffset));
+	valid = valid && (header.tangentCount == 0 || header.tangentCount == header.vertexCount);
+
+	valid = valid && std::memcmp(file.GetData() + pathOffset, key.path.data(), key.path.size()) == 0;
+	if (!valid)
+	{
+		Close();
+		return false;
+	}
+
+	vertices = reinterpret_cast<const Vertex*>(file.GetData() + vertexOffset);
+	vertexCount = static_cast<size_t>(header.vertexCount);
+	indices = header.indexCount > 0 ? file.GetData() + indexOffset : nullptr;
+	indexCount = static_cast<size_t>(header.indexCount);
+	indexSize = header.indexSize;
+	tangents = header.tangentCount > 0 ? reinterpret_cast<const glm::vec4*>(file.GetData() + tangentOffset) : nullptr;
+	boundsMin = glm::vec3(header.boundsMin[0], header.boundsMin[1], header.boundsMin[2]);
+	boundsMax = glm::vec3(header.boundsMax[0], header.boundsMax[1], header.boundsMax[2]);
+	for (uint32_t i = 0; i < header.lodCount; i++)
+	{
+		MeshCacheLod stored;
+		std::memcpy(&stored, file.GetData() + lodOffset + i * sizeof(stored), sizeof(stored));
+		if (stored.firstIndex > header.indexCount || stored.indexCount > header.indexCount - stored.firstIndex)
+		{
+			Close();
+			return false;
+		}
+		lods.push_back({ static_cast<size_t>(stored.firstIndex), static_cast<size_t>(stored.indexCount), stored.error });
+	}
+	return true;
+}
+
+void MeshCache::Close()
+{
+	file.Close();
+	vertices = nullptr;
+	vertexCount = 0;
+	indices = nullptr;
+	indexCount = 0;
+	indexSize = 0;
+	tangents = nullptr;
+	lods.clear();
+	boundsMin = boundsMax = glm::vec3(0.0f);
+}
+
+bool MeshCache::Write(const std::string& modelPath, const Vertex* vertexData, size_t vertexCount, const GLuint* indexData, size_t indexCount,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax, uint32_t flags, uint32_t lodKey, uint32_t normalKey, const std::vector<LodLevel>& lods, const glm::vec4* tangentData)
+{
+	SourceKey key;
+	if (!GetSourceKey(modelPath, key))
+	{
+		return false;
+	}
+
+	std::vector<GLushort> shortIndices;
+	const void* indexBytes = indexData;
+	uint32_t indexSize = sizeof(GLuint);
+	if (MeshModel::ChooseIndexType(vertexCount) == GL_UNSIGNED_SHORT)
+	{
+		shortIndices.assign(indexData, indexData + indexCount);
+		indexBytes = shortIndices.data();
+		indexSize = sizeof(GLushort);
+	}
+
+	MeshCacheHeader header;
+	std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+	header.version = Version;
+	header.vertexSize = sizeof(Vertex);
+	header.sourceSize = key.size;
+	header.sourceTime = key.time;
+	header.vertexCount = vertexCount;
+	header.indexCount = indexCount;
+	header.indexSize = indexCount > 0 ? indexSize : 0;
+	header.pathLength = static_cast<uint32_t>(key.path.size());
+	header.flags = flags;
+	header.lodCount = static_cast<uint32_t>(lods.size());
+	header.lodKey = lodKey;
+	header.normalKey = normalKey;
+	header.tangentCount = tangentData != nullptr ? vertexCount : 0;
+	for (int i = 0; i < 3; i++)
+	{
+		header.boundsMin[i] = boundsMin[i];
+		header.boundsMax[i] = boundsMax[i];
+	}
+
+	size_t vertexOffset = AlignUp(sizeof(header) + key.path.size());
+	size_t indexOffset = AlignUp(vertexOffset + vertexCount * sizeof(Vertex));
+	size_t lodOffset = AlignUp(indexOffset + header.indexCount * indexSize);
+	size_t tangentOffset = AlignUp(lodOffset + lods.size() * sizeof(MeshCacheLod));
+	const char padding[DataAlignment] = {};
+
+	// Written under a temporary name first so a reader never maps a half-written file
+	std::string cachePath = GetCachePath(modelPath);
+	std::string tempPath = cachePath + ".tmp";
+	{
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out)
+		{
+			return false;
+		}
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(key.path.data(), key.path.size());
+		out.write(padding, vertexOffset - sizeof(header) - key.path.size());
+		out.write(reinterpret_cast<const char*>(vertexData), vertexCount * sizeof(Vertex));
+		if (header.indexCount > 0)
+		{
+			out.write(padding, indexOffset - vertexOffset - vertexCount * sizeof(Vertex));
+			out.write(static_cast<const char*>(indexBytes), indexCount * indexSize);
+		}
+		size_t written = header.indexCount > 0 ? indexOffset + indexCount * indexSize : vertexOffset + vertexCount * sizeof(Vertex);
+		if (!lods.empty())
+		{
+			out.write(padding, lodOffset - written);
+			for (const LodLevel& lod : lods)
+			{
+				MeshCacheLod stored = { lod.firstIndex, lod.indexCount, lod.error, 0 };
+				out.write(reinterpret_cast<const char*>(&stored), sizeof(stored));
+			}
+			written = lodOffset + lods.size() * sizeof(MeshCacheLod);
+		}
+		if (header.tangentCount > 0)
+		{
+			out.write(padding, tangentOffset - written);
+			out.write(reinterpret_cast<const char*>(tangentData), vertexCount * sizeof(glm::vec4));
+		}
+		if (!out)
+		{
+			out.close();
+			std::remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(tempPath, cachePath, error);
+	if (error)
+	{
+		std::filesystem::remove(tempPath, error);
+		return false;
+	}
+	return true;
+}
+
+const Vertex* MeshCache::GetVertices() const
+{
+	return vertices;
+}
+
+size_t MeshCache::GetVertexCount() const
+{
+	return vertexCount;
+}
+
+const void* MeshCache::GetIndices() const
+{
+	return indices;
+}
+
+size_t MeshCache::GetIndexCount() const
+{
+	return indexCount;
+}
+
+uint32_t MeshCache::GetIndexSize() const
+{
+	return indexSize;
+}
+
+GLenum MeshCache::GetIndexType() const
+{
+	return indexSize == sizeof(GLushort) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+const std::vector<LodLevel>& MeshCache::GetLods() const
+{
+	return lods;
+}
+
+const glm::vec4* MeshCache::GetTangents() const
+{
+	return tangents;
+}
+
+const glm::vec3& MeshCache::GetBoundsMin() const
+{
+	return boundsMin;
+}
+
+const glm::vec3& MeshCache::GetBoundsMax() const
+{
+	return boundsMax;
+}
@@ -1,14 +1,126 @@
 #include "MeshModel.h"
 #include <iostream>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/packing.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include "MeshBuilder.h"
+#include "MeshCache.h"
+#include "UvProjector.h"
 
 using namespace std;
-MeshModel::MeshModel(std::vector<Face> faces, std::vector<glm::vec3> vertices, std::vector<glm::vec3> normals, std::vector<glm::vec2> textureCoords, const std::string& model_name) :
-	faces(faces),
-	vertices(vertices),
-	normals(normals),
-	textureCoords(textureCoords),
+
+namespace
+{
+	size_t GetComponentSize(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_BYTE:
+		case GL_UNSIGNED_BYTE:
+			return 1;
+		case GL_SHORT:
+		case GL_UNSIGNED_SHORT:
+		case GL_HALF_FLOAT:
+			return 2;
+		default:
+			return 4;
+		}
+	}
+
+	template<typename T>
+	float ReadComponent(const char* p, bool normalized)
+	{
+		T value;
+		memcpy(&value, p, sizeof(T));
+		// Signed normalized integers clamp at -1, the way GL converts them
+		return normalized ? std::max((float)value / (float)std::numeric_limits<T>::max(), -1.0f) : (float)value;
+	}
+
+	// One attribute of an External vertex as the vertex shader reads it
+	glm::vec4 ReadAttribute(const char* vertexData, const VertexAttribute& attribute, size_t i)
+	{
+		size_t componentSize = GetComponentSize(attribute.type);
+		size_t stride = attribute.stride != 0 ? attribute.stride : attribute.size * componentSize;
+		const char* p = vertexData + attribute.offset + i * stride;
+		glm::vec4 value(0.0f, 0.0f, 0.0f, 1.0f);
+		for (GLint c = 0; c < attribute.size; c++, p += componentSize)
+		{
+			switch (attribute.type)
+			{
+			case GL_BYTE: value[c] = ReadComponent<int8_t>(p, attribute.normalized); break;
+			case GL_UNSIGNED_BYTE: value[c] = ReadComponent<uint8_t>(p, attribute.normalized); break;
+			case GL_SHORT: value[c] = ReadComponent<int16_t>(p, attribute.normalized); break;
+			case GL_UNSIGNED_SHORT: value[c] = ReadComponent<uint16_t>(p, attribute.normalized); break;
+			case GL_UNSIGNED_INT: value[c] = ReadComponent<uint32_t>(p, attribute.normalized); break;
+			default: value[c] = ReadComponent<float>(p, false); break;
+			}
+		}
+		return value;
+	}
+}
+
+MeshModel::MeshModel(FaceTable faces, std::vector<glm::vec3> vertices, std::vector<glm::vec3> normals, std::vector<glm::vec2> textureCoords, const std::string& model_name) :
+	geometry(std::make_shared<MeshGeometry>()),
+	model_name(model_name)
+{
+	InitProperties();
+	geometry->faces = std::move(faces);
+	geometry->vertices = std::move(vertices);
+	geometry->normals = std::move(normals);
+	geometry->textureCoords = std::move(textureCoords);
+
+	MeshBuilder builder(geometry->faces, geometry->vertices, geometry->normals, geometry->textureCoords);
+	builder.Build(geometry->faces.GetFacesCount());
+	geometry->modelVertices = std::move(builder.GetVertices());
+	geometry->modelIndices = std::move(builder.GetIndices());
+
+	geometry->vertexCount = geometry->modelVertices.size();
+	geometry->indexCount = geometry->modelIndices.size();
+	geometry->indexType = ChooseIndexType(geometry->vertexCount);
+	ComputeBounds(geometry->modelVertices.data(), geometry->modelVertices.size(), geometry->boundsMin, geometry->boundsMax);
+}
+
+MeshModel::MeshModel(FaceTable faces, std::vector<glm::vec3> vertices, std::vector<glm::vec3> normals, std::vector<glm::vec2> textureCoords,
+	std::vector<Vertex> modelVertices, std::vector<GLuint> modelIndices, const std::string& model_name) :
+	geometry(std::make_shared<MeshGeometry>()),
+	model_name(model_name)
+{
+	InitProperties();
+	geometry->faces = std::move(faces);
+	geometry->vertices = std::move(vertices);
+	geometry->normals = std::move(normals);
+	geometry->textureCoords = std::move(textureCoords);
+	geometry->modelVertices = std::move(modelVertices);
+	geometry->modelIndices = std::move(modelIndices);
+	geometry->vertexCount = geometry->modelVertices.size();
+	geometry->indexCount = geometry->modelIndices.size();
+	geometry->indexType = ChooseIndexType(geometry->vertexCount);
+	ComputeBounds(geometry->modelVertices.data(), geometry->modelVertices.size(), geometry->boundsMin, geometry->boundsMax);
+}
+
+MeshModel::MeshModel(const std::string& model_name) :
+	geometry(std::make_shared<MeshGeometry>()),
+	model_name(model_name)
+{
+	InitProperties();
+	geometry->residency = MeshResidency::GpuOnly;
+}
+
+MeshModel::MeshModel(std::shared_ptr<MeshGeometry> geometry, const std::string& model_name) :
+	geometry(std::move(geometry)),
 	model_name(model_name)
+{
+	InitProperties();
+}
+
+void MeshModel::InitProperties()
 {
 	localTransform = worldTransform = localTranslate = worldTranslate =localScale = worldScale = localRotate  = worldRotate = glm::mat4(1.0f);
 	modelColor = glm::vec3(0.0f, 0.0f, 0.0f);
@@ -21,64 +133,434 @@ MeshModel::MeshModel(std::vector<Face> faces, std::vector<glm::vec3> vertices, s
 	std::mt19937 mt(rd());
 	std::uniform_real_distribution<double> dist(0, 1);
 	color = glm::vec3(dist(mt), dist(mt), dist(mt));
-	modelVertices.reserve(3 * faces.size());
-	for (int i = 0; i < faces.size(); i++)
+}
+
+MeshGeometry::~MeshGeometry()
+{
+	if (vao != 0)
+	{
+		glDeleteVertexArrays(1, &vao);
+		glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &ibo);
+	}
+	if (tangentVbo != 0)
+	{
+		glDeleteBuffers(1, &tangentVbo);
+	}
+	if (uvVbo != 0)
+	{
+		glDeleteBuffers(1, &uvVbo);
+	}
+	if (positionVao != 0)
+	{
+		glDeleteVertexArrays(1, &positionVao);
+		glDeleteBuffers(1, &positionVbo);
+	}
+}
+
+GLenum MeshModel::ChooseIndexType(size_t vertexCount)
+{
+	return vertexCount <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+void MeshModel::CreateBuffers(size_t vertexCount, size_t indexCount, GLenum indexType)
+{
+	geometry->vertexCount = vertexCount;
+	geometry->indexCount = indexCount;
+	geometry->indexType = indexType;
+	geometry->vertexCapacity = vertexCount;
+	geometry->residentVertexCount = geometry->residentIndexCount = 0;
+	glGenVertexArrays(1, &geometry->vao);
+	glGenBuffers(1, &geometry->vbo);
+	glGenBuffers(1, &geometry->ibo);
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * GetVertexSize(), NULL, GL_STATIC_DRAW);
+	glBindVertexArray(geometry->vao);
+	// The element buffer binding is part of the VAO state
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * GetIndexSize(), NULL, GL_STATIC_DRAW);
+	glBindVertexArray(0);
+	SetVertexAttributes();
+}
+
+void MeshModel::SetVertexAttributes()
+{
+	glBindVertexArray(geometry->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->vbo);
+	if (geometry->vertexFormat == VertexFormat::Quantized)
+	{
+		// Normalized integers arrive in the shader as floats, so it reads both layouts the same way
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(QuantizedVertex), (GLvoid*)offsetof(QuantizedVertex, position));
+		glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(QuantizedVertex), (GLvoid*)offsetof(QuantizedVertex, normal));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(QuantizedVertex), (GLvoid*)offsetof(QuantizedVertex, textureCoords));
+	}
+	else if (geometry->vertexFormat == VertexFormat::External)
 	{
-		Face currentFace = faces.at(i);
-		for (int j = 0; j < 3; j++)
+		for (const VertexAttribute& attribute : geometry->attributes)
 		{
-			int vertexIndex = currentFace.GetVertexIndex(j) - 1;
-			int normalIndex = currentFace.GetNormalIndex(j) - 1;
-			Vertex vertex;
-			vertex.position = vertices[vertexIndex];
+			glVertexAttribPointer(attribute.index, attribute.size, attribute.type, attribute.normalized, attribute.stride, (GLvoid*)attribute.offset);
+		}
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(3 * sizeof(GLfloat)));
+		// Texture Coords
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(6 * sizeof(GLfloat)));
+	}
+	if (geometry->uvVbo != 0)
+	{
+		// A projection replaces the vertex's own texture coords
+		glBindBuffer(GL_ARRAY_BUFFER, geometry->uvVbo);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (GLvoid*)0);
+	}
+	// An External layout can lack normals or texture coords, those read as the constant (0, 0, 0, 1)
+	for (GLuint index = 0; index < 3; index++)
+	{
+		if (HasVertexAttribute(index))
+		{
+			glEnableVertexAttribArray(index);
+		}
+		else
+		{
+			glDisableVertexAttribArray(index);
+		}
+	}
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
 
-			if (textureCoords.size() > 0)
-			{
-				int textureCoordsIndex = currentFace.GetTextureIndex(j) - 1;
-				vertex.textureCoords = textureCoords[textureCoordsIndex];
-			}
-			if (normals.size() > 0) {
-				vertex.normal = normals[normalIndex];
-			}
-			modelVertices.push_back(vertex);
+bool MeshModel::HasVertexAttribute(GLuint index) const
+{
+	if (geometry->vertexFormat != VertexFormat::External || (index == 2 && geometry->uvVbo != 0))
+	{
+		return true;
+	}
+	return std::any_of(geometry->attributes.begin(), geometry->attributes.end(), [index](const VertexAttribute& attribute) { return attribute.index == index; });
+}
+
+void MeshModel::UploadVertices(size_t first, size_t count, const Vertex* vertexData)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->vbo);
+	if (geometry->vertexFormat == VertexFormat::Quantized)
+	{
+		std::vector<QuantizedVertex> quantized(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			quantized[i] = QuantizeVertex(vertexData[i]);
 		}
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(QuantizedVertex), count * sizeof(QuantizedVertex), quantized.data());
 	}
-	glGenVertexArrays(1, &vao);
-	glGenBuffers(1, &vbo);
-	glBindVertexArray(vao);
-	glBindBuffer(GL_ARRAY_BUFFER, vbo);
-	glBufferData(GL_ARRAY_BUFFER, modelVertices.size() * sizeof(Vertex), &modelVertices[0], GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(3 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(1);
-	// Texture Coords
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(6 * sizeof(GLfloat)));
-	glEnableVertexAttribArray(2);
+	else
+	{
+		glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(Vertex), count * sizeof(Vertex), vertexData);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	geometry->residentVertexCount = std::max(geometry->residentVertexCount, first + count);
+}
+
+void MeshModel::UploadIndices(size_t first, size_t count, const void* indexData)
+{
+	glBindVertexArray(geometry->vao);
+	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, first * GetIndexSize(), count * GetIndexSize(), indexData);
+	glBindVertexArray(0);
+	geometry->residentIndexCount = std::max(geometry->residentIndexCount, first + count);
+}
+
+void MeshModel::CreateExternalBuffers(const void* vertexData, size_t vertexBytes, size_t vertexCount, std::vector<VertexAttribute> attributes,
+	const void* indexData, size_t indexCount, GLenum indexType)
+{
+	geometry->vertexFormat = VertexFormat::External;
+	geometry->attributes = std::move(attributes);
+	geometry->vertexBytes = vertexBytes;
+	geometry->vertexCount = geometry->vertexCapacity = geometry->residentVertexCount = vertexCount;
+	geometry->indexCount = geometry->residentIndexCount = indexCount;
+	geometry->indexType = indexType;
+	glGenVertexArrays(1, &geometry->vao);
+	glGenBuffers(1, &geometry->vbo);
+	glGenBuffers(1, &geometry->ibo);
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
+	glBindVertexArray(geometry->vao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * GetIndexSize(), indexData, GL_STATIC_DRAW);
 	glBindVertexArray(0);
+	SetVertexAttributes();
+}
+
+void MeshModel::ReserveVertices(size_t capacity)
+{
+	if (capacity <= geometry->vertexCapacity)
+	{
+		return;
+	}
+
+	// Grow geometrically and carry the resident vertices over on the GPU
+	capacity = std::max(capacity, geometry->vertexCapacity * 2);
+	GLuint newVbo;
+	glGenBuffers(1, &newVbo);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newVbo);
+	glBufferData(GL_COPY_WRITE_BUFFER, capacity * GetVertexSize(), NULL, GL_STATIC_DRAW);
+	if (geometry->residentVertexCount > 0)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, geometry->vbo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, geometry->residentVertexCount * GetVertexSize());
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	glDeleteBuffers(1, &geometry->vbo);
+	geometry->vbo = newVbo;
+	geometry->vertexCapacity = capacity;
+	SetVertexAttributes();
+}
+
+void MeshModel::AppendVertices(const Vertex* vertexData, size_t count)
+{
+	// The extra streams no longer cover every vertex, UploadModelData or their setters redo them
+	if (geometry->uvVbo != 0)
+	{
+		ReleaseUvStream();
+	}
+	if (geometry->positionVbo != 0)
+	{
+		ReleasePositionStream();
+	}
+	ReserveVertices(geometry->residentVertexCount + count);
+	UploadVertices(geometry->residentVertexCount, count, vertexData);
+	geometry->vertexCount = geometry->residentVertexCount;
+}
+
+void MeshModel::AdoptGeometry(const MeshModel& source)
+{
+	geometry = source.geometry;
+}
+
+void MeshModel::AppendIndices(const GLuint* indexData, size_t count)
+{
+	if (geometry->indexType == GL_UNSIGNED_SHORT)
+	{
+		std::vector<GLushort> shortIndices(indexData, indexData + count);
+		UploadIndices(geometry->residentIndexCount, count, shortIndices.data());
+	}
+	else
+	{
+		UploadIndices(geometry->residentIndexCount, count, indexData);
+	}
+}
+
+size_t MeshModel::GetResidentIndexCount() const
+{
+	return geometry->residentIndexCount;
+}
+
+void MeshModel::SetVertexFormat(VertexFormat format, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	geometry->vertexFormat = format;
+
+	// A cube rather than the box, so the dequantization is a uniform scale and normals are unaffected
+	glm::vec3 size = boundsMax - boundsMin;
+	geometry->quantizeOrigin = boundsMin;
+	geometry->quantizeScale = std::max(std::max(size.x, size.y), size.z);
+	if (geometry->quantizeScale <= 0.0f)
+	{
+		geometry->quantizeScale = 1.0f;
+	}
+}
+
+VertexFormat MeshModel::GetVertexFormat() const
+{
+	return geometry->vertexFormat;
+}
+
+size_t MeshModel::GetVertexSize() const
+{
+	if (geometry->vertexFormat == VertexFormat::External)
+	{
+		// On average, the buffer views can have gaps between their vertices
+		return geometry->vertexCount > 0 ? geometry->vertexBytes / geometry->vertexCount : 0;
+	}
+	return geometry->vertexFormat == VertexFormat::Quantized ? sizeof(QuantizedVertex) : sizeof(Vertex);
+}
+
+glm::mat4x4 MeshModel::GetDequantizeTransform() const
+{
+	if (geometry->vertexFormat != VertexFormat::Quantized)
+	{
+		return glm::mat4(1.0f);
+	}
+	return glm::scale(glm::translate(glm::mat4(1.0f), geometry->quantizeOrigin), glm::vec3(geometry->quantizeScale));
+}
+
+QuantizedVertex MeshModel::QuantizeVertex(const Vertex& vertex) const
+{
+	QuantizedVertex quantized;
+	glm::vec3 position = (vertex.position - geometry->quantizeOrigin) / geometry->quantizeScale;
+	quantized.position[0] = glm::packUnorm1x16(position.x);
+	quantized.position[1] = glm::packUnorm1x16(position.y);
+	quantized.position[2] = glm::packUnorm1x16(position.z);
+	quantized.position[3] = 0;
+	quantized.normal = glm::packSnorm3x10_1x2(glm::vec4(vertex.normal, 0.0f));
+	quantized.textureCoords[0] = glm::packHalf1x16(vertex.textureCoords.x);
+	quantized.textureCoords[1] = glm::packHalf1x16(vertex.textureCoords.y);
+	return quantized;
+}
+
+Vertex MeshModel::DequantizeVertex(const QuantizedVertex& quantized) const
+{
+	Vertex vertex;
+	glm::vec3 position(glm::unpackUnorm1x16(quantized.position[0]), glm::unpackUnorm1x16(quantized.position[1]), glm::unpackUnorm1x16(quantized.position[2]));
+	vertex.position = geometry->quantizeOrigin + position * geometry->quantizeScale;
+	vertex.normal = glm::vec3(glm::unpackSnorm3x10_1x2(quantized.normal));
+	vertex.textureCoords = glm::vec2(glm::unpackHalf1x16(quantized.textureCoords[0]), glm::unpackHalf1x16(quantized.textureCoords[1]));
+	return vertex;
+}
+
+QuantizationError MeshModel::MeasureQuantizationError(const Vertex* vertexData, size_t count) const
+{
+	QuantizationError error = {};
+	glm::vec3 boundsMin, boundsMax;
+	ComputeBounds(vertexData, count, boundsMin, boundsMax);
+	error.boundsDiagonal = glm::length(boundsMax - boundsMin);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const Vertex& vertex = vertexData[i];
+		Vertex decoded = DequantizeVertex(QuantizeVertex(vertex));
+		error.maxPosition = std::max(error.maxPosition, glm::length(decoded.position - vertex.position));
+		glm::vec2 textureError = glm::abs(decoded.textureCoords - vertex.textureCoords);
+		error.maxTextureCoords = std::max(error.maxTextureCoords, std::max(textureError.x, textureError.y));
+
+		float normalLength = glm::length(vertex.normal) * glm::length(decoded.normal);
+		if (normalLength > 0.0f)
+		{
+			float cosine = glm::clamp(glm::dot(vertex.normal, decoded.normal) / normalLength, -1.0f, 1.0f);
+			error.maxNormalDegrees = std::max(error.maxNormalDegrees, glm::degrees(std::acos(cosine)));
+		}
+	}
+	return error;
+}
+
+void MeshModel::ComputeBounds(const Vertex* vertexData, size_t count, glm::vec3& boundsMin, glm::vec3& boundsMax)
+{
+	boundsMin = glm::vec3(FLT_MAX);
+	boundsMax = glm::vec3(-FLT_MAX);
+	for (size_t i = 0; i < count; i++)
+	{
+		boundsMin = glm::min(boundsMin, vertexData[i].position);
+		boundsMax = glm::max(boundsMax, vertexData[i].position);
+	}
+	if (count == 0)
+	{
+		boundsMin = boundsMax = glm::vec3(0.0f);
+	}
+}
+
+void MeshModel::SetBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+{
+	geometry->boundsMin = boundsMin;
+	geometry->boundsMax = boundsMax;
+}
+
+const glm::vec3& MeshModel::GetBoundsMin() const
+{
+	return geometry->boundsMin;
+}
+
+const glm::vec3& MeshModel::GetBoundsMax() const
+{
+	return geometry->boundsMax;
+}
+
+void MeshModel::UploadToGpu()
+{
+	CreateBuffers(geometry->modelVertices.size(), geometry->modelIndices.size(), ChooseIndexType(geometry->modelVertices.size()));
+	UploadModelData();
+}
+
+void MeshModel::UploadModelData()
+{
+	if (geometry->vertexFormat == VertexFormat::External)
+	{
+		// modelVertices are Vertex data, the vertex buffer is made again in that layout
+		geometry->vertexFormat = VertexFormat::Float;
+		geometry->attributes.clear();
+		geometry->vertexBytes = 0;
+		geometry->vertexCapacity = geometry->residentVertexCount = 0;
+	}
+	if (geometry->modelIndices.size() > geometry->indexCount)
+	{
+		// e.g. a streamed model whose levels of detail were appended after its buffers were made
+		geometry->indexCount = geometry->modelIndices.size();
+		glBindVertexArray(geometry->vao);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, geometry->indexCount * GetIndexSize(), NULL, GL_STATIC_DRAW);
+		glBindVertexArray(0);
+		geometry->residentIndexCount = 0;
+	}
+	// Split vertices (generated normals) can outgrow a streamed buffer, optimization can shrink it
+	ReserveVertices(geometry->modelVertices.size());
+	geometry->vertexCount = geometry->modelVertices.size();
+	UploadVertices(0, geometry->modelVertices.size(), geometry->modelVertices.data());
+	if (geometry->indexType == GL_UNSIGNED_SHORT)
+	{
+		std::vector<GLushort> shortIndices(geometry->modelIndices.begin(), geometry->modelIndices.end());
+		UploadIndices(0, shortIndices.size(), shortIndices.data());
+	}
+	else
+	{
+		UploadIndices(0, geometry->modelIndices.size(), geometry->modelIndices.data());
+	}
+	if (!geometry->modelTangents.empty())
+	{
+		UploadTangents(geometry->modelTangents.data(), geometry->modelTangents.size());
+	}
+	if (geometry->uvProjection != UvProjection::None)
+	{
+		ProjectUvs();
+	}
+	if (geometry->positionStream)
+	{
+		UploadPositions();
+	}
+}
 
-	/*for (int j = 0; j < vertices.size(); j++) {
-		std::cout << "vertices " << j << "(X: " << vertices[j][0] << " ,Y: " << vertices[j][1] << " ,Z: " << vertices[j][2]<<")" << std::endl;
+void MeshModel::UploadTangents(const glm::vec4* tangentData, size_t count)
+{
+	if (geometry->tangentVbo == 0)
+	{
+		glGenBuffers(1, &geometry->tangentVbo);
 	}
-	for (int i = 0; i < faces.size(); i++) {
-		std::cout << "faces "  << ": (" << faces[i].GetVertexIndex(0) << ", " << faces[i].GetVertexIndex(1) << ", " << faces[i].GetVertexIndex(2)<<")" << std::endl;
-	}*/
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->tangentVbo);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::vec4), tangentData, GL_STATIC_DRAW);
+	glBindVertexArray(geometry->vao);
+	glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (GLvoid*)0);
+	glEnableVertexAttribArray(3);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	geometry->tangentCount = count;
+}
+
+bool MeshModel::HasTangents() const
+{
+	return geometry->tangentCount > 0;
+}
+
+bool MeshModel::IsUploaded() const
+{
+	return geometry->vao != 0;
 }
 
 MeshModel::~MeshModel()
 {
-	glDeleteVertexArrays(1, &vao);
-	glDeleteBuffers(1, &vbo);
 }
 
-const Face& MeshModel::GetFace(int index) const
+Face MeshModel::GetFace(int index) const
 {
-	return faces[index];
+	return geometry->faces.GetFace(index);
 }
 
 int MeshModel::GetFacesCount() const
 {
-	return faces.size();
+	return (int)geometry->faces.GetFacesCount();
 }
 
 const std::string& MeshModel::GetModelName() const
@@ -87,20 +569,20 @@ const std::string& MeshModel::GetModelName() const
 }
 
 std::vector<glm::vec3>& MeshModel::getVertices() {
-	return vertices;
+	return geometry->vertices;
 }
 float MeshModel::GetVertex(int index, int coordinate)
 {
-	return vertices[index][coordinate];
+	return geometry->vertices[index][coordinate];
 }
 float MeshModel::GetNormal(int index, int coordinate)
 {
-	return normals[index][coordinate];
+	return geometry->normals[index][coordinate];
 }
 
 std::vector<glm::vec3> MeshModel::GetNormals()
 {
-	return normals;
+	return geometry->normals;
 }
 
 void MeshModel::WorldTranslate(float x, float y, float z)
@@ -164,21 +646,406 @@ glm::vec3 MeshModel::GetPosition()
 }
 GLuint MeshModel::GetVao() const
 {
-	return vao;
+	return geometry->vao;
+}
+GLuint MeshModel::GetVao(DrawPass pass) const
+{
+	return pass == DrawPass::PositionOnly && geometry->positionVao != 0 ? geometry->positionVao : geometry->vao;
 }
 const std::vector<Vertex>& MeshModel::GetModelVertices()
 {
-	return modelVertices;
+	return geometry->modelVertices;
+}
+size_t MeshModel::GetVertexCount() const
+{
+	return geometry->vertexCount;
+}
+const std::vector<GLuint>& MeshModel::GetModelIndices() const
+{
+	return geometry->modelIndices;
+}
+size_t MeshModel::GetIndexCount() const
+{
+	return geometry->indexCount;
+}
+GLenum MeshModel::GetIndexType() const
+{
+	return geometry->indexType;
+}
+size_t MeshModel::GetIndexSize() const
+{
+	return geometry->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+void MeshModel::SetUvProjection(UvProjection mode)
+{
+	if (mode == geometry->uvProjection && (mode == UvProjection::None || geometry->uvVbo != 0))
+	{
+		return;
+	}
+	geometry->uvProjection = mode;
+	if (!IsUploaded())
+	{
+		// UploadModelData projects once the buffers exist
+		return;
+	}
+	if (mode == UvProjection::None)
+	{
+		ReleaseUvStream();
+	}
+	else
+	{
+		ProjectUvs();
+	}
+}
+
+UvProjection MeshModel::GetUvProjection() const
+{
+	return geometry->uvProjection;
+}
+
+bool MeshModel::WithVertexPositions(const std::function<void(const glm::vec3*, const glm::vec3*, size_t)>& use)
+{
+	if (geometry->modelVertices.size() >= geometry->vertexCount && geometry->vertexCount > 0)
+	{
+		use(&geometry->modelVertices.data()->position, &geometry->modelVertices.data()->normal, sizeof(Vertex));
+		return true;
+	}
+	if (geometry->compactPositions.size() >= geometry->vertexCount && geometry->vertexCount > 0)
+	{
+		use(geometry->compactPositions.data(), nullptr, sizeof(glm::vec3));
+		return true;
+	}
+
+	// Needs the vertices for a moment, afterwards the model keeps only what its residency says
+	MeshResidency kept = geometry->residency;
+	if (!RestoreModelData())
+	{
+		return false;
+	}
+	use(&geometry->modelVertices.data()->position, &geometry->modelVertices.data()->normal, sizeof(Vertex));
+	SetResidency(kept);
+	return true;
+}
+
+void MeshModel::ProjectUvs()
+{
+	auto start = std::chrono::steady_clock::now();
+	std::vector<glm::vec2> uvs(geometry->vertexCount);
+	bool projected = WithVertexPositions([&](const glm::vec3* positions, const glm::vec3* normals, size_t stride)
+	{
+		UvProjector::Project(geometry->uvProjection, positions, normals, stride, geometry->vertexCount, geometry->boundsMin, geometry->boundsMax, uvs.data());
+	});
+	if (!projected)
+	{
+		std::cerr << "Could not read back the vertices of " << model_name << " to project texture coords" << std::endl;
+		return;
+	}
+
+	if (geometry->uvVbo == 0)
+	{
+		glGenBuffers(1, &geometry->uvVbo);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->uvVbo);
+	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), uvs.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	SetVertexAttributes();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << UvProjector::GetName(geometry->uvProjection) << " texture coords for " << model_name << ": " << uvs.size() << " vertices in "
+		<< elapsed.count() * 1000.0 << " ms" << std::endl;
+}
+
+void MeshModel::ReleaseUvStream()
+{
+	if (geometry->uvVbo != 0)
+	{
+		glDeleteBuffers(1, &geometry->uvVbo);
+		geometry->uvVbo = 0;
+		SetVertexAttributes();
+	}
+}
+
+void MeshModel::SetPositionStream(bool enabled)
+{
+	geometry->positionStream = enabled;
+	if (!enabled)
+	{
+		ReleasePositionStream();
+	}
+	else if (IsUploaded() && geometry->positionVbo == 0)
+	{
+		UploadPositions();
+	}
+}
+
+bool MeshModel::HasPositionStream() const
+{
+	return geometry->positionVbo != 0;
+}
+
+size_t MeshModel::GetPositionSize() const
+{
+	return geometry->vertexFormat == VertexFormat::Quantized ? 4 * sizeof(GLushort) : sizeof(glm::vec3);
+}
+
+void MeshModel::UploadPositions()
+{
+	// Same encoding as the position in the full vertex, so GetDrawTransform fits both arrays
+	std::vector<char> packed(geometry->vertexCount * GetPositionSize());
+	bool read = WithVertexPositions([&](const glm::vec3* positions, const glm::vec3*, size_t stride)
+	{
+		const char* source = reinterpret_cast<const char*>(positions);
+		for (size_t i = 0; i < geometry->vertexCount; i++)
+		{
+			const glm::vec3& position = *reinterpret_cast<const glm::vec3*>(source + i * stride);
+			if (geometry->vertexFormat == VertexFormat::Quantized)
+			{
+				Vertex vertex = { position, glm::vec3(0.0f), glm::vec2(0.0f) };
+				memcpy(&packed[i * GetPositionSize()], QuantizeVertex(vertex).position, GetPositionSize());
+			}
+			else
+			{
+				memcpy(&packed[i * GetPositionSize()], &position, GetPositionSize());
+			}
+		}
+	});
+	if (!read)
+	{
+		std::cerr << "Could not read back the vertices of " << model_name << " for its position stream" << std::endl;
+		return;
+	}
+
+	if (geometry->positionVao == 0)
+	{
+		glGenVertexArrays(1, &geometry->positionVao);
+		glGenBuffers(1, &geometry->positionVbo);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->positionVbo);
+	glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+	glBindVertexArray(geometry->positionVao);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry->ibo);
+	if (geometry->vertexFormat == VertexFormat::Quantized)
+	{
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, (GLsizei)GetPositionSize(), (GLvoid*)0);
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, (GLsizei)GetPositionSize(), (GLvoid*)0);
+	}
+	glEnableVertexAttribArray(0);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void MeshModel::ReleasePositionStream()
+{
+	if (geometry->positionVao != 0)
+	{
+		glDeleteVertexArrays(1, &geometry->positionVao);
+		glDeleteBuffers(1, &geometry->positionVbo);
+		geometry->positionVao = geometry->positionVbo = 0;
+	}
+}
+
+void MeshModel::SetResidency(MeshResidency mode)
+{
+	bool needsData = (mode == MeshResidency::Full && geometry->modelVertices.empty()) ||
+		(mode == MeshResidency::Compact && geometry->compactPositions.empty() && geometry->modelVertices.empty()) ||
+		(mode != MeshResidency::GpuOnly && geometry->modelIndices.empty());
+	if (needsData && geometry->vertexCount > 0 && !RestoreModelData())
+	{
+		std::cerr << "Could not restore the CPU data of " << model_name << std::endl;
+		return;
+	}
+
+	if (mode == MeshResidency::Full)
+	{
+		if (geometry->faces.GetFacesCount() == 0)
+		{
+			RebuildObjData();
+		}
+		std::vector<glm::vec3>().swap(geometry->compactPositions);
+	}
+	else
+	{
+		if (mode == MeshResidency::Compact && geometry->compactPositions.empty())
+		{
+			geometry->compactPositions.resize(geometry->modelVertices.size());
+			for (size_t i = 0; i < geometry->modelVertices.size(); i++)
+			{
+				geometry->compactPositions[i] = geometry->modelVertices[i].position;
+			}
+		}
+		geometry->faces = FaceTable();
+		std::vector<glm::vec3>().swap(geometry->vertices);
+		std::vector<glm::vec3>().swap(geometry->normals);
+		std::vector<glm::vec2>().swap(geometry->textureCoords);
+		std::vector<Vertex>().swap(geometry->modelVertices);
+		std::vector<glm::vec4>().swap(geometry->modelTangents);
+	}
+	if (mode == MeshResidency::GpuOnly)
+	{
+		std::vector<GLuint>().swap(geometry->modelIndices);
+		std::vector<glm::vec3>().swap(geometry->compactPositions);
+	}
+	geometry->residency = mode;
+}
+
+MeshResidency MeshModel::GetResidency() const
+{
+	return geometry->residency;
 }
-void MeshModel::SetPlane()
+
+bool MeshModel::RestoreModelData()
 {
-	for (int i = 0; i < modelVertices.size(); i++)
+	if (!geometry->cacheSource.modelPath.empty())
+	{
+		MeshCache cache;
+		if (cache.Open(geometry->cacheSource.modelPath, geometry->cacheSource.flags, geometry->cacheSource.lodKey, geometry->cacheSource.normalKey) &&
+			cache.GetVertexCount() == geometry->vertexCount && cache.GetIndexCount() == geometry->indexCount)
+		{
+			geometry->modelVertices.assign(cache.GetVertices(), cache.GetVertices() + geometry->vertexCount);
+			if (cache.GetIndexType() == GL_UNSIGNED_SHORT)
+			{
+				const GLushort* shortIndices = static_cast<const GLushort*>(cache.GetIndices());
+				geometry->modelIndices.assign(shortIndices, shortIndices + geometry->indexCount);
+			}
+			else
+			{
+				const GLuint* intIndices = static_cast<const GLuint*>(cache.GetIndices());
+				geometry->modelIndices.assign(intIndices, intIndices + geometry->indexCount);
+			}
+			if (cache.GetTangents() != nullptr)
+			{
+				geometry->modelTangents.assign(cache.GetTangents(), cache.GetTangents() + geometry->vertexCount);
+			}
+			return true;
+		}
+	}
+	if (!IsUploaded())
+	{
+		return false;
+	}
+
+	geometry->modelVertices.resize(geometry->vertexCount);
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->vbo);
+	if (geometry->vertexFormat == VertexFormat::External)
+	{
+		std::vector<char> external(geometry->vertexBytes);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, external.size(), external.data());
+		std::fill(geometry->modelVertices.begin(), geometry->modelVertices.end(), Vertex{ glm::vec3(0.0f), glm::vec3(0.0f), glm::vec2(0.0f) });
+		for (const VertexAttribute& attribute : geometry->attributes)
+		{
+			for (size_t i = 0; i < geometry->vertexCount; i++)
+			{
+				glm::vec4 value = ReadAttribute(external.data(), attribute, i);
+				Vertex& vertex = geometry->modelVertices[i];
+				switch (attribute.index)
+				{
+				case 0: vertex.position = glm::vec3(value); break;
+				case 1: vertex.normal = glm::vec3(value); break;
+				case 2: vertex.textureCoords = glm::vec2(value); break;
+				}
+			}
+		}
+	}
+	else if (geometry->vertexFormat == VertexFormat::Quantized)
+	{
+		std::vector<QuantizedVertex> quantized(geometry->vertexCount);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, geometry->vertexCount * sizeof(QuantizedVertex), quantized.data());
+		for (size_t i = 0; i < geometry->vertexCount; i++)
+		{
+			geometry->modelVertices[i] = DequantizeVertex(quantized[i]);
+		}
+	}
+	else
 	{
-		modelVertices.at(i).textureCoords.x = modelVertices.at(i).position.x;
-		modelVertices.at(i).textureCoords.y = modelVertices.at(i).position.y;
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, geometry->vertexCount * sizeof(Vertex), geometry->modelVertices.data());
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	glBindVertexArray(geometry->vao);
+	if (geometry->indexType == GL_UNSIGNED_SHORT)
+	{
+		std::vector<GLushort> shortIndices(geometry->indexCount);
+		glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, geometry->indexCount * sizeof(GLushort), shortIndices.data());
+		geometry->modelIndices.assign(shortIndices.begin(), shortIndices.end());
+	}
+	else
+	{
+		geometry->modelIndices.resize(geometry->indexCount);
+		glGetBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, geometry->indexCount * sizeof(GLuint), geometry->modelIndices.data());
 	}
-	glBindVertexArray(vao);
-	glBindBuffer(GL_VERTEX_ARRAY, vbo);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, modelVertices.size() * sizeof(Vertex), &modelVertices[0]);
 	glBindVertexArray(0);
-}
\ No newline at end of file
+
+	if (HasTangents())
+	{
+		geometry->modelTangents.resize(geometry->tangentCount);
+		glBindBuffer(GL_ARRAY_BUFFER, geometry->tangentVbo);
+		glGetBufferSubData(GL_ARRAY_BUFFER, 0, geometry->tangentCount * sizeof(glm::vec4), geometry->modelTangents.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	return true;
+}
+
+// OBJ style arrays with one position, normal and texture coordinate per indexed vertex
+void MeshModel::RebuildObjData()
+{
+	geometry->vertices.resize(geometry->modelVertices.size());
+	geometry->normals.resize(geometry->modelVertices.size());
+	geometry->textureCoords.resize(geometry->modelVertices.size());
+	for (size_t i = 0; i < geometry->modelVertices.size(); i++)
+	{
+		geometry->vertices[i] = geometry->modelVertices[i].position;
+		geometry->normals[i] = geometry->modelVertices[i].normal;
+		geometry->textureCoords[i] = geometry->modelVertices[i].textureCoords;
+	}
+
+	size_t faceIndexCount = geometry->lods.empty() ? geometry->modelIndices.size() : geometry->lods[0].indexCount;
+	geometry->faces = FaceTable();
+	geometry->faces.Reserve(faceIndexCount / 3);
+	for (size_t i = 0; i + 2 < faceIndexCount; i += 3)
+	{
+		int corners[3] = { (int)geometry->modelIndices[i] + 1, (int)geometry->modelIndices[i + 1] + 1, (int)geometry->modelIndices[i + 2] + 1 };
+		geometry->faces.AddTriangle(corners, corners, corners);
+	}
+}
+
+const std::vector<glm::vec3>& MeshModel::GetCompactPositions() const
+{
+	return geometry->compactPositions;
+}
+
+size_t MeshModel::GetCpuMemoryUsage() const
+{
+	return geometry->faces.GetMemoryUsage() +
+		geometry->vertices.capacity() * sizeof(glm::vec3) +
+		geometry->normals.capacity() * sizeof(glm::vec3) +
+		geometry->textureCoords.capacity() * sizeof(glm::vec2) +
+		geometry->modelVertices.capacity() * sizeof(Vertex) +
+		geometry->modelIndices.capacity() * sizeof(GLuint) +
+		geometry->compactPositions.capacity() * sizeof(glm::vec3) +
+		geometry->modelTangents.capacity() * sizeof(glm::vec4) +
+		geometry->lods.capacity() * sizeof(LodLevel);
+}
+
+size_t MeshModel::GetGpuMemoryUsage() const
+{
+	size_t vertexBytes = geometry->vertexFormat == VertexFormat::External ? geometry->vertexBytes : geometry->vertexCapacity * GetVertexSize();
+	return IsUploaded() ? vertexBytes + geometry->indexCount * GetIndexSize() + geometry->tangentCount * sizeof(glm::vec4) +
+		(geometry->uvVbo != 0 ? geometry->vertexCount * sizeof(glm::vec2) : 0) +
+		(geometry->positionVbo != 0 ? geometry->vertexCount * GetPositionSize() : 0) : 0;
+}
+MeshGeometry& MeshModel::GetGeometry() const
+{
+	return *geometry;
+}
+
+const std::shared_ptr<MeshGeometry>& MeshModel::GetSharedGeometry() const
+{
+	return geometry;
+}
+
+long MeshModel::GetInstanceCount() const
+{
+	return geometry.use_count();
+}
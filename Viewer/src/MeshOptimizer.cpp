@@ -0,0 +1,315 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <climits>
+
+namespace
+{
+	// FIFO post-transform cache: a vertex is resident while fewer than cacheSize misses happened since it was loaded
+	struct CacheSimulator
+	{
+		std::vector<size_t> timestamps;
+		size_t time;
+		size_t cacheSize;
+
+		CacheSimulator(size_t vertexCount, size_t cacheSize) :
+			timestamps(vertexCount, 0),
+			time(cacheSize + 1),
+			cacheSize(cacheSize)
+		{
+		}
+
+		// Returns 1 on a miss
+		unsigned Access(GLuint vertex)
+		{
+			if (time - timestamps[vertex] > cacheSize)
+			{
+				timestamps[vertex] = time++;
+				return 1;
+			}
+			return 0;
+		}
+
+		void Flush()
+		{
+			time += cacheSize + 1;
+		}
+	};
+}
+
+VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize)
+{
+	CacheSimulator cache(vertexCount, cacheSize);
+	size_t misses = 0;
+	for (GLuint index : indices)
+	{
+		misses += cache.Access(index);
+	}
+
+	VertexCacheStats stats;
+	size_t triangleCount = indices.size() / 3;
+	stats.acmr = triangleCount > 0 ? (float)misses / (float)triangleCount : 0.0f;
+	stats.atvr = vertexCount > 0 ? (float)misses / (float)vertexCount : 0.0f;
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || vertexCount == 0)
+	{
+		return;
+	}
+
+	// Triangles around each vertex, and how many of them are not emitted yet
+	std::vector<unsigned> liveTriangles(vertexCount, 0);
+	for (GLuint index : indices)
+	{
+		liveTriangles[index]++;
+	}
+	std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+	std::vector<unsigned> adjacency(indices.size());
+	std::vector<size_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		adjacency[fill[indices[i]]++] = (unsigned)(i / 3);
+	}
+
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<GLuint> deadEnd;
+	std::vector<GLuint> candidates;
+	std::vector<GLuint> result;
+	deadEnd.reserve(indices.size());
+	result.reserve(indices.size());
+
+	size_t time = cacheSize + 1;
+	size_t cursor = 0;
+	long long fanning = indices[0];
+	while (fanning >= 0)
+	{
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (size_t k = adjacencyOffsets[fanning]; k < adjacencyOffsets[fanning + 1]; k++)
+		{
+			unsigned triangle = adjacency[k];
+			if (emitted[triangle])
+			{
+				continue;
+			}
+			for (int corner = 0; corner < 3; corner++)
+			{
+				GLuint v = indices[triangle * 3 + corner];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize)
+				{
+					cacheTime[v] = time++;
+				}
+			}
+			emitted[triangle] = 1;
+		}
+
+		// Next fan: the oldest candidate that will still be cached after its own triangles went through
+		long long next = -1;
+		long long bestPriority = -1;
+		for (GLuint v : candidates)
+		{
+			if (liveTriangles[v] == 0)
+			{
+				continue;
+			}
+			long long priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+			{
+				priority = (long long)(time - cacheTime[v]);
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		// Dead end: go back to a recently used vertex, or else to the next unfinished one in order
+		while (next < 0 && !deadEnd.empty())
+		{
+			GLuint v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0)
+			{
+				next = v;
+			}
+		}
+		while (next < 0 && cursor < vertexCount)
+		{
+			if (liveTriangles[cursor] > 0)
+			{
+				next = (long long)cursor;
+			}
+			cursor++;
+		}
+		fanning = next;
+	}
+
+	// Meshes that come already well ordered (e.g. lathed strips) can lose, keep the input then
+	if (AnalyzeVertexCache(result, vertexCount, cacheSize).acmr < AnalyzeVertexCache(indices, vertexCount, cacheSize).acmr)
+	{
+		indices.swap(result);
+	}
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices, float threshold, size_t cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	// Hard boundaries: a triangle that misses on all three corners starts from a cold cache anyway
+	std::vector<unsigned> misses(triangleCount);
+	std::vector<size_t> hardClusters;
+	CacheSimulator cache(vertices.size(), cacheSize);
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		misses[t] = cache.Access(indices[t * 3]) + cache.Access(indices[t * 3 + 1]) + cache.Access(indices[t * 3 + 2]);
+		if (t == 0 || misses[t] == 3)
+		{
+			hardClusters.push_back(t);
+		}
+	}
+	hardClusters.push_back(triangleCount);
+
+	// Soft boundaries: cut a cluster as soon as its prefix is about as cache efficient as the whole
+	std::vector<size_t> clusters;
+	cache.Flush();
+	for (size_t c = 0; c + 1 < hardClusters.size(); c++)
+	{
+		size_t begin = hardClusters[c];
+		size_t end = hardClusters[c + 1];
+		size_t clusterMisses = 0;
+		for (size_t t = begin; t < end; t++)
+		{
+			clusterMisses += misses[t];
+		}
+		float limit = threshold * (float)clusterMisses / (float)(end - begin);
+
+		clusters.push_back(begin);
+		size_t start = begin;
+		size_t runningMisses = 0;
+		for (size_t t = begin; t < end; t++)
+		{
+			runningMisses += cache.Access(indices[t * 3]) + cache.Access(indices[t * 3 + 1]) + cache.Access(indices[t * 3 + 2]);
+			if (t + 1 < end && (float)runningMisses <= limit * (float)(t + 1 - start))
+			{
+				clusters.push_back(t + 1);
+				start = t + 1;
+				runningMisses = 0;
+				cache.Flush();
+			}
+		}
+		cache.Flush();
+	}
+	size_t clusterCount = clusters.size();
+	clusters.push_back(triangleCount);
+
+	// Area weighted centroid and normal of every cluster
+	std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		float clusterArea = 0.0f;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			const glm::vec3& a = vertices[indices[t * 3]].position;
+			const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3& d = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 normal = glm::cross(b - a, d - a);
+			float area = glm::length(normal);
+			centroids[c] += (a + b + d) * (area / 3.0f);
+			normals[c] += normal;
+			clusterArea += area;
+		}
+		meshCentroid += centroids[c];
+		meshArea += clusterArea;
+		centroids[c] = clusterArea > 0.0f ? centroids[c] / clusterArea : vertices[indices[clusters[c] * 3]].position;
+	}
+	if (meshArea > 0.0f)
+	{
+		meshCentroid /= meshArea;
+	}
+
+	// Clusters on the outside facing away from the center are the likely occluders
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		float length = glm::length(normals[c]);
+		sortKeys[c] = length > 0.0f ? glm::dot(centroids[c] - meshCentroid, normals[c] / length) : 0.0f;
+	}
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<GLuint> result;
+	result.reserve(indices.size());
+	for (size_t c : order)
+	{
+		result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	}
+	indices.swap(result);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, std::vector<glm::vec4>* tangents)
+{
+	bool moveTangents = tangents != nullptr && tangents->size() == vertices.size();
+	std::vector<GLuint> remap(vertices.size(), UINT_MAX);
+	GLuint used = 0;
+	for (GLuint& index : indices)
+	{
+		if (remap[index] == UINT_MAX)
+		{
+			remap[index] = used++;
+		}
+		index = remap[index];
+	}
+
+	// Unused vertices go to the back, then every cycle of the permutation is walked in place,
+	// so the vertex array is never held twice
+	GLuint unused = used;
+	for (GLuint& target : remap)
+	{
+		if (target == UINT_MAX)
+		{
+			target = unused++;
+		}
+	}
+	for (size_t start = 0; start < vertices.size(); start++)
+	{
+		while (remap[start] != start)
+		{
+			GLuint target = remap[start];
+			std::swap(vertices[start], vertices[target]);
+			if (moveTangents)
+			{
+				std::swap((*tangents)[start], (*tangents)[target]);
+			}
+			std::swap(remap[start], remap[target]);
+		}
+	}
+	vertices.resize(used);
+	if (moveTangents)
+	{
+		tangents->resize(used);
+	}
+}
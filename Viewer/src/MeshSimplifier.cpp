@@ -0,0 +1,337 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cfloat>
+
+namespace
+{
+	// Symmetric 4x4 error quadric (upper triangle) plus the area it was built from
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+		double a11 = 0, a12 = 0, a13 = 0;
+		double a22 = 0, a23 = 0;
+		double a33 = 0;
+		double weight = 0;
+
+		void AddPlane(const glm::dvec3& n, double d, double w)
+		{
+			a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z; a03 += w * n.x * d;
+			a11 += w * n.y * n.y; a12 += w * n.y * n.z; a13 += w * n.y * d;
+			a22 += w * n.z * n.z; a23 += w * n.z * d;
+			a33 += w * d * d;
+			weight += w;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+			weight += q.weight;
+		}
+
+		// Area weighted sum of squared distances from p to the planes
+		double Evaluate(const glm::vec3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double error = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+				+ a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+				+ a22 * z * z + 2 * a23 * z
+				+ a33;
+			return std::max(error, 0.0);
+		}
+	};
+
+	struct Collapse
+	{
+		GLuint from;
+		GLuint to;
+		double cost;
+	};
+
+	// Triangles around every position, rebuilt at the start of each pass
+	struct Adjacency
+	{
+		std::vector<size_t> offsets;
+		std::vector<unsigned> triangles;
+
+		void Build(const std::vector<GLuint>& indices, const std::vector<GLuint>& wedge)
+		{
+			offsets.assign(wedge.size() + 1, 0);
+			for (GLuint index : indices)
+			{
+				offsets[wedge[index] + 1]++;
+			}
+			for (size_t v = 0; v < wedge.size(); v++)
+			{
+				offsets[v + 1] += offsets[v];
+			}
+			triangles.resize(indices.size());
+			std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+			for (size_t i = 0; i < indices.size(); i++)
+			{
+				triangles[fill[wedge[indices[i]]]++] = (unsigned)(i / 3);
+			}
+		}
+	};
+
+	void GatherNeighbours(const Adjacency& adjacency, const std::vector<GLuint>& indices, const std::vector<GLuint>& wedge, GLuint vertex, std::vector<GLuint>& neighbours)
+	{
+		neighbours.clear();
+		for (size_t k = adjacency.offsets[vertex]; k < adjacency.offsets[vertex + 1]; k++)
+		{
+			unsigned triangle = adjacency.triangles[k];
+			for (int corner = 0; corner < 3; corner++)
+			{
+				GLuint other = wedge[indices[triangle * 3 + corner]];
+				if (other != vertex && std::find(neighbours.begin(), neighbours.end(), other) == neighbours.end())
+				{
+					neighbours.push_back(other);
+				}
+			}
+		}
+	}
+
+	// Link condition (the edge's two opposite vertices are the only shared neighbours)
+	// and no triangle around the moving vertex may flip
+	bool CanCollapse(const Adjacency& adjacency, const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, const std::vector<GLuint>& wedge,
+		GLuint from, GLuint to, std::vector<GLuint>& fromNeighbours, std::vector<GLuint>& toNeighbours)
+	{
+		GLuint toPosition = wedge[to];
+		GatherNeighbours(adjacency, indices, wedge, from, fromNeighbours);
+		GatherNeighbours(adjacency, indices, wedge, toPosition, toNeighbours);
+		size_t shared = 0;
+		for (GLuint v : fromNeighbours)
+		{
+			if (std::find(toNeighbours.begin(), toNeighbours.end(), v) != toNeighbours.end())
+			{
+				shared++;
+			}
+		}
+		if (shared > 2)
+		{
+			return false;
+		}
+
+		const glm::vec3& target = vertices[to].position;
+		for (size_t k = adjacency.offsets[from]; k < adjacency.offsets[from + 1]; k++)
+		{
+			const GLuint* triangle = &indices[adjacency.triangles[k] * 3];
+			if (wedge[triangle[0]] == toPosition || wedge[triangle[1]] == toPosition || wedge[triangle[2]] == toPosition)
+			{
+				continue;
+			}
+
+			glm::vec3 before[3], after[3];
+			for (int corner = 0; corner < 3; corner++)
+			{
+				before[corner] = vertices[triangle[corner]].position;
+				after[corner] = wedge[triangle[corner]] == from ? target : before[corner];
+			}
+			glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+			glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+			if (glm::dot(normalBefore, normalAfter) <= 1e-3f * glm::length(normalBefore) * glm::length(normalAfter))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+float MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices, size_t targetIndexCount, std::vector<GLuint>& result)
+{
+	result = indices;
+	if (targetIndexCount >= indices.size() || vertices.empty())
+	{
+		return 0.0f;
+	}
+
+	// Vertices that share a position are one point of the surface, the first of them stands for all.
+	// More than one vertex at a position means an attribute seam, which stays where it is.
+	size_t vertexCount = vertices.size();
+	std::vector<GLuint> wedge(vertexCount);
+	std::vector<char> locked(vertexCount, 0);
+	{
+		std::vector<GLuint> order(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			order[v] = (GLuint)v;
+		}
+		auto lessPosition = [&vertices](GLuint a, GLuint b)
+		{
+			const glm::vec3& p = vertices[a].position;
+			const glm::vec3& q = vertices[b].position;
+			return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z != q.z ? p.z < q.z : a < b;
+		};
+		std::sort(order.begin(), order.end(), lessPosition);
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			GLuint v = order[i];
+			if (i > 0 && vertices[order[i - 1]].position == vertices[v].position)
+			{
+				wedge[v] = wedge[order[i - 1]];
+				locked[wedge[v]] = 1;
+			}
+			else
+			{
+				wedge[v] = v;
+			}
+		}
+	}
+
+	// Edges that do not have exactly two triangles are open borders or non-manifold
+	{
+		std::vector<uint64_t> edges;
+		edges.reserve(indices.size());
+		for (size_t i = 0; i < indices.size(); i += 3)
+		{
+			for (int corner = 0; corner < 3; corner++)
+			{
+				GLuint a = wedge[indices[i + corner]];
+				GLuint b = wedge[indices[i + (corner + 1) % 3]];
+				edges.push_back(((uint64_t)std::min(a, b) << 32) | std::max(a, b));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t begin = 0, end = 0; begin < edges.size(); begin = end)
+		{
+			while (end < edges.size() && edges[end] == edges[begin])
+			{
+				end++;
+			}
+			if (end - begin != 2)
+			{
+				locked[(GLuint)(edges[begin] >> 32)] = 1;
+				locked[(GLuint)(edges[begin] & 0xFFFFFFFFu)] = 1;
+			}
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		glm::dvec3 p0(vertices[indices[i]].position);
+		glm::dvec3 p1(vertices[indices[i + 1]].position);
+		glm::dvec3 p2(vertices[indices[i + 2]].position);
+		glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+		double area = glm::length(normal);
+		if (area <= 0.0)
+		{
+			continue;
+		}
+		normal /= area;
+		double distance = -glm::dot(normal, p0);
+		for (int corner = 0; corner < 3; corner++)
+		{
+			quadrics[wedge[indices[i + corner]]].AddPlane(normal, distance, area);
+		}
+	}
+
+	Adjacency adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<Collapse> cheapest(vertexCount);
+	std::vector<GLuint> remap(vertexCount);
+	std::vector<char> touched(vertexCount);
+	std::vector<GLuint> fromNeighbours, toNeighbours;
+	double maxError = 0.0;
+
+	// Each pass collapses the cheapest edges that do not interfere with each other
+	while (result.size() > targetIndexCount)
+	{
+		adjacency.Build(result, wedge);
+
+		// Every directed edge u -> v of a triangle proposes moving u onto v, each vertex keeps its cheapest
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			cheapest[v].cost = DBL_MAX;
+		}
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int corner = 0; corner < 3; corner++)
+			{
+				GLuint from = wedge[result[i + corner]];
+				GLuint to = result[i + (corner + 1) % 3];
+				if (locked[from])
+				{
+					continue;
+				}
+				Quadric quadric = quadrics[from];
+				quadric.Add(quadrics[wedge[to]]);
+				double cost = quadric.Evaluate(vertices[to].position) / std::max(quadric.weight, 1e-12);
+				if (cost < cheapest[from].cost)
+				{
+					cheapest[from] = { from, to, cost };
+				}
+			}
+		}
+		collapses.clear();
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			if (cheapest[v].cost != DBL_MAX)
+			{
+				collapses.push_back(cheapest[v]);
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+
+		for (size_t v = 0; v < vertexCount; v++)
+		{
+			remap[v] = (GLuint)v;
+		}
+		std::fill(touched.begin(), touched.end(), 0);
+
+		// An interior collapse removes two triangles
+		size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+		size_t removed = 0;
+		for (const Collapse& collapse : collapses)
+		{
+			if (removed >= trianglesToRemove)
+			{
+				break;
+			}
+			GLuint toPosition = wedge[collapse.to];
+			if (touched[collapse.from] || touched[toPosition] ||
+				!CanCollapse(adjacency, vertices, result, wedge, collapse.from, collapse.to, fromNeighbours, toNeighbours))
+			{
+				continue;
+			}
+
+			remap[collapse.from] = collapse.to;
+			quadrics[toPosition].Add(quadrics[collapse.from]);
+			maxError = std::max(maxError, collapse.cost);
+			removed += 2;
+
+			// The ring around the collapse changes shape, leave it alone for the rest of this pass
+			touched[collapse.from] = touched[toPosition] = 1;
+			for (GLuint v : fromNeighbours)
+			{
+				touched[v] = 1;
+			}
+		}
+		if (removed == 0)
+		{
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3)
+		{
+			GLuint a = remap[result[i]];
+			GLuint b = remap[result[i + 1]];
+			GLuint c = remap[result[i + 2]];
+			if (wedge[a] != wedge[b] && wedge[b] != wedge[c] && wedge[a] != wedge[c])
+			{
+				result[write++] = a;
+				result[write++] = b;
+				result[write++] = c;
+			}
+		}
+		result.resize(write);
+	}
+
+	return (float)std::sqrt(maxError);
+}
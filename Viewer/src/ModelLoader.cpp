@@ -0,0 +1,493 @@
+#include "ModelLoader.h"
+#include <algorithm>
+#include <iostream>
+#include "AssetCache.h"
+#include "Scene.h"
+#include "ThreadPool.h"
+#include "Utils.h"
+
+namespace
+{
+	void PrintQuantizationError(const MeshModel& model, const std::string& modelName, const Vertex* vertexData, size_t count)
+	{
+		QuantizationError error = model.MeasureQuantizationError(vertexData, count);
+		// Worst case on screen when the whole model spans a 1080 pixel view
+		float pixels = error.boundsDiagonal > 0.0f ? error.maxPosition / error.boundsDiagonal * 1080.0f : 0.0f;
+		std::cout << "Quantized " << modelName << ": " << sizeof(Vertex) << " -> " << sizeof(QuantizedVertex) << " bytes per vertex, max error: position "
+			<< error.maxPosition << " (" << pixels << " px at 1080p), normal " << error.maxNormalDegrees << " deg, texture coords " << error.maxTextureCoords << std::endl;
+	}
+
+	// UploadStep reads the model's own CPU data, 16 bit indices are converted once up front
+	void SetUploadSource(ModelLoader::LoadJob& job, MeshModel& model)
+	{
+		const std::vector<GLuint>& indices = model.GetModelIndices();
+		job.vertexSource = model.GetModelVertices().data();
+		job.vertexCount = model.GetModelVertices().size();
+		job.indexCount = indices.size();
+		job.indexType = MeshModel::ChooseIndexType(job.vertexCount);
+		job.indexSource = indices.data();
+		if (job.indexType == GL_UNSIGNED_SHORT)
+		{
+			job.shortIndices.assign(indices.begin(), indices.end());
+			job.indexSource = job.shortIndices.data();
+		}
+		job.tangentSource = model.GetGeometry().modelTangents.empty() ? nullptr : model.GetGeometry().modelTangents.data();
+	}
+}
+
+ModelLoader::ModelLoader() :
+	streaming(true),
+	quantizeVertices(false),
+	positionStreams(false),
+	residency(MeshResidency::Full)
+{
+}
+
+ModelLoader::~ModelLoader()
+{
+	// Workers only hold their own job, so they can finish after we are gone
+	for (const std::shared_ptr<LoadJob>& job : jobs)
+	{
+		job->progress.cancelled = true;
+	}
+}
+
+void ModelLoader::Load(const std::string& filePath)
+{
+	auto job = std::make_shared<LoadJob>();
+	job->filePath = filePath;
+	job->modelName = Utils::GetFileName(filePath);
+	job->streaming = streaming;
+	job->quantize = quantizeVertices;
+	job->positionStream = positionStreams;
+	job->options = meshOptions;
+	job->residency = residency;
+	job->startTime = std::chrono::steady_clock::now();
+	jobs.push_back(job);
+
+	// Already loaded: the next Update adds an instance, there is nothing to read or upload
+	job->model = AssetCache::Instance().CreateInstance(filePath);
+	if (job->model)
+	{
+		job->instance = true;
+		job->state = LoadState::Uploading;
+		return;
+	}
+	ThreadPool::Instance().Enqueue([job]() { ReadJob(job); });
+}
+
+bool ModelLoader::Reload(const std::shared_ptr<MeshModel>& model)
+{
+	const std::string& filePath = model->GetGeometry().sourcePath;
+	if (filePath.empty())
+	{
+		return false;
+	}
+
+	// Keeps the layout and residency of the model, and skips the asset cache, which would hand back the old geometry
+	auto job = std::make_shared<LoadJob>();
+	job->filePath = filePath;
+	job->modelName = Utils::GetFileName(filePath);
+	job->quantize = model->GetVertexFormat() == VertexFormat::Quantized;
+	job->positionStream = model->HasPositionStream();
+	job->options = meshOptions;
+	job->residency = model->GetResidency();
+	job->target = model;
+	job->startTime = std::chrono::steady_clock::now();
+	jobs.push_back(job);
+	ThreadPool::Instance().Enqueue([job]() { ReadJob(job); });
+	return true;
+}
+
+void ModelLoader::Cancel(size_t jobIndex)
+{
+	LoadJob& job = *jobs[jobIndex];
+	std::lock_guard<std::mutex> lock(job.batchMutex);
+	job.progress.cancelled = true;
+
+	// A running worker notices the flag itself, anything it already finished is dropped on the next Update
+	if (job.state == LoadState::Uploading || (job.state == LoadState::Streaming && job.builtModel))
+	{
+		job.state = LoadState::Cancelled;
+	}
+}
+
+void ModelLoader::ReadJob(const std::shared_ptr<LoadJob>& job)
+{
+	if (Utils::GetFileExtension(job->filePath) == "glb")
+	{
+		// Nothing to build, the buffer views go to the GPU as they are
+		auto gltf = std::make_shared<GltfScene>();
+		bool read = GltfLoader::Read(job->filePath, *gltf, &job->progress);
+		if (!read && !job->progress.cancelled)
+		{
+			std::cerr << "Error opening model '" << job->filePath << "'" << std::endl;
+			job->state = LoadState::Failed;
+			return;
+		}
+
+		// Published under the lock so a cancel either sees Uploading or we see the cancel
+		std::lock_guard<std::mutex> lock(job->batchMutex);
+		if (job->progress.cancelled)
+		{
+			job->state = LoadState::Cancelled;
+			return;
+		}
+		job->gltf = gltf;
+		job->state = LoadState::Uploading;
+		return;
+	}
+
+	MeshBatchCallback onBatch;
+	if (job->streaming)
+	{
+		onBatch = [job](const MeshBatch& batch)
+		{
+			StreamBatch copy;
+			copy.vertices.assign(batch.vertices, batch.vertices + batch.vertexCount);
+			copy.indices.assign(batch.indices, batch.indices + batch.indexCount);
+
+			std::lock_guard<std::mutex> lock(job->batchMutex);
+			job->batches.push_back(std::move(copy));
+			if (job->state != LoadState::Streaming)
+			{
+				job->streamIndexCount = batch.totalIndexCount;
+				job->streamVertexEstimate = batch.vertexEstimate;
+				job->streamBoundsMin = batch.boundsMin;
+				job->streamBoundsMax = batch.boundsMax;
+				job->state = LoadState::Streaming;
+			}
+		};
+	}
+
+	std::shared_ptr<MeshModel> model = Utils::ReadMeshModel(job->filePath, job->cache, &job->progress, onBatch, job->options);
+	if (job->state == LoadState::Streaming)
+	{
+		if (model && job->quantize)
+		{
+			model->SetVertexFormat(VertexFormat::Quantized, job->streamBoundsMin, job->streamBoundsMax);
+			PrintQuantizationError(*model, job->modelName, model->GetModelVertices().data(), model->GetModelVertices().size());
+		}
+
+		// Checked under the lock so a cancel either sees the finished model or we see the cancel
+		std::lock_guard<std::mutex> lock(job->batchMutex);
+		if (job->progress.cancelled || !model)
+		{
+			job->state = LoadState::Cancelled;
+		}
+		else
+		{
+			job->builtModel = model;
+		}
+		return;
+	}
+	if (!model)
+	{
+		job->state = job->progress.cancelled ? LoadState::Cancelled : LoadState::Failed;
+		return;
+	}
+
+	if (job->cache.GetVertices() != nullptr)
+	{
+		job->vertexSource = job->cache.GetVertices();
+		job->indexSource = job->cache.GetIndices();
+		job->vertexCount = job->cache.GetVertexCount();
+		job->indexCount = job->cache.GetIndexCount();
+		job->indexType = job->cache.GetIndexType();
+		job->tangentSource = job->cache.GetTangents();
+	}
+	else
+	{
+		SetUploadSource(*job, *model);
+	}
+	if (job->quantize)
+	{
+		model->SetVertexFormat(VertexFormat::Quantized, model->GetBoundsMin(), model->GetBoundsMax());
+		PrintQuantizationError(*model, job->modelName, job->vertexSource, job->vertexCount);
+	}
+
+	std::lock_guard<std::mutex> lock(job->batchMutex);
+	if (job->progress.cancelled)
+	{
+		job->state = LoadState::Cancelled;
+		return;
+	}
+	job->model = model;
+	job->state = LoadState::Uploading;
+}
+
+bool ModelLoader::UploadStep(LoadJob& job, MeshModel& model, size_t& budget)
+{
+	if (!model.IsUploaded())
+	{
+		model.CreateBuffers(job.vertexCount, job.indexCount, job.indexType);
+	}
+
+	if (job.verticesUploaded < job.vertexCount && budget > 0)
+	{
+		size_t count = std::min(job.vertexCount - job.verticesUploaded, std::max<size_t>(budget / model.GetVertexSize(), 1));
+		model.UploadVertices(job.verticesUploaded, count, job.vertexSource + job.verticesUploaded);
+		job.verticesUploaded += count;
+		budget -= std::min(budget, count * model.GetVertexSize());
+	}
+
+	size_t indexSize = model.GetIndexSize();
+	if (job.verticesUploaded == job.vertexCount && job.indicesUploaded < job.indexCount && budget > 0)
+	{
+		size_t count = std::min(job.indexCount - job.indicesUploaded, std::max<size_t>(budget / indexSize, 1));
+		model.UploadIndices(job.indicesUploaded, count, static_cast<const char*>(job.indexSource) + job.indicesUploaded * indexSize);
+		job.indicesUploaded += count;
+		budget -= std::min(budget, count * indexSize);
+	}
+
+	bool finished = job.verticesUploaded == job.vertexCount && job.indicesUploaded == job.indexCount;
+	if (finished && job.tangentSource != nullptr)
+	{
+		// The extra stream goes up in one piece once the rest is there, it is not drawn without the normal map
+		model.UploadTangents(job.tangentSource, job.vertexCount);
+		job.tangentSource = nullptr;
+	}
+	return finished;
+}
+
+bool ModelLoader::GltfStep(LoadJob& job, size_t& budget)
+{
+	if (!GltfLoader::Upload(*job.gltf, job.modelName, job.gltfUpload, budget))
+	{
+		return false;
+	}
+	job.gltfModels = std::move(job.gltfUpload.models);
+	job.model = job.gltfModels.front();
+	// The mapping is only read by the upload
+	job.gltf.reset();
+	job.gltfUpload = GltfUpload();
+	return true;
+}
+
+bool ModelLoader::StreamStep(LoadJob& job, Scene& scene, size_t& budget)
+{
+	std::unique_lock<std::mutex> lock(job.batchMutex);
+	if (!job.model)
+	{
+		// The index count is exact, the vertex count is only known at the end, so its
+		// buffer starts at the position count and grows. The index type has to cover every corner.
+		job.model = std::make_shared<MeshModel>(job.modelName);
+		job.model->SetBounds(job.streamBoundsMin, job.streamBoundsMax);
+		if (job.quantize)
+		{
+			job.model->SetVertexFormat(VertexFormat::Quantized, job.streamBoundsMin, job.streamBoundsMax);
+		}
+		job.model->CreateBuffers(0, job.streamIndexCount, MeshModel::ChooseIndexType(job.streamIndexCount));
+		job.model->ReserveVertices(job.streamVertexEstimate);
+		scene.AddModel(job.model);
+		job.inScene = true;
+	}
+
+	while (!job.batches.empty() && budget > 0)
+	{
+		StreamBatch batch = std::move(job.batches.front());
+		job.batches.pop_front();
+		lock.unlock();
+
+		job.model->AppendVertices(batch.vertices.data(), batch.vertices.size());
+		job.model->AppendIndices(batch.indices.data(), batch.indices.size());
+		size_t bytes = batch.vertices.size() * job.model->GetVertexSize() + batch.indices.size() * job.model->GetIndexSize();
+		budget -= std::min(budget, bytes);
+
+		lock.lock();
+	}
+
+	if (!job.batches.empty() || !job.builtModel)
+	{
+		return false;
+	}
+
+	MeshGeometry& geometry = job.model->GetGeometry();
+	MeshGeometry& built = job.builtModel->GetGeometry();
+	if (!job.options.optimize && built.lods.empty() && !built.generatedNormals && built.modelTangents.empty())
+	{
+		// Everything is on the GPU, keep the CPU copy the way a regular load does
+		geometry.modelVertices = std::move(built.modelVertices);
+		geometry.modelIndices = std::move(built.modelIndices);
+		geometry.cacheSource = built.cacheSource;
+		geometry.sourcePath = built.sourcePath;
+		job.builtModel.reset();
+		// A projection picked while the batches arrived covers the whole model now
+		job.model->SetUvProjection(geometry.uvProjection);
+		return true;
+	}
+
+	// Batches went up in file order without generated normals. The final data goes into buffers of its
+	// own under the same budget, the streamed ones are drawn until it is all there.
+	lock.unlock();
+	if (job.vertexSource == nullptr)
+	{
+		SetUploadSource(job, *job.builtModel);
+	}
+	if (!UploadStep(job, *job.builtModel, budget))
+	{
+		return false;
+	}
+	UvProjection uvProjection = geometry.uvProjection;
+	job.model->AdoptGeometry(*job.builtModel);
+	job.builtModel.reset();
+	job.model->SetUvProjection(uvProjection);
+	return true;
+}
+
+void ModelLoader::ReportTimes(LoadJob& job)
+{
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - job.startTime;
+	double fullTime = elapsed.count() * 1000.0;
+	if (job.firstPixelTime < 0.0)
+	{
+		job.firstPixelTime = fullTime;
+	}
+	std::cout << (job.instance ? "Instanced " : job.streaming ? "Streamed " : "Loaded ") << job.modelName << ": first pixel after " << job.firstPixelTime
+		<< " ms, full model after " << fullTime << " ms" << std::endl;
+}
+
+void ModelLoader::Update(Scene& scene)
+{
+	size_t budget = UploadBytesPerFrame;
+	for (const std::shared_ptr<LoadJob>& job : jobs)
+	{
+		LoadState state = job->state;
+		if ((state != LoadState::Uploading && state != LoadState::Streaming) || budget == 0 || job->progress.cancelled)
+		{
+			continue;
+		}
+
+		bool finished = false;
+		if (state == LoadState::Streaming)
+		{
+			finished = StreamStep(*job, scene, budget);
+		}
+		else if (job->gltf)
+		{
+			finished = GltfStep(*job, budget);
+		}
+		else
+		{
+			finished = UploadStep(*job, *job->model, budget);
+			if (job->streaming && !job->inScene)
+			{
+				scene.AddModel(job->model);
+				job->inScene = true;
+			}
+		}
+
+		// This frame is the first to draw part of the model
+		if (job->firstPixelTime < 0.0 && job->inScene && job->model->GetResidentIndexCount() > 0)
+		{
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - job->startTime;
+			job->firstPixelTime = elapsed.count() * 1000.0;
+		}
+
+		if (finished)
+		{
+			std::vector<std::shared_ptr<MeshModel>> models = job->gltfModels;
+			if (models.empty())
+			{
+				models.push_back(job->model);
+			}
+			for (const std::shared_ptr<MeshModel>& model : models)
+			{
+				// Before the residency drops the CPU copy the positions come from
+				if (job->positionStream)
+				{
+					model->SetPositionStream(true);
+				}
+				// Instances share the residency of the geometry they draw
+				if (!job->instance)
+				{
+					model->SetResidency(job->residency);
+				}
+				if (job->target)
+				{
+					UvProjection uvProjection = job->target->GetUvProjection();
+					job->target->AdoptGeometry(*model);
+					job->target->SetUvProjection(uvProjection);
+				}
+				else if (!job->inScene)
+				{
+					scene.AddModel(model);
+				}
+			}
+			// A GLB file is several models, the cache holds one per path
+			if (!job->instance && job->gltfModels.empty())
+			{
+				AssetCache::Instance().Add(job->filePath, *job->model);
+			}
+			job->cache.Close();
+			std::vector<GLushort>().swap(job->shortIndices);
+			ReportTimes(*job);
+			job->model.reset();
+			job->gltfModels.clear();
+			job->state = LoadState::Done;
+		}
+	}
+
+	// Cancelled models are released here, on the thread that owns their GL buffers
+	jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [&scene](const std::shared_ptr<LoadJob>& job)
+	{
+		LoadState state = job->state;
+		if (state == LoadState::Cancelled)
+		{
+			if (job->inScene)
+			{
+				scene.RemoveModel(job->model);
+			}
+			job->model.reset();
+		}
+		return state == LoadState::Done || state == LoadState::Cancelled || state == LoadState::Failed;
+	}), jobs.end());
+}
+
+size_t ModelLoader::GetJobCount() const
+{
+	return jobs.size();
+}
+
+const ModelLoader::LoadJob& ModelLoader::GetJob(size_t jobIndex) const
+{
+	return *jobs[jobIndex];
+}
+
+float ModelLoader::GetProgress(const LoadJob& job)
+{
+	if (job.state == LoadState::Reading)
+	{
+		return job.progress.GetFraction();
+	}
+	if (job.state == LoadState::Streaming)
+	{
+		size_t total = job.streamIndexCount;
+		return total > 0 && job.model ? (float)job.model->GetResidentIndexCount() / (float)total : 0.0f;
+	}
+	size_t total = job.vertexCount + job.indexCount;
+	return total > 0 ? (float)(job.verticesUploaded + job.indicesUploaded) / (float)total : 1.0f;
+}
+
+const char* ModelLoader::GetStateName(const LoadJob& job)
+{
+	if (job.progress.cancelled)
+	{
+		return "Cancelling";
+	}
+	switch (job.state)
+	{
+	case LoadState::Reading:
+		return job.progress.GetFraction() < 1.0f ? "Parsing" : "Building";
+	case LoadState::Streaming:
+		return "Streaming";
+	case LoadState::Uploading:
+		return "Uploading";
+	case LoadState::Done:
+		return "Done";
+	case LoadState::Cancelled:
+		return "Cancelled";
+	default:
+		return "Failed";
+	}
+}
@@ -0,0 +1,300 @@
+#include "NormalGenerator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <glm/gtc/constants.hpp>
+#include "ThreadPool.h"
+
+namespace
+{
+	const size_t ItemsPerTask = 1 << 16;
+	const GLuint NoVertex = 0xFFFFFFFFu;
+
+	// task(begin, end) over [0, count) in pieces large enough to be worth a pool job
+	template <typename Task>
+	void ParallelRanges(size_t count, const Task& task)
+	{
+		size_t taskCount = (count + ItemsPerTask - 1) / ItemsPerTask;
+		ThreadPool::Instance().ParallelFor(taskCount, [&](size_t i)
+		{
+			task(i * ItemsPerTask, std::min(count, (i + 1) * ItemsPerTask));
+		});
+	}
+
+	// acos to about 1e-4 radians (Abramowitz and Stegun 4.4.45), plenty for a weight and much cheaper
+	float FastAcos(float x)
+	{
+		float a = std::fabs(x);
+		float angle = std::sqrt(1.0f - a) * (1.5707288f + a * (-0.2121144f + a * (0.0742610f - 0.0187293f * a)));
+		return x < 0.0f ? glm::pi<float>() - angle : angle;
+	}
+
+	// Angles at the three corners of a triangle, from its unit edge directions
+	glm::vec3 CornerAngles(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+	{
+		glm::vec3 e0 = p1 - p0;
+		glm::vec3 e1 = p2 - p1;
+		glm::vec3 e2 = p0 - p2;
+		float l0 = glm::length(e0), l1 = glm::length(e1), l2 = glm::length(e2);
+		if (l0 <= 0.0f || l1 <= 0.0f || l2 <= 0.0f)
+		{
+			return glm::vec3(0.0f);
+		}
+		e0 /= l0;
+		e1 /= l1;
+		e2 /= l2;
+		return glm::vec3(FastAcos(glm::clamp(-glm::dot(e2, e0), -1.0f, 1.0f)),
+			FastAcos(glm::clamp(-glm::dot(e0, e1), -1.0f, 1.0f)),
+			FastAcos(glm::clamp(-glm::dot(e1, e2), -1.0f, 1.0f)));
+	}
+
+	bool SameNormal(const glm::vec3& a, const glm::vec3& b)
+	{
+		return glm::dot(a, b) > 0.99999f;
+	}
+
+	// The first cornerCount corners grouped by keyOf(vertex): corners[offsets[k]..offsets[k + 1]) have key k
+	template <typename KeyOf>
+	void BuildCornerLists(const std::vector<GLuint>& indices, size_t cornerCount, size_t keyCount, const KeyOf& keyOf,
+		std::vector<size_t>& offsets, std::vector<GLuint>& corners)
+	{
+		offsets.assign(keyCount + 1, 0);
+		for (size_t c = 0; c < cornerCount; c++)
+		{
+			offsets[keyOf(indices[c]) + 1]++;
+		}
+		for (size_t k = 0; k < keyCount; k++)
+		{
+			offsets[k + 1] += offsets[k];
+		}
+		corners.resize(cornerCount);
+		std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t c = 0; c < cornerCount; c++)
+		{
+			corners[fill[keyOf(indices[c])]++] = (GLuint)c;
+		}
+	}
+
+	// Some unit vector perpendicular to normal
+	glm::vec3 AnyTangent(const glm::vec3& normal)
+	{
+		glm::vec3 axis = std::fabs(normal.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+		glm::vec3 tangent = glm::cross(normal, axis);
+		float length = glm::length(tangent);
+		return length > 0.0f ? tangent / length : axis;
+	}
+}
+
+void NormalGenerator::Generate(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, const std::vector<GLuint>& positionOf, size_t positionCount,
+	float creaseAngle, NormalWeighting weighting)
+{
+	size_t triangleCount = indices.size() / 3;
+	size_t cornerCount = triangleCount * 3;
+
+	// Unit face normals and what every corner contributes
+	std::vector<glm::vec3> faceNormals(triangleCount);
+	std::vector<float> cornerWeights(cornerCount);
+	ParallelRanges(triangleCount, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3]].position;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			faceNormals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+			if (weighting == NormalWeighting::Area)
+			{
+				cornerWeights[t * 3] = cornerWeights[t * 3 + 1] = cornerWeights[t * 3 + 2] = length * 0.5f;
+			}
+			else
+			{
+				glm::vec3 angles = CornerAngles(p0, p1, p2);
+				cornerWeights[t * 3] = angles.x;
+				cornerWeights[t * 3 + 1] = angles.y;
+				cornerWeights[t * 3 + 2] = angles.z;
+			}
+		}
+	});
+
+	// Corners around every position
+	std::vector<size_t> offsets;
+	std::vector<GLuint> corners;
+	BuildCornerLists(indices, cornerCount, positionCount, [&positionOf](GLuint vertex) { return positionOf[vertex]; }, offsets, corners);
+
+	// The faces around a position are grouped in one pass: each joins the first group whose mean normal
+	// is within the crease angle of its own, or starts a new one. Every corner gets the sum of its group.
+	bool smooth = creaseAngle >= 180.0f;
+	float creaseCosine = std::cos(glm::radians(creaseAngle));
+	std::vector<glm::vec3> cornerNormals(cornerCount);
+	ParallelRanges(positionCount, [&](size_t begin, size_t end)
+	{
+		// Per group the sum of its unit face normals, for the test, and of the weighted ones, for the result
+		std::vector<glm::vec3> groupDirections;
+		std::vector<glm::vec3> groupSums;
+		std::vector<size_t> groupOf;
+		for (size_t p = begin; p < end; p++)
+		{
+			const GLuint* first = corners.data() + offsets[p];
+			size_t count = offsets[p + 1] - offsets[p];
+			groupDirections.clear();
+			groupSums.clear();
+			groupOf.resize(count);
+			for (size_t i = 0; i < count; i++)
+			{
+				const glm::vec3& normal = faceNormals[first[i] / 3];
+				size_t group = 0;
+				// A degenerate face has no direction of its own and adds nothing, any group takes it
+				if (!smooth && normal != glm::vec3(0.0f))
+				{
+					while (group < groupDirections.size() && glm::dot(groupDirections[group], normal) < creaseCosine * glm::length(groupDirections[group]))
+					{
+						group++;
+					}
+				}
+				if (group == groupDirections.size())
+				{
+					groupDirections.push_back(glm::vec3(0.0f));
+					groupSums.push_back(glm::vec3(0.0f));
+				}
+				groupDirections[group] += normal;
+				groupSums[group] += normal * cornerWeights[first[i]];
+				groupOf[i] = group;
+			}
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const glm::vec3& normal = groupSums[groupOf[i]];
+				float length = glm::length(normal);
+				cornerNormals[first[i]] = length > 0.0f ? normal / length : faceNormals[first[i] / 3];
+			}
+		}
+	});
+
+	// A vertex keeps the normal of its first corner, corners that disagree get a copy of it
+	size_t vertexCount = vertices.size();
+	std::vector<GLuint> nextCopy(vertexCount, NoVertex);
+	std::vector<char> assigned(vertexCount, 0);
+	for (size_t c = 0; c < cornerCount; c++)
+	{
+		GLuint vertex = indices[c];
+		const glm::vec3& normal = cornerNormals[c];
+		if (!assigned[vertex])
+		{
+			vertices[vertex].normal = normal;
+			assigned[vertex] = 1;
+			continue;
+		}
+		while (!SameNormal(vertices[vertex].normal, normal))
+		{
+			if (nextCopy[vertex] == NoVertex)
+			{
+				Vertex copy = vertices[vertex];
+				copy.normal = normal;
+				nextCopy[vertex] = (GLuint)vertices.size();
+				nextCopy.push_back(NoVertex);
+				vertices.push_back(copy);
+			}
+			vertex = nextCopy[vertex];
+		}
+		indices[c] = vertex;
+	}
+}
+
+void NormalGenerator::GenerateTangents(std::vector<Vertex>& vertices, std::vector<GLuint>& indices, size_t baseIndexCount, std::vector<glm::vec4>& tangents)
+{
+	size_t triangleCount = indices.size() / 3;
+	size_t vertexCount = vertices.size();
+
+	// Direction of increasing u on every face and whether its texture is mirrored
+	std::vector<glm::vec3> faceTangents(triangleCount);
+	std::vector<glm::vec3> faceAngles(triangleCount);
+	std::vector<uint8_t> faceMirrored(triangleCount);
+	ParallelRanges(triangleCount, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			const Vertex& v0 = vertices[indices[t * 3]];
+			const Vertex& v1 = vertices[indices[t * 3 + 1]];
+			const Vertex& v2 = vertices[indices[t * 3 + 2]];
+			glm::vec3 e1 = v1.position - v0.position;
+			glm::vec3 e2 = v2.position - v0.position;
+			glm::vec2 d1 = v1.textureCoords - v0.textureCoords;
+			glm::vec2 d2 = v2.textureCoords - v0.textureCoords;
+			float area = d1.x * d2.y - d2.x * d1.y;
+			faceTangents[t] = area != 0.0f ? (e1 * d2.y - e2 * d1.y) / area : glm::vec3(0.0f);
+			faceAngles[t] = CornerAngles(v0.position, v1.position, v2.position);
+			faceMirrored[t] = area < 0.0f;
+		}
+	});
+
+	// Every vertex gathers its faces of the full mesh, each projected into the plane of the vertex
+	// normal and weighted by its angle there. Mirrored and regular faces are summed apart.
+	std::vector<size_t> offsets;
+	std::vector<GLuint> corners;
+	BuildCornerLists(indices, std::min(baseIndexCount, indices.size()), vertexCount, [](GLuint vertex) { return vertex; }, offsets, corners);
+	std::vector<glm::vec3> regular(vertexCount);
+	std::vector<glm::vec3> mirrored(vertexCount);
+	ParallelRanges(vertexCount, [&](size_t begin, size_t end)
+	{
+		for (size_t v = begin; v < end; v++)
+		{
+			const glm::vec3& normal = vertices[v].normal;
+			glm::vec3 sums[2] = { glm::vec3(0.0f), glm::vec3(0.0f) };
+			for (size_t k = offsets[v]; k < offsets[v + 1]; k++)
+			{
+				GLuint corner = corners[k];
+				size_t t = corner / 3;
+				glm::vec3 tangent = faceTangents[t] - normal * glm::dot(normal, faceTangents[t]);
+				float length = glm::length(tangent);
+				if (length <= 0.0f)
+				{
+					continue;
+				}
+				sums[faceMirrored[t]] += tangent / length * faceAngles[t][corner % 3];
+			}
+			regular[v] = sums[0];
+			mirrored[v] = sums[1];
+		}
+	});
+
+	// A vertex on a mirror seam gets a copy for its mirrored faces, the w component carries the handedness
+	tangents.resize(vertexCount);
+	std::vector<GLuint> mirroredCopy(vertexCount, NoVertex);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		bool hasRegular = glm::length(regular[v]) > 0.0f;
+		bool hasMirrored = glm::length(mirrored[v]) > 0.0f;
+		glm::vec3 normal = vertices[v].normal;
+		if (hasRegular && hasMirrored)
+		{
+			mirroredCopy[v] = (GLuint)vertices.size();
+			vertices.push_back(vertices[v]);
+			tangents.push_back(glm::vec4(glm::normalize(mirrored[v]), -1.0f));
+		}
+		if (hasRegular)
+		{
+			tangents[v] = glm::vec4(glm::normalize(regular[v]), 1.0f);
+		}
+		else if (hasMirrored)
+		{
+			tangents[v] = glm::vec4(glm::normalize(mirrored[v]), -1.0f);
+		}
+		else
+		{
+			tangents[v] = glm::vec4(AnyTangent(normal), 1.0f);
+		}
+	}
+	ParallelRanges(triangleCount, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			for (size_t c = t * 3; c < t * 3 + 3 && faceMirrored[t]; c++)
+			{
+				GLuint copy = mirroredCopy[indices[c]];
+				indices[c] = copy != NoVertex ? copy : indices[c];
+			}
+		}
+	});
+}
@@ -0,0 +1,401 @@
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+namespace
+{
+	inline bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline const char* SkipBlanks(const char* p, const char* end)
+	{
+		while (p < end && IsBlank(*p))
+		{
+			p++;
+		}
+		return p;
+	}
+
+	inline const char* SkipToken(const char* p, const char* end)
+	{
+		while (p < end && !IsBlank(*p))
+		{
+			p++;
+		}
+		return p;
+	}
+
+	inline const char* FindLineEnd(const char* p, const char* end)
+	{
+		if (p >= end)
+		{
+			return end;
+		}
+		const char* newLine = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		return newLine != nullptr ? newLine : end;
+	}
+
+	inline const char* ParseFloat(const char* p, const char* end, float& value)
+	{
+		p = SkipBlanks(p, end);
+		if (p < end && *p == '+')
+		{
+			p++;
+		}
+
+		std::from_chars_result result = std::from_chars(p, end, value);
+		if (result.ec != std::errc())
+		{
+			value = 0.0f;
+		}
+		return result.ptr;
+	}
+
+	inline const char* ParseInt(const char* p, const char* end, int& value)
+	{
+		if (p < end && *p == '+')
+		{
+			p++;
+		}
+
+		std::from_chars_result result = std::from_chars(p, end, value);
+		if (result.ec != std::errc())
+		{
+			value = 0;
+		}
+		return result.ptr;
+	}
+
+	// OBJ indices are 1-based, negative ones count back from the last element read so far
+	inline int ResolveIndex(int index, size_t count)
+	{
+		return index < 0 ? static_cast<int>(count) + index + 1 : index;
+	}
+
+	enum class LineType
+	{
+		Vertex,
+		Normal,
+		TextureCoords,
+		Face,
+		Empty,
+		Unknown
+	};
+
+	inline LineType ClassifyLine(const char* p, const char* keyEnd)
+	{
+		size_t keyLength = keyEnd - p;
+		if (keyLength == 1 && p[0] == 'v')
+		{
+			return LineType::Vertex;
+		}
+		if (keyLength == 2 && p[0] == 'v' && p[1] == 'n')
+		{
+			return LineType::Normal;
+		}
+		if (keyLength == 2 && p[0] == 'v' && p[1] == 't')
+		{
+			return LineType::TextureCoords;
+		}
+		if (keyLength == 1 && p[0] == 'f')
+		{
+			return LineType::Face;
+		}
+		if (keyLength == 0 || p[0] == '#')
+		{
+			// comment / empty line
+			return LineType::Empty;
+		}
+		return LineType::Unknown;
+	}
+
+	struct ObjCounts
+	{
+		size_t vertices = 0;
+		size_t normals = 0;
+		size_t textureCoords = 0;
+	};
+
+	// Newline-aligned slice of the file. Vertex data is written straight into the
+	// shared arrays at the chunk's base offsets, faces are merged afterwards.
+	struct ObjChunk
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+		ObjCounts counts;
+		ObjCounts base;
+		FaceTable faces;
+		size_t unknownLines = 0;
+	};
+
+	// Progress is published every ProgressStep bytes, which is also how often a cancel is noticed
+	const size_t ProgressStep = 1 << 20;
+
+	// Adds the bytes up to p to the progress, returns false once the parse was cancelled
+	inline bool ReportProgress(ObjParseProgress* progress, const char*& reported, const char* p)
+	{
+		if (progress == nullptr)
+		{
+			return true;
+		}
+		progress->bytesDone += p - reported;
+		reported = p;
+		return !progress->cancelled;
+	}
+
+	// Polygons with more than three corners are split into a triangle fan around the first corner
+	void ParseFace(const char* p, const char* end, const ObjCounts& counts, FaceTable& faces)
+	{
+		int vertexIndices[3] = { 0, 0, 0 };
+		int textureIndices[3] = { 0, 0, 0 };
+		int normalIndices[3] = { 0, 0, 0 };
+		int corner = 0;
+
+		while (true)
+		{
+			p = SkipBlanks(p, end);
+			if (p >= end)
+			{
+				break;
+			}
+
+			// v, v/t, v//n or v/t/n
+			int vertexIndex = 0, textureIndex = 0, normalIndex = 0;
+			p = ParseInt(p, end, vertexIndex);
+			if (p < end && *p == '/')
+			{
+				p++;
+				if (p < end && *p != '/')
+				{
+					p = ParseInt(p, end, textureIndex);
+				}
+				if (p < end && *p == '/')
+				{
+					p = ParseInt(p + 1, end, normalIndex);
+				}
+			}
+			p = SkipToken(p, end);
+
+			// Slot 1 keeps the previous corner, slot 2 takes the new one
+			int slot = corner < 3 ? corner : 2;
+			if (corner >= 3)
+			{
+				vertexIndices[1] = vertexIndices[2];
+				textureIndices[1] = textureIndices[2];
+				normalIndices[1] = normalIndices[2];
+			}
+			vertexIndices[slot] = ResolveIndex(vertexIndex, counts.vertices);
+			textureIndices[slot] = ResolveIndex(textureIndex, counts.textureCoords);
+			normalIndices[slot] = ResolveIndex(normalIndex, counts.normals);
+			corner++;
+
+			if (corner >= 3)
+			{
+				faces.AddTriangle(vertexIndices, textureIndices, normalIndices);
+			}
+		}
+	}
+
+	void CountChunk(ObjChunk& chunk, ObjParseProgress* progress)
+	{
+		const char* reported = chunk.begin;
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			if ((size_t)(p - reported) >= ProgressStep && !ReportProgress(progress, reported, p))
+			{
+				return;
+			}
+
+			p = SkipBlanks(p, chunk.end);
+			const char* lineEnd = FindLineEnd(p, chunk.end);
+			switch (ClassifyLine(p, SkipToken(p, lineEnd)))
+			{
+			case LineType::Vertex:
+				chunk.counts.vertices++;
+				break;
+			case LineType::Normal:
+				chunk.counts.normals++;
+				break;
+			case LineType::TextureCoords:
+				chunk.counts.textureCoords++;
+				break;
+			default:
+				break;
+			}
+			p = lineEnd < chunk.end ? lineEnd + 1 : chunk.end;
+		}
+		ReportProgress(progress, reported, p);
+	}
+
+	void ParseChunk(ObjChunk& chunk, ObjData& data, ObjParseProgress* progress)
+	{
+		// Running global counts, used to resolve relative face indices
+		ObjCounts counts = chunk.base;
+
+		const char* reported = chunk.begin;
+		const char* p = chunk.begin;
+		while (p < chunk.end)
+		{
+			if ((size_t)(p - reported) >= ProgressStep && !ReportProgress(progress, reported, p))
+			{
+				return;
+			}
+
+			p = SkipBlanks(p, chunk.end);
+			const char* lineEnd = FindLineEnd(p, chunk.end);
+			const char* keyEnd = SkipToken(p, lineEnd);
+
+			// based on the type parse data
+			switch (ClassifyLine(p, keyEnd))
+			{
+			case LineType::Vertex:
+			{
+				glm::vec3& vertex = data.vertices[counts.vertices++];
+				const char* q = ParseFloat(keyEnd, lineEnd, vertex.x);
+				q = ParseFloat(q, lineEnd, vertex.y);
+				ParseFloat(q, lineEnd, vertex.z);
+				break;
+			}
+			case LineType::Normal:
+			{
+				glm::vec3& normal = data.normals[counts.normals++];
+				const char* q = ParseFloat(keyEnd, lineEnd, normal.x);
+				q = ParseFloat(q, lineEnd, normal.y);
+				ParseFloat(q, lineEnd, normal.z);
+				break;
+			}
+			case LineType::TextureCoords:
+			{
+				glm::vec2& textureCoords = data.textureCoords[counts.textureCoords++];
+				const char* q = ParseFloat(keyEnd, lineEnd, textureCoords.x);
+				ParseFloat(q, lineEnd, textureCoords.y);
+				break;
+			}
+			case LineType::Face:
+				ParseFace(keyEnd, lineEnd, counts, chunk.faces);
+				break;
+			case LineType::Empty:
+				break;
+			case LineType::Unknown:
+				chunk.unknownLines++;
+				break;
+			}
+
+			p = lineEnd < chunk.end ? lineEnd + 1 : chunk.end;
+		}
+		ReportProgress(progress, reported, p);
+	}
+}
+
+bool ObjParser::ParseFile(const std::string& filePath, ObjData& data, size_t* fileSize, ObjParseProgress* progress)
+{
+	MappedFile file;
+	if (!file.Open(filePath))
+	{
+		return false;
+	}
+
+	if (fileSize != nullptr)
+	{
+		*fileSize = file.GetSize();
+	}
+	return Parse(file.GetData(), file.GetData() + file.GetSize(), data, GetDefaultChunkCount(file.GetSize()), progress);
+}
+
+size_t ObjParser::GetDefaultChunkCount(size_t byteCount)
+{
+	// Below this a chunk is not worth the hand-off to another thread
+	const size_t minChunkBytes = 256 * 1024;
+	size_t threads = ThreadPool::Instance().GetThreadCount();
+	return std::max<size_t>(1, std::min(threads, byteCount / minChunkBytes));
+}
+
+bool ObjParser::Parse(const char* begin, const char* end, ObjData& data, size_t chunkCount, ObjParseProgress* progress)
+{
+	data = ObjData();
+	if (progress != nullptr)
+	{
+		// Both passes read every byte once
+		progress->bytesDone = 0;
+		progress->bytesTotal = 2 * (end - begin);
+	}
+
+	// Split at line starts so no line is shared by two chunks
+	std::vector<ObjChunk> chunks(std::max<size_t>(chunkCount, 1));
+	size_t byteCount = end - begin;
+	const char* chunkBegin = begin;
+	for (size_t i = 0; i < chunks.size(); i++)
+	{
+		const char* chunkEnd = end;
+		if (i + 1 < chunks.size())
+		{
+			chunkEnd = std::max(chunkBegin, begin + byteCount * (i + 1) / chunks.size());
+			chunkEnd = FindLineEnd(chunkEnd, end);
+			chunkEnd = chunkEnd < end ? chunkEnd + 1 : end;
+		}
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	ThreadPool& pool = ThreadPool::Instance();
+	pool.ParallelFor(chunks.size(), [&chunks, progress](size_t i) { CountChunk(chunks[i], progress); });
+	if (progress != nullptr && progress->cancelled)
+	{
+		return false;
+	}
+
+	// Each chunk gets the global element counts of the chunks before it
+	ObjCounts total;
+	for (ObjChunk& chunk : chunks)
+	{
+		chunk.base = total;
+		total.vertices += chunk.counts.vertices;
+		total.normals += chunk.counts.normals;
+		total.textureCoords += chunk.counts.textureCoords;
+	}
+	data.vertices.resize(total.vertices);
+	data.normals.resize(total.normals);
+	data.textureCoords.resize(total.textureCoords);
+
+	pool.ParallelFor(chunks.size(), [&chunks, &data, progress](size_t i) { ParseChunk(chunks[i], data, progress); });
+	if (progress != nullptr && progress->cancelled)
+	{
+		data = ObjData();
+		return false;
+	}
+
+	for (const ObjChunk& chunk : chunks)
+	{
+		data.unknownLines += chunk.unknownLines;
+	}
+	if (chunks.size() == 1)
+	{
+		data.faces = std::move(chunks[0].faces);
+		return true;
+	}
+
+	// Sized once up front, each chunk is freed as soon as it was copied over
+	size_t faceCount = 0;
+	bool textureIndices = false;
+	bool normalIndices = false;
+	for (const ObjChunk& chunk : chunks)
+	{
+		faceCount += chunk.faces.GetFacesCount();
+		textureIndices = textureIndices || chunk.faces.HasTextureIndices();
+		normalIndices = normalIndices || chunk.faces.HasNormalIndices();
+	}
+	data.faces.Reserve(faceCount, textureIndices, normalIndices);
+	for (ObjChunk& chunk : chunks)
+	{
+		data.faces.Append(chunk.faces);
+		chunk.faces.Clear();
+	}
+	return true;
+}
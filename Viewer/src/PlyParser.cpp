@@ -0,0 +1,557 @@
+#include "PlyParser.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	const size_t ItemsPerTask = 1 << 16;
+
+	enum class PlyType
+	{
+		Int8,
+		UInt8,
+		Int16,
+		UInt16,
+		Int32,
+		UInt32,
+		Float32,
+		Float64,
+		Invalid
+	};
+
+	struct PlyProperty
+	{
+		std::string name;
+		PlyType type = PlyType::Invalid;
+		// Lists start with their item count in countType, type is then the item type
+		bool isList = false;
+		PlyType countType = PlyType::Invalid;
+		size_t offset = 0;
+	};
+
+	struct PlyElement
+	{
+		std::string name;
+		size_t count = 0;
+		std::vector<PlyProperty> properties;
+		// Bytes per item, 0 when the element has lists and every item has to be walked
+		size_t stride = 0;
+	};
+
+	PlyType ParseType(const std::string& name)
+	{
+		if (name == "char" || name == "int8") return PlyType::Int8;
+		if (name == "uchar" || name == "uint8") return PlyType::UInt8;
+		if (name == "short" || name == "int16") return PlyType::Int16;
+		if (name == "ushort" || name == "uint16") return PlyType::UInt16;
+		if (name == "int" || name == "int32") return PlyType::Int32;
+		if (name == "uint" || name == "uint32") return PlyType::UInt32;
+		if (name == "float" || name == "float32") return PlyType::Float32;
+		if (name == "double" || name == "float64") return PlyType::Float64;
+		return PlyType::Invalid;
+	}
+
+	size_t GetTypeSize(PlyType type)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: case PlyType::UInt8: return 1;
+		case PlyType::Int16: case PlyType::UInt16: return 2;
+		case PlyType::Int32: case PlyType::UInt32: case PlyType::Float32: return 4;
+		case PlyType::Float64: return 8;
+		default: return 0;
+		}
+	}
+
+	template <typename T>
+	inline T Load(const char* p, bool swap)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof(T));
+		if (swap)
+		{
+			char* bytes = reinterpret_cast<char*>(&value);
+			std::reverse(bytes, bytes + sizeof(T));
+		}
+		return value;
+	}
+
+	inline double ReadNumber(const char* p, PlyType type, bool swap)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: return (double)Load<int8_t>(p, swap);
+		case PlyType::UInt8: return (double)Load<uint8_t>(p, swap);
+		case PlyType::Int16: return (double)Load<int16_t>(p, swap);
+		case PlyType::UInt16: return (double)Load<uint16_t>(p, swap);
+		case PlyType::Int32: return (double)Load<int32_t>(p, swap);
+		case PlyType::UInt32: return (double)Load<uint32_t>(p, swap);
+		case PlyType::Float32: return (double)Load<float>(p, swap);
+		case PlyType::Float64: return Load<double>(p, swap);
+		default: return 0.0;
+		}
+	}
+
+	inline int64_t ReadInteger(const char* p, PlyType type, bool swap)
+	{
+		switch (type)
+		{
+		case PlyType::Int8: return Load<int8_t>(p, swap);
+		case PlyType::UInt8: return Load<uint8_t>(p, swap);
+		case PlyType::Int16: return Load<int16_t>(p, swap);
+		case PlyType::UInt16: return Load<uint16_t>(p, swap);
+		case PlyType::Int32: return Load<int32_t>(p, swap);
+		case PlyType::UInt32: return Load<uint32_t>(p, swap);
+		default: return (int64_t)ReadNumber(p, type, swap);
+		}
+	}
+
+	bool IsLittleEndianHost()
+	{
+		uint16_t one = 1;
+		char first;
+		std::memcpy(&first, &one, 1);
+		return first == 1;
+	}
+
+	const PlyProperty* FindProperty(const PlyElement& element, std::initializer_list<const char*> names)
+	{
+		for (const char* name : names)
+		{
+			for (const PlyProperty& property : element.properties)
+			{
+				if (property.name == name)
+				{
+					return &property;
+				}
+			}
+		}
+		return nullptr;
+	}
+
+	// Size of the item at p, walking its lists. 0 when it runs past end.
+	size_t GetItemSize(const PlyElement& element, const char* p, const char* end, bool swap)
+	{
+		if (element.stride != 0)
+		{
+			return element.stride;
+		}
+		const char* q = p;
+		for (const PlyProperty& property : element.properties)
+		{
+			if (property.isList)
+			{
+				size_t countSize = GetTypeSize(property.countType);
+				if (q + countSize > end)
+				{
+					return 0;
+				}
+				int64_t count = ReadInteger(q, property.countType, swap);
+				q += countSize + std::max<int64_t>(count, 0) * GetTypeSize(property.type);
+			}
+			else
+			{
+				q += GetTypeSize(property.type);
+			}
+			if (q > end)
+			{
+				return 0;
+			}
+		}
+		return q - p;
+	}
+
+	bool ParseHeader(const char* begin, const char* end, std::vector<PlyElement>& elements, bool& bigEndian, const char*& body)
+	{
+		const char* marker = "end_header";
+		const char* found = std::search(begin, end, marker, marker + std::strlen(marker));
+		if (end - begin < 3 || std::memcmp(begin, "ply", 3) != 0 || found == end)
+		{
+			std::cerr << "Not a PLY file" << std::endl;
+			return false;
+		}
+		const char* lineEnd = static_cast<const char*>(std::memchr(found, '\n', end - found));
+		if (lineEnd == nullptr)
+		{
+			return false;
+		}
+		body = lineEnd + 1;
+
+		std::istringstream header(std::string(begin, found));
+		std::string line;
+		bool binary = false;
+		while (std::getline(header, line))
+		{
+			std::istringstream words(line);
+			std::string keyword;
+			words >> keyword;
+			if (keyword == "format")
+			{
+				std::string format;
+				words >> format;
+				binary = format == "binary_little_endian" || format == "binary_big_endian";
+				bigEndian = format == "binary_big_endian";
+				if (!binary)
+				{
+					std::cerr << "PLY format '" << format << "' is not supported, only binary" << std::endl;
+					return false;
+				}
+			}
+			else if (keyword == "element")
+			{
+				PlyElement element;
+				words >> element.name >> element.count;
+				elements.push_back(element);
+			}
+			else if (keyword == "property" && !elements.empty())
+			{
+				PlyProperty property;
+				std::string type;
+				words >> type;
+				if (type == "list")
+				{
+					std::string countType, itemType;
+					words >> countType >> itemType;
+					property.isList = true;
+					property.countType = ParseType(countType);
+					property.type = ParseType(itemType);
+				}
+				else
+				{
+					property.type = ParseType(type);
+				}
+				words >> property.name;
+				if (property.type == PlyType::Invalid || (property.isList && property.countType == PlyType::Invalid))
+				{
+					std::cerr << "PLY property '" << property.name << "' has an unknown type" << std::endl;
+					return false;
+				}
+				elements.back().properties.push_back(property);
+			}
+		}
+		if (!binary)
+		{
+			std::cerr << "PLY header has no format line" << std::endl;
+			return false;
+		}
+
+		for (PlyElement& element : elements)
+		{
+			size_t offset = 0;
+			bool fixed = true;
+			for (PlyProperty& property : element.properties)
+			{
+				property.offset = offset;
+				fixed = fixed && !property.isList;
+				offset += GetTypeSize(property.type);
+			}
+			element.stride = fixed ? offset : 0;
+		}
+		return true;
+	}
+
+	// Positions, normals and texture coords of a fixed size vertex element, in parallel
+	bool ReadVertices(const PlyElement& element, const char* p, bool swap, ObjData& data)
+	{
+		const PlyProperty* x = FindProperty(element, { "x" });
+		const PlyProperty* y = FindProperty(element, { "y" });
+		const PlyProperty* z = FindProperty(element, { "z" });
+		const PlyProperty* nx = FindProperty(element, { "nx" });
+		const PlyProperty* ny = FindProperty(element, { "ny" });
+		const PlyProperty* nz = FindProperty(element, { "nz" });
+		const PlyProperty* u = FindProperty(element, { "u", "s", "texture_u", "texture_s" });
+		const PlyProperty* v = FindProperty(element, { "v", "t", "texture_v", "texture_t" });
+		if (x == nullptr || y == nullptr || z == nullptr || element.stride == 0)
+		{
+			std::cerr << "PLY vertices need fixed size x, y and z properties" << std::endl;
+			return false;
+		}
+		bool hasNormals = nx != nullptr && ny != nullptr && nz != nullptr;
+		bool hasTextureCoords = u != nullptr && v != nullptr;
+
+		data.vertices.resize(element.count);
+		data.normals.resize(hasNormals ? element.count : 0);
+		data.textureCoords.resize(hasTextureCoords ? element.count : 0);
+		size_t taskCount = (element.count + ItemsPerTask - 1) / ItemsPerTask;
+		ThreadPool::Instance().ParallelFor(taskCount, [&](size_t task)
+		{
+			size_t last = std::min(element.count, (task + 1) * ItemsPerTask);
+			for (size_t i = task * ItemsPerTask; i < last; i++)
+			{
+				const char* item = p + i * element.stride;
+				data.vertices[i] = glm::vec3(ReadNumber(item + x->offset, x->type, swap), ReadNumber(item + y->offset, y->type, swap), ReadNumber(item + z->offset, z->type, swap));
+				if (hasNormals)
+				{
+					data.normals[i] = glm::vec3(ReadNumber(item + nx->offset, nx->type, swap), ReadNumber(item + ny->offset, ny->type, swap), ReadNumber(item + nz->offset, nz->type, swap));
+				}
+				if (hasTextureCoords)
+				{
+					data.textureCoords[i] = glm::vec2(ReadNumber(item + u->offset, u->type, swap), ReadNumber(item + v->offset, v->type, swap));
+				}
+			}
+		});
+		return true;
+	}
+
+	// Faces that are all triangles have a fixed size, so they can be decoded in parallel.
+	// False when a face turns out not to be a valid triangle, the caller then walks them one by one.
+	bool ReadTriangles(const PlyElement& element, const PlyProperty& indexList, const char* p, size_t triangleStride, bool swap,
+		size_t vertexCount, std::vector<int>& corners)
+	{
+		size_t countSize = GetTypeSize(indexList.countType);
+		size_t indexSize = GetTypeSize(indexList.type);
+		// Offset of the list within an item, the lists before it are triangles too
+		size_t listOffset = 0;
+		for (const PlyProperty& property : element.properties)
+		{
+			if (&property == &indexList)
+			{
+				break;
+			}
+			listOffset += property.isList ? countSize + 3 * GetTypeSize(property.type) : GetTypeSize(property.type);
+		}
+
+		corners.resize(element.count * 3);
+		std::atomic<bool> valid{ true };
+		size_t taskCount = (element.count + ItemsPerTask - 1) / ItemsPerTask;
+		ThreadPool::Instance().ParallelFor(taskCount, [&](size_t task)
+		{
+			size_t last = std::min(element.count, (task + 1) * ItemsPerTask);
+			for (size_t f = task * ItemsPerTask; f < last && valid; f++)
+			{
+				const char* list = p + f * triangleStride + listOffset;
+				if (ReadInteger(list, indexList.countType, swap) != 3)
+				{
+					valid = false;
+					break;
+				}
+				for (int corner = 0; corner < 3; corner++)
+				{
+					int64_t index = ReadInteger(list + countSize + corner * indexSize, indexList.type, swap);
+					if (index < 0 || (size_t)index >= vertexCount)
+					{
+						valid = false;
+					}
+					corners[f * 3 + corner] = (int)index + 1;
+				}
+			}
+		});
+		return valid;
+	}
+
+	// Any polygon sizes, fans around the first corner. Faces with an index out of range are left out.
+	// False when a face runs past end.
+	bool ReadPolygons(const PlyElement& element, const PlyProperty& indexList, const char* p, const char* end, bool swap,
+		size_t vertexCount, std::vector<int>& corners, size_t& skipped)
+	{
+		corners.clear();
+		// Every face takes at least a byte, a count past that is not trusted for the reservation
+		corners.reserve(std::min(element.count, (size_t)(end - p)) * 3);
+		size_t indexSize = GetTypeSize(indexList.type);
+		for (size_t f = 0; f < element.count; f++)
+		{
+			const char* q = p;
+			for (const PlyProperty& property : element.properties)
+			{
+				size_t left = end - q;
+				if (!property.isList)
+				{
+					if (GetTypeSize(property.type) > left)
+					{
+						return false;
+					}
+					q += GetTypeSize(property.type);
+					continue;
+				}
+				size_t countSize = GetTypeSize(property.countType);
+				if (countSize > left)
+				{
+					return false;
+				}
+				int64_t count = std::max<int64_t>(ReadInteger(q, property.countType, swap), 0);
+				if ((uint64_t)count > (left - countSize) / GetTypeSize(property.type))
+				{
+					return false;
+				}
+				const char* items = q + countSize;
+				q = items + count * GetTypeSize(property.type);
+				if (&property != &indexList)
+				{
+					continue;
+				}
+
+				bool inRange = count >= 3;
+				for (int64_t i = 0; i < count && inRange; i++)
+				{
+					int64_t index = ReadInteger(items + i * indexSize, indexList.type, swap);
+					inRange = index >= 0 && (size_t)index < vertexCount;
+				}
+				if (!inRange)
+				{
+					skipped++;
+					continue;
+				}
+				int first = (int)ReadInteger(items, indexList.type, swap) + 1;
+				for (int64_t i = 2; i < count; i++)
+				{
+					corners.push_back(first);
+					corners.push_back((int)ReadInteger(items + (i - 1) * indexSize, indexList.type, swap) + 1);
+					corners.push_back((int)ReadInteger(items + i * indexSize, indexList.type, swap) + 1);
+				}
+			}
+			p = q;
+		}
+		return true;
+	}
+}
+
+bool PlyParser::ParseFile(const std::string& filePath, ObjData& data, size_t* fileSize, ObjParseProgress* progress)
+{
+	MappedFile file;
+	if (!file.Open(filePath))
+	{
+		return false;
+	}
+
+	if (fileSize != nullptr)
+	{
+		*fileSize = file.GetSize();
+	}
+	return Parse(file.GetData(), file.GetData() + file.GetSize(), data, progress);
+}
+
+bool PlyParser::Parse(const char* begin, const char* end, ObjData& data, ObjParseProgress* progress)
+{
+	data = ObjData();
+	if (progress != nullptr)
+	{
+		progress->bytesDone = 0;
+		progress->bytesTotal = end - begin;
+	}
+
+	std::vector<PlyElement> elements;
+	bool bigEndian = false;
+	const char* p = nullptr;
+	if (!ParseHeader(begin, end, elements, bigEndian, p))
+	{
+		return false;
+	}
+	bool swap = bigEndian == IsLittleEndianHost();
+
+	// Fixed size elements after the faces tell where the face data ends without walking it
+	std::vector<int> corners;
+	size_t skipped = 0;
+	for (size_t e = 0; e < elements.size(); e++)
+	{
+		const PlyElement& element = elements[e];
+		if (progress != nullptr)
+		{
+			progress->bytesDone = p - begin;
+			if (progress->cancelled)
+			{
+				data = ObjData();
+				return false;
+			}
+		}
+
+		// Counts come from the header, they are checked against the bytes left before any pointer is formed
+		size_t remaining = end - p;
+		const char* elementEnd = nullptr;
+		if (element.stride != 0)
+		{
+			if (element.count > remaining / element.stride)
+			{
+				std::cerr << "PLY file ends inside element '" << element.name << "'" << std::endl;
+				return false;
+			}
+			elementEnd = p + element.stride * element.count;
+		}
+		else
+		{
+			size_t tail = 0;
+			bool fixedTail = true;
+			for (size_t later = e + 1; later < elements.size() && fixedTail; later++)
+			{
+				const PlyElement& next = elements[later];
+				fixedTail = next.stride != 0 && next.count <= (remaining - tail) / next.stride;
+				if (fixedTail)
+				{
+					tail += next.stride * next.count;
+				}
+			}
+			elementEnd = fixedTail ? end - tail : nullptr;
+		}
+
+		if (element.name == "vertex")
+		{
+			if (!ReadVertices(element, p, swap, data))
+			{
+				return false;
+			}
+		}
+		else if (element.name == "face")
+		{
+			const PlyProperty* indexList = FindProperty(element, { "vertex_indices", "vertex_index" });
+			if (indexList == nullptr || !indexList->isList)
+			{
+				std::cerr << "PLY faces have no vertex_indices list" << std::endl;
+				return false;
+			}
+
+			size_t triangleStride = 0;
+			for (const PlyProperty& property : element.properties)
+			{
+				triangleStride += property.isList ? GetTypeSize(property.countType) + 3 * GetTypeSize(property.type) : GetTypeSize(property.type);
+			}
+			bool triangles = elementEnd != nullptr && element.count <= (size_t)(elementEnd - p) / triangleStride &&
+				(size_t)(elementEnd - p) == triangleStride * element.count &&
+				ReadTriangles(element, *indexList, p, triangleStride, swap, data.vertices.size(), corners);
+			if (!triangles)
+			{
+				if (!ReadPolygons(element, *indexList, p, elementEnd != nullptr ? elementEnd : end, swap, data.vertices.size(), corners, skipped))
+				{
+					std::cerr << "PLY file ends inside element '" << element.name << "'" << std::endl;
+					return false;
+				}
+			}
+		}
+
+		// Other elements (edges, materials...) are skipped
+		if (elementEnd == nullptr)
+		{
+			const char* q = p;
+			for (size_t i = 0; i < element.count; i++)
+			{
+				size_t size = GetItemSize(element, q, end, swap);
+				if (size == 0)
+				{
+					std::cerr << "PLY file ends inside element '" << element.name << "'" << std::endl;
+					return false;
+				}
+				q += size;
+			}
+			elementEnd = q;
+		}
+		p = elementEnd;
+	}
+
+	if (skipped > 0)
+	{
+		std::cerr << "Skipped " << skipped << " PLY faces with fewer than three corners or an index out of range" << std::endl;
+	}
+	std::vector<int> textureIndices = data.textureCoords.empty() ? std::vector<int>() : corners;
+	std::vector<int> normalIndices = data.normals.empty() ? std::vector<int>() : corners;
+	data.faces.Assign(std::move(corners), std::move(textureIndices), std::move(normalIndices));
+	if (progress != nullptr)
+	{
+		progress->bytesDone = end - begin;
+	}
+	return true;
+}
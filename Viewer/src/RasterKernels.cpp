@@ -0,0 +1,646 @@
+#include "RasterKernels.h"
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RASTER_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC compiles any intrinsic without flags, GCC and Clang need the instruction set per function
+// so that the rest of the program still runs on CPUs without it
+#if defined(RASTER_X86) && !defined(_MSC_VER)
+#define RASTER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RASTER_TARGET(isa)
+#endif
+
+namespace
+{
+	// Depth at column x is rowDepth + (x - originX) * depthStepX in every kernel, in this order and without
+	// fused multiply-adds, so that they all round the same way
+	float GetRowDepth(const EdgeSetup& setup, int row)
+	{
+		return setup.depth + (float)row * setup.depthStepY;
+	}
+
+	int64_t FloorDivide(int64_t value, int64_t divisor)
+	{
+		int64_t quotient = value / divisor;
+		return quotient * divisor > value ? quotient - 1 : quotient;
+	}
+
+	size_t RasterizeScalar(const EdgeSetup& setup, float* depthBuffer, int width, RasterBlock* blocks)
+	{
+		size_t count = 0;
+		int firstBlock = setup.minX & ~(RasterBlock::Width - 1);
+		for (int y = setup.minY; y <= setup.maxY; y++)
+		{
+			int row = y - setup.originY;
+			int32_t rowTests[3];
+			for (int i = 0; i < 3; i++)
+			{
+				rowTests[i] = setup.tests[i] + row * setup.stepY[i];
+			}
+			float rowDepth = GetRowDepth(setup, row);
+			float* depthRow = depthBuffer + (size_t)y * width;
+			for (int blockX = firstBlock; blockX <= setup.maxX; blockX += RasterBlock::Width)
+			{
+				unsigned mask = 0;
+				int lastX = std::min(blockX + RasterBlock::Width - 1, setup.maxX);
+				for (int x = std::max(blockX, setup.minX); x <= lastX; x++)
+				{
+					int column = x - setup.originX;
+					if (((rowTests[0] + column * setup.stepX[0]) | (rowTests[1] + column * setup.stepX[1]) | (rowTests[2] + column * setup.stepX[2])) < 0)
+					{
+						continue;
+					}
+					float z = rowDepth + (float)column * setup.depthStepX;
+					if (z < depthRow[x] && z <= 1.0f)
+					{
+						depthRow[x] = z;
+						mask |= 1u << (x - blockX);
+					}
+				}
+				if (mask != 0)
+				{
+					blocks[count++] = { blockX, y, mask };
+				}
+			}
+		}
+		return count;
+	}
+
+#if defined(RASTER_X86)
+	// Depth test of the 4 pixels from x whose lanes are set in covered, returns the ones that passed
+	RASTER_TARGET("sse4.1")
+	unsigned DepthTestSse41(__m128 covered, __m128 z, float* depthRow, int x, int width)
+	{
+		if (x + 4 > width)
+		{
+			// The lanes run past the end of the row, into pixels of another tile
+			alignas(16) float depths[4];
+			_mm_store_ps(depths, z);
+			unsigned lanes = (unsigned)_mm_movemask_ps(covered);
+			unsigned passed = 0;
+			for (int lane = 0; lane < 4; lane++)
+			{
+				if ((lanes & (1u << lane)) != 0 && depths[lane] < depthRow[x + lane] && depths[lane] <= 1.0f)
+				{
+					depthRow[x + lane] = depths[lane];
+					passed |= 1u << lane;
+				}
+			}
+			return passed;
+		}
+		// Lanes outside the rectangle are still in the tile, they get their own depth back
+		__m128 stored = _mm_loadu_ps(depthRow + x);
+		__m128 pass = _mm_and_ps(covered, _mm_and_ps(_mm_cmplt_ps(z, stored), _mm_cmple_ps(z, _mm_set1_ps(1.0f))));
+		unsigned passed = (unsigned)_mm_movemask_ps(pass);
+		if (passed != 0)
+		{
+			_mm_storeu_ps(depthRow + x, _mm_blendv_ps(stored, z, pass));
+		}
+		return passed;
+	}
+
+	RASTER_TARGET("sse4.1")
+	size_t RasterizeSse41(const EdgeSetup& setup, float* depthBuffer, int width, RasterBlock* blocks)
+	{
+		const __m128i laneIndices = _mm_setr_epi32(0, 1, 2, 3);
+		const __m128 laneOffsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+		const __m128i firstColumn = _mm_set1_epi32(setup.minX - 1);
+		const __m128i lastColumn = _mm_set1_epi32(setup.maxX + 1);
+		int firstBlock = setup.minX & ~(RasterBlock::Width - 1);
+		// The tests of the first half block, and how much they change from half to half
+		__m128i laneTests[3];
+		__m128i halfSteps[3];
+		for (int i = 0; i < 3; i++)
+		{
+			__m128i stepX = _mm_set1_epi32(setup.stepX[i]);
+			laneTests[i] = _mm_add_epi32(_mm_set1_epi32(setup.tests[i] + (firstBlock - setup.originX) * setup.stepX[i]), _mm_mullo_epi32(laneIndices, stepX));
+			halfSteps[i] = _mm_set1_epi32(setup.stepX[i] * 4);
+		}
+		__m128 depthStepX = _mm_set1_ps(setup.depthStepX);
+
+		size_t count = 0;
+		for (int y = setup.minY; y <= setup.maxY; y++)
+		{
+			int row = y - setup.originY;
+			__m128i tests[3];
+			for (int i = 0; i < 3; i++)
+			{
+				tests[i] = _mm_add_epi32(laneTests[i], _mm_set1_epi32(row * setup.stepY[i]));
+			}
+			__m128 rowDepth = _mm_set1_ps(GetRowDepth(setup, row));
+			float* depthRow = depthBuffer + (size_t)y * width;
+			for (int blockX = firstBlock; blockX <= setup.maxX; blockX += RasterBlock::Width)
+			{
+				unsigned mask = 0;
+				// A block is two halves of 4
+				for (int half = 0; half < 2; half++)
+				{
+					int x = blockX + half * 4;
+					__m128i outside = _mm_or_si128(_mm_or_si128(tests[0], tests[1]), tests[2]);
+					__m128i columns = _mm_add_epi32(_mm_set1_epi32(x), laneIndices);
+					__m128i inRectangle = _mm_and_si128(_mm_cmpgt_epi32(columns, firstColumn), _mm_cmplt_epi32(columns, lastColumn));
+					// A negative test has the sign bit set, which is all the float compare needs
+					__m128 covered = _mm_andnot_ps(_mm_castsi128_ps(outside), _mm_castsi128_ps(inRectangle));
+					if (_mm_movemask_ps(covered) != 0)
+					{
+						__m128 column = _mm_add_ps(_mm_set1_ps((float)(x - setup.originX)), laneOffsets);
+						__m128 z = _mm_add_ps(rowDepth, _mm_mul_ps(column, depthStepX));
+						mask |= DepthTestSse41(covered, z, depthRow, x, width) << (half * 4);
+					}
+					for (int i = 0; i < 3; i++)
+					{
+						tests[i] = _mm_add_epi32(tests[i], halfSteps[i]);
+					}
+				}
+				if (mask != 0)
+				{
+					blocks[count++] = { blockX, y, mask };
+				}
+			}
+		}
+		return count;
+	}
+
+	RASTER_TARGET("avx2")
+	size_t RasterizeAvx2(const EdgeSetup& setup, float* depthBuffer, int width, RasterBlock* blocks)
+	{
+		const __m256i laneIndices = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+		const __m256 laneOffsets = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+		const __m256 farPlane = _mm256_set1_ps(1.0f);
+		const __m256i firstColumn = _mm256_set1_epi32(setup.minX - 1);
+		const __m256i lastColumn = _mm256_set1_epi32(setup.maxX + 1);
+		int firstBlock = setup.minX & ~(RasterBlock::Width - 1);
+		// The tests of the first block, and how much they change from block to block
+		__m256i laneTests[3];
+		__m256i blockSteps[3];
+		for (int i = 0; i < 3; i++)
+		{
+			__m256i stepX = _mm256_set1_epi32(setup.stepX[i]);
+			laneTests[i] = _mm256_add_epi32(_mm256_set1_epi32(setup.tests[i] + (firstBlock - setup.originX) * setup.stepX[i]), _mm256_mullo_epi32(laneIndices, stepX));
+			blockSteps[i] = _mm256_set1_epi32(setup.stepX[i] * RasterBlock::Width);
+		}
+		__m256 depthStepX = _mm256_set1_ps(setup.depthStepX);
+
+		size_t count = 0;
+		for (int y = setup.minY; y <= setup.maxY; y++)
+		{
+			int row = y - setup.originY;
+			__m256i tests[3];
+			for (int i = 0; i < 3; i++)
+			{
+				tests[i] = _mm256_add_epi32(laneTests[i], _mm256_set1_epi32(row * setup.stepY[i]));
+			}
+			__m256 rowDepth = _mm256_set1_ps(GetRowDepth(setup, row));
+			float* depthRow = depthBuffer + (size_t)y * width;
+			for (int blockX = firstBlock; blockX <= setup.maxX; blockX += RasterBlock::Width)
+			{
+				__m256i outside = _mm256_or_si256(_mm256_or_si256(tests[0], tests[1]), tests[2]);
+				for (int i = 0; i < 3; i++)
+				{
+					tests[i] = _mm256_add_epi32(tests[i], blockSteps[i]);
+				}
+				__m256i columns = _mm256_add_epi32(_mm256_set1_epi32(blockX), laneIndices);
+				__m256i inRectangle = _mm256_and_si256(_mm256_cmpgt_epi32(columns, firstColumn), _mm256_cmpgt_epi32(lastColumn, columns));
+				// A negative test has the sign bit set, which is all the float compare needs
+				__m256 covered = _mm256_andnot_ps(_mm256_castsi256_ps(outside), _mm256_castsi256_ps(inRectangle));
+				if (_mm256_movemask_ps(covered) == 0)
+				{
+					continue;
+				}
+
+				// Masked lanes are neither read nor written, so a block never touches another tile
+				__m256 column = _mm256_add_ps(_mm256_set1_ps((float)(blockX - setup.originX)), laneOffsets);
+				__m256 z = _mm256_add_ps(rowDepth, _mm256_mul_ps(column, depthStepX));
+				__m256 stored = _mm256_maskload_ps(depthRow + blockX, _mm256_castps_si256(covered));
+				__m256 pass = _mm256_and_ps(covered, _mm256_and_ps(_mm256_cmp_ps(z, stored, _CMP_LT_OQ), _mm256_cmp_ps(z, farPlane, _CMP_LE_OQ)));
+				unsigned mask = (unsigned)_mm256_movemask_ps(pass);
+				if (mask != 0)
+				{
+					_mm256_maskstore_ps(depthRow + blockX, _mm256_castps_si256(pass), z);
+					blocks[count++] = { blockX, y, mask };
+				}
+			}
+		}
+		return count;
+	}
+
+	bool CpuSupports(RasterKernel kernel)
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		// AVX needs the OS to save the upper register halves as well
+		bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+		bool avx2 = false;
+		if (avx && maxLeaf >= 7)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+		return kernel == RasterKernel::Sse41 ? sse41 : avx2;
+#else
+		__builtin_cpu_init();
+		return kernel == RasterKernel::Sse41 ? __builtin_cpu_supports("sse4.1") != 0 : __builtin_cpu_supports("avx2") != 0;
+#endif
+	}
+#endif
+}
+
+glm::ivec2 RasterKernels::Snap(const glm::vec2& screen)
+{
+	return glm::ivec2((int)std::lround(screen.x * SubpixelScale), (int)std::lround(screen.y * SubpixelScale));
+}
+
+bool RasterKernels::GetPixelBounds(const glm::ivec2* vertices, int& minX, int& minY, int& maxX, int& maxY)
+{
+	int64_t area = (int64_t)(vertices[1].x - vertices[0].x) * (vertices[2].y - vertices[0].y) -
+		(int64_t)(vertices[1].y - vertices[0].y) * (vertices[2].x - vertices[0].x);
+	if (area == 0)
+	{
+		return false;
+	}
+	// Pixel p has its center at p * SubpixelScale + SubpixelScale / 2
+	glm::ivec2 boundsMin = glm::min(vertices[0], glm::min(vertices[1], vertices[2])) - SubpixelScale / 2;
+	glm::ivec2 boundsMax = glm::max(vertices[0], glm::max(vertices[1], vertices[2])) - SubpixelScale / 2;
+	minX = (int)-FloorDivide(-boundsMin.x, SubpixelScale);
+	minY = (int)-FloorDivide(-boundsMin.y, SubpixelScale);
+	maxX = (int)FloorDivide(boundsMax.x, SubpixelScale);
+	maxY = (int)FloorDivide(boundsMax.y, SubpixelScale);
+	return true;
+}
+
+bool RasterKernels::SetupTriangle(const glm::ivec2* vertices, const glm::vec3& depth, int minX, int minY, int maxX, int maxY, EdgeSetup& setup)
+{
+	int boundsMinX, boundsMinY, boundsMaxX, boundsMaxY;
+	if (!GetPixelBounds(vertices, boundsMinX, boundsMinY, boundsMaxX, boundsMaxY))
+	{
+		return false;
+	}
+	setup.minX = std::max(minX, boundsMinX);
+	setup.minY = std::max(minY, boundsMinY);
+	setup.maxX = std::min(maxX, boundsMaxX);
+	setup.maxY = std::min(maxY, boundsMaxY);
+	if (setup.minX > setup.maxX || setup.minY > setup.maxY)
+	{
+		return false;
+	}
+
+	// A clockwise triangle has all edges negative inside, flipping them keeps edges / area
+	int64_t area = (int64_t)(vertices[1].x - vertices[0].x) * (vertices[2].y - vertices[0].y) -
+		(int64_t)(vertices[1].y - vertices[0].y) * (vertices[2].x - vertices[0].x);
+	int sign = area < 0 ? -1 : 1;
+	setup.area = (float)(area * sign);
+
+	// A test changes by less than this over the rectangle, beyond it its sign is settled for the whole rectangle
+	const int64_t reach = (int64_t)MaxRectangle * 2 * GuardBand * SubpixelScale * 2;
+	setup.originX = setup.minX;
+	setup.originY = setup.minY;
+	glm::i64vec2 start((int64_t)setup.originX * SubpixelScale + SubpixelScale / 2, (int64_t)setup.originY * SubpixelScale + SubpixelScale / 2);
+	for (int i = 0; i < 3; i++)
+	{
+		const glm::ivec2& a = vertices[(i + 1) % 3];
+		const glm::ivec2& b = vertices[(i + 2) % 3];
+		setup.stepX[i] = (a.y - b.y) * sign;
+		setup.stepY[i] = (b.x - a.x) * sign;
+		setup.edges[i] = ((int64_t)(b.x - a.x) * (start.y - a.y) - (int64_t)(b.y - a.y) * (start.x - a.x)) * sign;
+		// A center on a left edge, or on a horizontal edge with the inside below, is inside. On any other
+		// edge it is outside, which biases the edge by one: the neighbor on the other side gets it.
+		bool topLeft = setup.stepX[i] > 0 || (setup.stepX[i] == 0 && setup.stepY[i] < 0);
+		int64_t test = FloorDivide(setup.edges[i] - (topLeft ? 0 : 1), SubpixelScale);
+		setup.tests[i] = (int32_t)std::max(-reach, std::min(reach, test));
+	}
+	// Depth is affine on the screen, so it steps like the edges
+	float inverseArea = 1.0f / setup.area;
+	glm::vec3 edges((float)setup.edges[0], (float)setup.edges[1], (float)setup.edges[2]);
+	glm::vec3 stepX((float)setup.stepX[0], (float)setup.stepX[1], (float)setup.stepX[2]);
+	glm::vec3 stepY((float)setup.stepY[0], (float)setup.stepY[1], (float)setup.stepY[2]);
+	setup.depth = glm::dot(edges, depth) * inverseArea;
+	setup.depthStepX = glm::dot(stepX, depth) * (SubpixelScale * inverseArea);
+	setup.depthStepY = glm::dot(stepY, depth) * (SubpixelScale * inverseArea);
+	return true;
+}
+
+size_t RasterKernels::GetMaxBlocks(int width, int height)
+{
+	// A rectangle that does not start on a block boundary ends one block further
+	return (size_t)height * (width / RasterBlock::Width + 1);
+}
+
+size_t RasterKernels::Rasterize(RasterKernel kernel, const EdgeSetup& setup, float* depthBuffer, int width, RasterBlock* blocks)
+{
+	switch (kernel)
+	{
+#if defined(RASTER_X86)
+	case RasterKernel::Sse41:
+		return RasterizeSse41(setup, depthBuffer, width, blocks);
+	case RasterKernel::Avx2:
+		return RasterizeAvx2(setup, depthBuffer, width, blocks);
+#endif
+	default:
+		return RasterizeScalar(setup, depthBuffer, width, blocks);
+	}
+}
+
+RASTER_TARGET("sse2")
+void RasterKernels::FillColor(float* pixels, size_t count, const glm::vec3& color)
+{
+	size_t i = 0;
+#if defined(RASTER_X86)
+	// Three vectors hold four pixels, the pattern then repeats
+	const __m128 first = _mm_setr_ps(color.r, color.g, color.b, color.r);
+	const __m128 second = _mm_setr_ps(color.g, color.b, color.r, color.g);
+	const __m128 third = _mm_setr_ps(color.b, color.r, color.g, color.b);
+	for (; i + 4 <= count; i += 4)
+	{
+		float* pixel = pixels + i * 3;
+		_mm_storeu_ps(pixel, first);
+		_mm_storeu_ps(pixel + 4, second);
+		_mm_storeu_ps(pixel + 8, third);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		pixels[i * 3] = color.r;
+		pixels[i * 3 + 1] = color.g;
+		pixels[i * 3 + 2] = color.b;
+	}
+}
+
+RASTER_TARGET("sse2")
+void RasterKernels::FillDepth(float* depths, size_t count, float depth)
+{
+	size_t i = 0;
+#if defined(RASTER_X86)
+	const __m128 value = _mm_set1_ps(depth);
+	for (; i + 4 <= count; i += 4)
+	{
+		_mm_storeu_ps(depths + i, value);
+	}
+#endif
+	for (; i < count; i++)
+	{
+		depths[i] = depth;
+	}
+}
+
+bool RasterKernels::IsSupported(RasterKernel kernel)
+{
+	if (kernel == RasterKernel::Scalar)
+	{
+		return true;
+	}
+#if defined(RASTER_X86)
+	static const bool sse41 = CpuSupports(RasterKernel::Sse41);
+	static const bool avx2 = CpuSupports(RasterKernel::Avx2);
+	return kernel == RasterKernel::Sse41 ? sse41 : avx2;
+#else
+	return false;
+#endif
+}
+
+RasterKernel RasterKernels::GetBest()
+{
+	if (IsSupported(RasterKernel::Avx2))
+	{
+		return RasterKernel::Avx2;
+	}
+	return IsSupported(RasterKernel::Sse41) ? RasterKernel::Sse41 : RasterKernel::Scalar;
+}
+
+const char* RasterKernels::GetName(RasterKernel kernel)
+{
+	switch (kernel)
+	{
+	case RasterKernel::Sse41:
+		return "SSE4.1";
+	case RasterKernel::Avx2:
+		return "AVX2";
+	default:
+		return "Scalar";
+	}
+}
+
+double RasterKernels::Benchmark(RasterKernel kernel)
+{
+	if (!IsSupported(kernel))
+	{
+		return 0.0;
+	}
+
+	// Triangles from a few pixels to the whole tile. Each one is in front of the ones before it,
+	// so every covered pixel passes the depth test and is counted.
+	const int TileSize = MaxRectangle;
+	const int TriangleCount = 256;
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> coordinate(0.0f, (float)TileSize);
+	std::vector<EdgeSetup> setups;
+	for (int i = 0; i < TriangleCount; i++)
+	{
+		float size = TileSize * std::pow(0.5f, (float)(i % 6));
+		glm::vec2 corner(coordinate(random), coordinate(random));
+		glm::ivec2 vertices[3];
+		for (int v = 0; v < 3; v++)
+		{
+			vertices[v] = Snap(glm::clamp(corner + glm::vec2(coordinate(random), coordinate(random)) * (size / TileSize) - size * 0.5f, 0.0f, (float)TileSize));
+		}
+		float z = 1.0f - (float)(i + 1) / (TriangleCount + 1);
+		EdgeSetup setup;
+		if (SetupTriangle(vertices, glm::vec3(z), 0, 0, TileSize - 1, TileSize - 1, setup))
+		{
+			setups.push_back(setup);
+		}
+	}
+
+	std::vector<float> depth(TileSize * TileSize);
+	std::vector<RasterBlock> blocks(GetMaxBlocks(TileSize, TileSize));
+	size_t pixels = 0;
+	auto start = std::chrono::steady_clock::now();
+	std::chrono::duration<double> elapsed(0.0);
+	while (elapsed.count() < 0.2)
+	{
+		std::fill(depth.begin(), depth.end(), INFINITY);
+		for (const EdgeSetup& setup : setups)
+		{
+			size_t count = Rasterize(kernel, setup, depth.data(), TileSize, blocks.data());
+			for (size_t b = 0; b < count; b++)
+			{
+				pixels += std::bitset<RasterBlock::Width>(blocks[b].mask).count();
+			}
+		}
+		elapsed = std::chrono::steady_clock::now() - start;
+	}
+	return pixels / elapsed.count() / 1e6;
+}
+
+WatertightResult RasterKernels::TestWatertight(RasterKernel kernel, int width, int height, int frames)
+{
+	WatertightResult result;
+	if (!IsSupported(kernel) || width <= 0 || height <= 0)
+	{
+		return result;
+	}
+
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<uint8_t> front((size_t)width * height);
+	std::vector<uint8_t> back((size_t)width * height);
+	std::vector<float> depth((size_t)width * height);
+	std::vector<RasterBlock> blocks(GetMaxBlocks(MaxRectangle, MaxRectangle));
+	std::vector<glm::ivec2> vertices;
+	std::vector<int> indices;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		// A jittered grid facing the eye, closed by a fan over its border that faces away: every pixel
+		// inside the border must be covered once by each side
+		int cells = 4 + (int)(random() % 45);
+		float size = 0.8f * std::min(width, height);
+		float cell = size / cells;
+		float angle = unit(random) * 6.2831853f;
+		glm::mat2 rotation(std::cos(angle), std::sin(angle), -std::sin(angle), std::cos(angle));
+		glm::vec2 center(width * 0.5f + unit(random), height * 0.5f + unit(random));
+		auto place = [&](glm::vec2 local)
+		{
+			// Rounded to a quarter pixel, so that many edges run exactly through pixel centers
+			return Snap(glm::round((center + rotation * local) * 4.0f) * 0.25f);
+		};
+		int side = cells + 1;
+		vertices.clear();
+		for (int j = 0; j <= cells; j++)
+		{
+			for (int i = 0; i <= cells; i++)
+			{
+				glm::vec2 local = (glm::vec2(i, j) - cells * 0.5f) * cell;
+				if (i > 0 && i < cells && j > 0 && j < cells)
+				{
+					local += (glm::vec2(unit(random), unit(random)) - 0.5f) * (cell * 0.5f);
+				}
+				vertices.push_back(place(local));
+			}
+		}
+		int middle = (int)vertices.size();
+		vertices.push_back(place(glm::vec2(0.0f)));
+
+		indices.clear();
+		for (int j = 0; j < cells; j++)
+		{
+			for (int i = 0; i < cells; i++)
+			{
+				int a = j * side + i;
+				int b = a + 1;
+				int c = b + side;
+				int d = a + side;
+				int split[6] = { a, b, c, a, c, d };
+				if (random() % 2 == 0)
+				{
+					int other[6] = { a, b, d, b, c, d };
+					std::copy(other, other + 6, split);
+				}
+				indices.insert(indices.end(), split, split + 6);
+			}
+		}
+		std::vector<int> border;
+		for (int i = 0; i < cells; i++)
+		{
+			border.push_back(i);
+		}
+		for (int j = 0; j < cells; j++)
+		{
+			border.push_back(j * side + cells);
+		}
+		for (int i = cells; i > 0; i--)
+		{
+			border.push_back(cells * side + i);
+		}
+		for (int j = cells; j > 0; j--)
+		{
+			border.push_back(j * side);
+		}
+		for (size_t k = 0; k < border.size(); k++)
+		{
+			int fan[3] = { middle, border[(k + 1) % border.size()], border[k] };
+			indices.insert(indices.end(), fan, fan + 3);
+		}
+
+		std::fill(front.begin(), front.end(), 0);
+		std::fill(back.begin(), back.end(), 0);
+		for (size_t t = 0; t < indices.size(); t += 3)
+		{
+			glm::ivec2 triangle[3] = { vertices[indices[t]], vertices[indices[t + 1]], vertices[indices[t + 2]] };
+			int minX, minY, maxX, maxY;
+			if (!GetPixelBounds(triangle, minX, minY, maxX, maxY))
+			{
+				continue;
+			}
+			int64_t area = (int64_t)(triangle[1].x - triangle[0].x) * (triangle[2].y - triangle[0].y) -
+				(int64_t)(triangle[1].y - triangle[0].y) * (triangle[2].x - triangle[0].x);
+			std::vector<uint8_t>& counts = area > 0 ? front : back;
+			minX = std::max(minX, 0);
+			minY = std::max(minY, 0);
+			maxX = std::min(maxX, width - 1);
+			maxY = std::min(maxY, height - 1);
+			// One rectangle per tile as the rasterizer sets them up, with the depth cleared so that
+			// every covered pixel passes
+			for (int tileY = minY / MaxRectangle; tileY <= maxY / MaxRectangle; tileY++)
+			{
+				for (int tileX = minX / MaxRectangle; tileX <= maxX / MaxRectangle; tileX++)
+				{
+					EdgeSetup setup;
+					if (!SetupTriangle(triangle, glm::vec3(0.0f), std::max(minX, tileX * MaxRectangle), std::max(minY, tileY * MaxRectangle),
+						std::min(maxX, tileX * MaxRectangle + MaxRectangle - 1), std::min(maxY, tileY * MaxRectangle + MaxRectangle - 1), setup))
+					{
+						continue;
+					}
+					for (int y = setup.minY; y <= setup.maxY; y++)
+					{
+						std::fill(depth.begin() + (size_t)y * width + setup.minX, depth.begin() + (size_t)y * width + setup.maxX + 1, INFINITY);
+					}
+					size_t count = Rasterize(kernel, setup, depth.data(), width, blocks.data());
+					for (size_t b = 0; b < count; b++)
+					{
+						for (int i = 0; i < RasterBlock::Width; i++)
+						{
+							if ((blocks[b].mask & (1u << i)) != 0)
+							{
+								uint8_t& pixel = counts[(size_t)blocks[b].y * width + blocks[b].x + i];
+								pixel = (uint8_t)std::min(pixel + 1, 255);
+							}
+						}
+					}
+				}
+			}
+		}
+
+		for (size_t p = 0; p < front.size(); p++)
+		{
+			if (front[p] > 1 || back[p] > 1)
+			{
+				result.drawnTwice++;
+			}
+			else if (front[p] != back[p])
+			{
+				result.missed++;
+			}
+			else if (front[p] == 1)
+			{
+				result.pixels++;
+			}
+		}
+	}
+	result.frames = frames;
+	return result;
+}
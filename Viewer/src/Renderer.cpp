@@ -5,6 +5,7 @@
 #include "Scene.h"
 #include "Utils.h"
 #include <iostream>
+#include <chrono>
 #include <algorithm>
 
 #define INDEX(width,x,y,c) ((x)+(y)*(width))*3+(c)
@@ -20,6 +21,7 @@ Renderer::Renderer(int viewport_width, int viewport_height) :
 	gray_scale = false;
 	color_with_buffer = false;
 	paintFlag = false;
+	normal_map_ready = false;
 	//array for 2d bolean
 	bool_array = new bool* [(viewport_width + 1)];
 	for (int i = 0; i < viewport_width + 1; i++)
@@ -94,6 +96,8 @@ void Renderer::CreateBuffers(int w, int h)
 	CreateOpenglBuffer(); //Do not remove this line.
 	color_buffer = new float[(3 * w * h)];
 	z_buffer = new float[w * h];
+	color_buffer_drawn = true;
+	cleared_color = glm::vec3(0.0f);
 	ClearColorBuffer(glm::vec3(0.0f, 0.0f, 0.0f));
 }
 
@@ -212,35 +216,114 @@ void Renderer::SwapBuffers()
 
 void Renderer::ClearColorBuffer(const glm::vec3& color)
 {
-	for (int i = 0; i < viewport_width; i++)
-	{
-		for (int j = 0; j < viewport_height; j++)
-		{
-			PutPixel(i, j, color);
-			z_buffer[Z_INDEX(viewport_width, i, j)] = INFINITY;
+	// Only the CPU rasterizer draws into the buffers, the clear waits for Render to know which path runs
+	pending_clear_color = color;
+	clear_pending = true;
+}
 
-		}
+void Renderer::FlushClear()
+{
+	if (!clear_pending)
+	{
+		return;
 	}
+	clear_pending = false;
+	if (!color_buffer_drawn && cleared_color == pending_clear_color)
+	{
+		return;
+	}
+	RasterKernels::FillColor(color_buffer, (size_t)viewport_width * viewport_height, pending_clear_color);
+	cleared_color = pending_clear_color;
+	color_buffer_drawn = false;
 }
 
 void Renderer::Render(Scene& scene)
 {
+	// The kernel tests draw their own triangles, so they run with no models loaded as well
+	if (scene.benchmark_raster_kernels)
+	{
+		scene.benchmark_raster_kernels = false;
+		for (int i = 0; i < 3; i++)
+		{
+			RasterKernel kernel = (RasterKernel)i;
+			scene.raster_kernel_mpixels[i] = RasterKernels::Benchmark(kernel);
+			std::cout << "Raster kernel " << RasterKernels::GetName(kernel) << ": ";
+			if (RasterKernels::IsSupported(kernel))
+			{
+				std::cout << scene.raster_kernel_mpixels[i] << " Mpixels/s" << std::endl;
+			}
+			else
+			{
+				std::cout << "not supported by this CPU" << std::endl;
+			}
+		}
+	}
+	if (scene.test_raster_watertight)
+	{
+		scene.test_raster_watertight = false;
+		scene.raster_watertight = RasterKernels::TestWatertight(scene.software_kernel, viewport_width, viewport_height, 16);
+		const WatertightResult& result = scene.raster_watertight;
+		std::cout << "Raster kernel " << RasterKernels::GetName(scene.software_kernel) << " over " << result.frames << " frames: " << result.pixels
+			<< " pixels covered once from each side, " << result.drawnTwice << " drawn twice, " << result.missed << " missed" << std::endl;
+	}
+	if (!scene.software_rendering || scene.GetModelCount() == 0)
+	{
+		FlushClear();
+	}
 	if (scene.GetModelCount() == 0)
 		return;
 
-	MeshModel& model = scene.GetModel(0);
 	Camera& camera = scene.GetActiveCamera();
-	glm::vec4 temp;
-	temp = model.GetTransform() * glm::vec4(model.modelVertices[0].position, 1);
-	cout << "model position: " << temp.x << " " << temp.y << " " << temp.z << " " << endl;
+	// A model that is still streaming in draws the part that is resident so far.
+	// The overlay shows the level of the active model.
+	std::vector<LodLevel> lods(scene.GetModelCount());
+	for (int i = 0; i < scene.GetModelCount(); i++)
+	{
+		lods[i] = SelectLod(scene, scene.GetModel(i), camera, i == scene.GetActiveModelIndex());
+	}
+	if (scene.software_rendering)
+	{
+		RenderSoftware(scene, lods);
+		return;
+	}
+	MeshModel& model = scene.GetActiveModel();
+	const LodLevel& lod = lods[scene.GetActiveModelIndex()];
+
+	if (scene.benchmark_depth_pass)
+	{
+		scene.benchmark_depth_pass = false;
+		const int repeats = 100;
+		scene.depth_pass_ms_full = TimeDepthPass(model, camera, lod, DrawPass::Shaded, repeats);
+		scene.depth_pass_ms_positions = TimeDepthPass(model, camera, lod, DrawPass::PositionOnly, repeats);
+		std::cout << "Depth pass over " << lod.indexCount / 3 << " triangles: " << scene.depth_pass_ms_full << " ms with the " << model.GetVertexSize()
+			<< " byte vertex, " << scene.depth_pass_ms_positions << " ms with the " << (model.HasPositionStream() ? model.GetPositionSize() : model.GetVertexSize())
+			<< " byte position stream" << std::endl;
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+	if (scene.depth_prepass)
+	{
+		// Fills the depth buffer so the shaded pass runs its fragment shader once per pixel
+		for (int i = 0; i < scene.GetModelCount(); i++)
+		{
+			DrawDepthPass(scene.GetModel(i), camera, lods[i], DrawPass::PositionOnly);
+		}
+		glDepthFunc(GL_LEQUAL);
+		glDepthMask(GL_FALSE);
+	}
+
+	if (scene.normal_map_file != normal_map_loaded)
+	{
+		normal_map_loaded = scene.normal_map_file;
+		normal_map_ready = texture_normalmap.loadTexture(normal_map_loaded, true);
+	}
 	colorShader.use();
-	colorShader.setUniform("model", model.GetTransform());
 	colorShader.setUniform("view", camera.GetViewTransformation());
 	colorShader.setUniform("projection", camera.GetProjectionTransformation());
 	colorShader.setUniform("material.textureMap", 0);
 	colorShader.setUniform("ToonShading", scene.toon_shading);
 	colorShader.setUniform("levels", scene.levels);
 	colorShader.setUniform("UseTexture", scene.use_texture);
+	colorShader.setUniform("Lighting", scene.lighting);
 
 	if (scene.lighting)
 	{
@@ -249,21 +332,178 @@ void Renderer::Render(Scene& scene)
 		colorShader.setUniform("AmbientLight", light.AmbientColor);
 		colorShader.setUniform("DiffuseLight", light.DiffuseColor);
 		colorShader.setUniform("SpecularLight", light.SpecularColor);
-		colorShader.setUniform("material.ambient", model.Ka);
-		colorShader.setUniform("material.diffuse", model.Kd);
-		colorShader.setUniform("material.specular", model.Ks);
 		colorShader.setUniform("Alpha", light.alpha);
 		colorShader.setUniform("LightPosition", light.GetPosition());
 		colorShader.setUniform("CameraPosition", camera.eye);
 	}
-	texture1.bind(0);
+	colorShader.setUniform("material.normalMap", 1);
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	glBindVertexArray(model.GetVao());
-	glDrawArrays(GL_TRIANGLES, 0, model.GetModelVertices().size());
-	glBindVertexArray(0);
-	texture1.unbind(0);
+	for (int i = 0; i < scene.GetModelCount(); i++)
+	{
+		MeshModel& drawn = scene.GetModel(i);
+		colorShader.setUniform("model", drawn.GetDrawTransform());
+		// The diffuse color is also the unlit color
+		colorShader.setUniform("material.ambient", drawn.Ka);
+		colorShader.setUniform("material.diffuse", drawn.Kd);
+		colorShader.setUniform("material.specular", drawn.Ks);
+		// e.g. a glTF base color map
+		Texture2D& texture = drawn.texture ? *drawn.texture : texture1;
+		texture.bind(0);
+		// Tangent space normal mapping needs the model's tangent stream (attribute 3)
+		bool normalMap = scene.normal_map && normal_map_ready && drawn.HasTangents();
+		colorShader.setUniform("UseNormalMap", normalMap);
+		if (normalMap)
+		{
+			texture_normalmap.bind(1);
+		}
+		glBindVertexArray(drawn.GetVao());
+		glDrawElements(GL_TRIANGLES, (GLsizei)lods[i].indexCount, drawn.GetIndexType(), (GLvoid*)(lods[i].firstIndex * drawn.GetIndexSize()));
+		glBindVertexArray(0);
+		texture.unbind(0);
+		if (normalMap)
+		{
+			texture_normalmap.unbind(1);
+		}
+	}
 	colorShader.setUniform("color", glm::vec3(0, 0, 0));
+	if (scene.depth_prepass)
+	{
+		glDepthFunc(GL_LESS);
+		glDepthMask(GL_TRUE);
+	}
+}
+
+void Renderer::RenderSoftware(Scene& scene, const std::vector<LodLevel>& lods)
+{
+	auto start = std::chrono::steady_clock::now();
+	Camera& camera = scene.GetActiveCamera();
+	RasterLighting lighting;
+	lighting.enabled = scene.lighting;
+	lighting.eye = camera.eye;
+	if (scene.lighting)
+	{
+		Light& light = scene.GetLight(0);
+		lighting.position = light.GetPosition();
+		lighting.ambient = light.AmbientColor;
+		lighting.diffuse = light.DiffuseColor;
+		lighting.specular = light.SpecularColor;
+		lighting.shininess = (float)light.alpha;
+	}
+	glm::mat4 viewProjection = camera.GetProjectionTransformation() * camera.GetViewTransformation();
+
+	rasterizer.SetKernel(scene.software_kernel);
+	rasterizer.SetHierarchicalDepth(scene.software_hierarchical_depth);
+	rasterizer.Begin(color_buffer, z_buffer, viewport_width, viewport_height, lighting);
+	if (clear_pending)
+	{
+		rasterizer.Clear(pending_clear_color);
+		clear_pending = false;
+	}
+	color_buffer_drawn = true;
+	for (int i = 0; i < scene.GetModelCount(); i++)
+	{
+		MeshModel& model = scene.GetModel(i);
+		const LodLevel& lod = lods[i];
+		// The CPU needs the vertices in RAM, a loaded model that dropped them goes back to Full residency
+		if (model.GetModelVertices().empty() && model.IsUploaded() && model.GetResidentIndexCount() == model.GetIndexCount())
+		{
+			model.SetResidency(MeshResidency::Full);
+		}
+		if (model.GetModelVertices().size() < model.GetVertexCount() || model.GetModelIndices().size() < lod.firstIndex + lod.indexCount)
+		{
+			continue;
+		}
+		RasterMaterial material = { model.Ka, model.Kd, model.Ks, model.color };
+		rasterizer.Draw(model.GetModelVertices().data(), model.GetModelVertices().size(), model.GetModelIndices().data() + lod.firstIndex, lod.indexCount,
+			model.GetTransform(), viewProjection, material);
+	}
+	rasterizer.End();
+
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	scene.software_frame_ms = elapsed.count() * 1000.0;
+	scene.software_stats = rasterizer.GetStats();
+}
+
+void Renderer::DrawDepthPass(MeshModel& model, Camera& camera, const LodLevel& lod, DrawPass pass)
+{
+	depthShader.use();
+	depthShader.setUniform("model", model.GetDrawTransform());
+	depthShader.setUniform("view", camera.GetViewTransformation());
+	depthShader.setUniform("projection", camera.GetProjectionTransformation());
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	glBindVertexArray(model.GetVao(pass));
+	glDrawElements(GL_TRIANGLES, (GLsizei)lod.indexCount, model.GetIndexType(), (GLvoid*)(lod.firstIndex * model.GetIndexSize()));
+	glBindVertexArray(0);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+// Milliseconds per depth pass, the GL 3.2 context has no timer queries so it waits for the GPU around the draws
+double Renderer::TimeDepthPass(MeshModel& model, Camera& camera, const LodLevel& lod, DrawPass pass, int repeats)
+{
+	DrawDepthPass(model, camera, lod, pass);
+	glFinish();
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < repeats; i++)
+	{
+		glClear(GL_DEPTH_BUFFER_BIT);
+		DrawDepthPass(model, camera, lod, pass);
+	}
+	glFinish();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count() * 1000.0 / repeats;
+}
+float Renderer::GetProjectedDiameter(MeshModel& model, Camera& camera) const
+{
+	glm::mat4x4 transform = model.GetTransform();
+	glm::vec3 center = (model.GetBoundsMin() + model.GetBoundsMax()) * 0.5f;
+	float scale = std::max(glm::length(glm::vec3(transform[0])), std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+	float radius = glm::length(model.GetBoundsMax() - center) * scale;
+
+	// The bounding sphere's diameter in pixels, w is the view depth under a perspective projection and 1 under an orthographic one
+	const glm::mat4x4& projection = camera.GetProjectionTransformation();
+	glm::vec4 clip = projection * camera.GetViewTransformation() * transform * glm::vec4(center, 1.0f);
+	float w = std::max(std::abs(clip.w), 1e-6f);
+	return 2.0f * radius * std::abs(projection[1][1]) / w * 0.5f * (float)viewport_height;
+}
+
+// The index range for the model's size on screen, limited to what is resident
+LodLevel Renderer::SelectLod(Scene& scene, MeshModel& model, Camera& camera, bool recordStats) const
+{
+	float screenSize = GetProjectedDiameter(model, camera);
+	if (recordStats)
+	{
+		scene.lod_level_drawn = 0;
+		scene.lod_screen_size = screenSize;
+	}
+	size_t resident = model.GetResidentIndexCount();
+	const std::vector<LodLevel>& lods = model.GetGeometry().lods;
+	if (lods.empty())
+	{
+		return { 0, resident, 0.0f };
+	}
+
+	size_t level = 0;
+	if (scene.use_lod)
+	{
+		while (level + 1 < lods.size() && level < scene.lod_thresholds.size() && screenSize < scene.lod_thresholds[level])
+		{
+			level++;
+		}
+	}
+
+	// The coarser levels reach the GPU after the full mesh, until then it draws what it has of level 0
+	const LodLevel& lod = lods[level];
+	if (lod.firstIndex + lod.indexCount > resident)
+	{
+		return { 0, std::min(resident, lods[0].indexCount), 0.0f };
+	}
+	if (recordStats)
+	{
+		scene.lod_level_drawn = (int)level;
+	}
+	return lod;
 }
+
 	void Renderer::SetSize(int width, int height)
 	{
 		viewport_width = width;
@@ -282,7 +522,15 @@ void Renderer::Render(Scene& scene)
 	}
 	void Renderer::LoadShaders()
 	{
-		colorShader.loadShaders("vshader.glsl", "fshader.glsl");
+		// The vertex arrays of a model: position, normal, texture coords and the optional tangent stream
+		colorShader.bindAttribLocation(0, "vPosition");
+		colorShader.bindAttribLocation(1, "vNormal");
+		colorShader.bindAttribLocation(2, "vTexCoord");
+		colorShader.bindAttribLocation(3, "vTangent");
+		colorShader.loadShaders("model_vshader.glsl", "model_fshader.glsl");
+		// Both vertex arrays of a model keep the position at attribute 0
+		depthShader.bindAttribLocation(0, "vPosition");
+		depthShader.loadShaders("depth_vshader.glsl", "depth_fshader.glsl");
 	}
 
 	void Renderer::LoadTextures()
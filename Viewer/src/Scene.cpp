@@ -1,4 +1,5 @@
 #include "Scene.h"
+#include <algorithm>
 #include "MeshModel.h"
 #include <string>
 
@@ -30,6 +31,21 @@ Scene::Scene() :
 	toon_shading = false;
 	levels = 3.0f;
 	use_texture = false;
+	use_lod = true;
+	lod_thresholds = { 400.0f, 200.0f, 100.0f };
+	lod_level_drawn = 0;
+	lod_screen_size = 0.0f;
+	depth_prepass = false;
+	benchmark_depth_pass = false;
+	depth_pass_ms_full = 0.0;
+	depth_pass_ms_positions = 0.0;
+	software_rendering = false;
+	software_frame_ms = 0.0;
+	software_kernel = RasterKernels::GetBest();
+	software_hierarchical_depth = true;
+	benchmark_raster_kernels = false;
+	std::fill(std::begin(raster_kernel_mpixels), std::end(raster_kernel_mpixels), 0.0);
+	test_raster_watertight = false;
 }
 
 void Scene::AddModel(const std::shared_ptr<MeshModel>& mesh_model)
@@ -37,6 +53,20 @@ void Scene::AddModel(const std::shared_ptr<MeshModel>& mesh_model)
 	mesh_models.push_back(mesh_model);
 }
 
+void Scene::RemoveModel(const std::shared_ptr<MeshModel>& mesh_model)
+{
+	auto it = std::find(mesh_models.begin(), mesh_models.end(), mesh_model);
+	if (it == mesh_models.end())
+	{
+		return;
+	}
+	mesh_models.erase(it);
+	if (active_model_index >= (int)mesh_models.size())
+	{
+		active_model_index = std::max(0, (int)mesh_models.size() - 1);
+	}
+}
+
 int Scene::GetModelCount() const
 {
 	return mesh_models.size();
@@ -52,6 +82,11 @@ MeshModel& Scene::GetActiveModel() const
 	return *mesh_models[active_model_index];
 }
 
+const std::shared_ptr<MeshModel>& Scene::GetActiveModelPointer() const
+{
+	return mesh_models[active_model_index];
+}
+
 void Scene::AddCamera(const std::shared_ptr<Camera>& camera)
 {
 	cameras.push_back(camera);
@@ -22,6 +22,14 @@ ShaderProgram::~ShaderProgram()
 	glDeleteProgram(programHandle);
 }
 
+//-----------------------------------------------------------------------------
+// Binds a vertex shader input to an attribute index before the program is linked
+//-----------------------------------------------------------------------------
+void ShaderProgram::bindAttribLocation(GLuint index, const GLchar* name)
+{
+	attribLocations[name] = index;
+}
+
 //-----------------------------------------------------------------------------
 // Loads vertex and fragment shaders
 //-----------------------------------------------------------------------------
@@ -54,6 +62,10 @@ bool ShaderProgram::loadShaders(const char* vsFilename, const char* fsFilename)
 	glAttachShader(programHandle, vs);
 	glAttachShader(programHandle, fs);
 
+	for (const auto& attrib : attribLocations)
+	{
+		glBindAttribLocation(programHandle, attrib.second, attrib.first.c_str());
+	}
 	glLinkProgram(programHandle);
 	checkCompileErrors(programHandle, PROGRAM);
 
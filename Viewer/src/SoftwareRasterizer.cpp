@@ -0,0 +1,634 @@
+#include "SoftwareRasterizer.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include "ThreadPool.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace
+{
+	const size_t VerticesPerTask = 1 << 14;
+	const size_t TrianglesPerChunk = 1 << 14;
+
+	// Clip space outcodes, a triangle with all three corners outside one plane is dropped
+	const unsigned OutsideLeft = 1;
+	const unsigned OutsideRight = 2;
+	const unsigned OutsideBottom = 4;
+	const unsigned OutsideTop = 8;
+	const unsigned OutsideNear = 16;
+	const unsigned OutsideFar = 32;
+
+	unsigned GetOutcode(const glm::vec4& clip)
+	{
+		unsigned code = 0;
+		code |= clip.x < -clip.w ? OutsideLeft : 0;
+		code |= clip.x > clip.w ? OutsideRight : 0;
+		code |= clip.y < -clip.w ? OutsideBottom : 0;
+		code |= clip.y > clip.w ? OutsideTop : 0;
+		code |= clip.z < -clip.w ? OutsideNear : 0;
+		code |= clip.z > clip.w ? OutsideFar : 0;
+		return code;
+	}
+
+	// Screen position of a vertex on the subpixel grid, the same for every tile the triangle is binned into
+	glm::ivec2 GetSubpixelPosition(const glm::vec4& clip, int width, int height)
+	{
+		float inverseW = 1.0f / clip.w;
+		return RasterKernels::Snap(glm::vec2((clip.x * inverseW * 0.5f + 0.5f) * width, (clip.y * inverseW * 0.5f + 0.5f) * height));
+	}
+
+	int GetLowestBit(uint64_t bits)
+	{
+#if defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, bits);
+		return (int)index;
+#else
+		return __builtin_ctzll(bits);
+#endif
+	}
+
+	double MillisecondsSince(std::chrono::steady_clock::time_point start)
+	{
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count() * 1000.0;
+	}
+}
+
+SoftwareRasterizer::SoftwareRasterizer() :
+	colorBuffer(nullptr),
+	depthBuffer(nullptr),
+	width(0),
+	height(0),
+	tilesX(0),
+	tilesY(0),
+	drawCount(0),
+	chunkCount(0),
+	kernel(RasterKernels::GetBest()),
+	hierarchicalDepth(true),
+	clearColor(0.0f),
+	clearGeneration(0),
+	clearPending(false)
+{
+}
+
+void SoftwareRasterizer::Begin(float* colorBuffer, float* depthBuffer, int width, int height, const RasterLighting& lighting)
+{
+	bool newBuffers = colorBuffer != this->colorBuffer || depthBuffer != this->depthBuffer || width != this->width || height != this->height;
+	this->colorBuffer = colorBuffer;
+	this->depthBuffer = depthBuffer;
+	this->width = width;
+	this->height = height;
+	this->lighting = lighting;
+	tilesX = (width + TileSize - 1) / TileSize;
+	tilesY = (height + TileSize - 1) / TileSize;
+	if (newBuffers)
+	{
+		// Other buffers hold what they hold, nothing of an earlier clear is owed to them
+		colorGenerations.assign((size_t)(tilesX * tilesY), clearGeneration);
+		depthGenerations.assign((size_t)(tilesX * tilesY), clearGeneration);
+		clearPending = false;
+	}
+	// On the inside of these planes pixel x, (x / w + 1) * width / 2, is at least a tile inside the guard band
+	float guard = (float)(RasterKernels::GuardBand - TileSize);
+	glm::vec2 guardBand(2.0f * guard / std::max(width, 1), 2.0f * guard / std::max(height, 1));
+	clipPlanes[0] = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+	clipPlanes[1] = glm::vec4(1.0f, 0.0f, 0.0f, guardBand.x + 1.0f);
+	clipPlanes[2] = glm::vec4(-1.0f, 0.0f, 0.0f, guardBand.x - 1.0f);
+	clipPlanes[3] = glm::vec4(0.0f, 1.0f, 0.0f, guardBand.y + 1.0f);
+	clipPlanes[4] = glm::vec4(0.0f, -1.0f, 0.0f, guardBand.y - 1.0f);
+	drawCount = 0;
+	chunkCount = 0;
+	stats = RasterStats();
+	stats.threads = ThreadPool::Instance().GetThreadCount();
+}
+
+void SoftwareRasterizer::Draw(const Vertex* vertices, size_t vertexCount, const GLuint* indices, size_t indexCount,
+	const glm::mat4& model, const glm::mat4& viewProjection, const RasterMaterial& material)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0 || width <= 0 || height <= 0)
+	{
+		return;
+	}
+	ThreadPool& pool = ThreadPool::Instance();
+	auto start = std::chrono::steady_clock::now();
+
+	if (draws.size() <= drawCount)
+	{
+		draws.resize(drawCount + 1);
+	}
+	size_t drawIndex = drawCount++;
+	DrawState& draw = draws[drawIndex];
+	draw.material = material;
+	draw.vertices.resize(vertexCount);
+	glm::mat4 modelViewProjection = viewProjection * model;
+	glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+	size_t vertexTasks = (vertexCount + VerticesPerTask - 1) / VerticesPerTask;
+	pool.ParallelFor(vertexTasks, [&](size_t task)
+	{
+		size_t end = std::min(vertexCount, (task + 1) * VerticesPerTask);
+		for (size_t i = task * VerticesPerTask; i < end; i++)
+		{
+			glm::vec4 position(vertices[i].position, 1.0f);
+			RasterVertex& transformed = draw.vertices[i];
+			transformed.clip = modelViewProjection * position;
+			transformed.world = glm::vec3(model * position);
+			transformed.normal = normalMatrix * vertices[i].normal;
+		}
+	});
+	stats.vertexMs += MillisecondsSince(start);
+	start = std::chrono::steady_clock::now();
+
+	size_t drawChunks = (triangleCount + TrianglesPerChunk - 1) / TrianglesPerChunk;
+	size_t firstChunk = chunkCount;
+	chunkCount += drawChunks;
+	if (chunks.size() < chunkCount)
+	{
+		chunks.resize(chunkCount);
+	}
+	pool.ParallelFor(drawChunks, [&](size_t task)
+	{
+		BinChunk& chunk = chunks[firstChunk + task];
+		chunk.draw = drawIndex;
+		BinTriangles(chunk, indices, task * TrianglesPerChunk, std::min(triangleCount, (task + 1) * TrianglesPerChunk));
+	});
+	stats.triangles += triangleCount;
+	for (size_t c = firstChunk; c < chunkCount; c++)
+	{
+		stats.binnedTriangles += chunks[c].triangles.size();
+		stats.binEntries += chunks[c].binTriangles.size();
+	}
+	stats.binMs += MillisecondsSince(start);
+}
+
+void SoftwareRasterizer::Clear(const glm::vec3& color)
+{
+	clearColor = color;
+	clearGeneration++;
+	clearPending = true;
+}
+
+void SoftwareRasterizer::End()
+{
+	auto start = std::chrono::steady_clock::now();
+	if (chunkCount > 0 || clearPending)
+	{
+		std::vector<DepthRejections> rejections((size_t)(tilesX * tilesY));
+		// The pool's threads and this one each take tiles until none are left
+		blockBuffers.resize(ThreadPool::Instance().GetThreadCount() + 1);
+		std::atomic<size_t> nextTile{ 0 };
+		ThreadPool::Instance().ParallelFor(blockBuffers.size(), [&](size_t lane)
+		{
+			std::vector<RasterBlock>& blocks = blockBuffers[lane];
+			blocks.resize(RasterKernels::GetMaxBlocks(TileSize, TileSize));
+			size_t tile;
+			while ((tile = nextTile.fetch_add(1)) < rejections.size())
+			{
+				RasterizeTile((int)tile, rejections[tile], blocks.data());
+			}
+		});
+		for (const DepthRejections& tile : rejections)
+		{
+			stats.rejectedTriangles += tile.triangles;
+			stats.rejectedBlocks += tile.blocks;
+			stats.rejectedPixels += tile.pixels;
+		}
+	}
+	clearPending = false;
+	stats.rasterMs = MillisecondsSince(start);
+}
+
+void SoftwareRasterizer::SetKernel(RasterKernel kernel)
+{
+	this->kernel = RasterKernels::IsSupported(kernel) ? kernel : RasterKernels::GetBest();
+}
+
+RasterKernel SoftwareRasterizer::GetKernel() const
+{
+	return kernel;
+}
+
+void SoftwareRasterizer::SetHierarchicalDepth(bool enabled)
+{
+	hierarchicalDepth = enabled;
+}
+
+const RasterStats& SoftwareRasterizer::GetStats() const
+{
+	return stats;
+}
+
+void SoftwareRasterizer::BinTriangles(BinChunk& chunk, const GLuint* indices, size_t firstTriangle, size_t lastTriangle)
+{
+	const std::vector<RasterVertex>& vertices = draws[chunk.draw].vertices;
+	chunk.triangles.clear();
+	chunk.clipped.clear();
+	for (size_t t = firstTriangle; t < lastTriangle; t++)
+	{
+		uint32_t corners[3] = { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] };
+		if (corners[0] >= vertices.size() || corners[1] >= vertices.size() || corners[2] >= vertices.size())
+		{
+			continue;
+		}
+		const RasterVertex* triangle[3] = { &vertices[corners[0]], &vertices[corners[1]], &vertices[corners[2]] };
+		unsigned codes[3] = { GetOutcode(triangle[0]->clip), GetOutcode(triangle[1]->clip), GetOutcode(triangle[2]->clip) };
+		if ((codes[0] & codes[1] & codes[2]) != 0)
+		{
+			continue;
+		}
+		if (((codes[0] | codes[1] | codes[2]) & ~OutsideFar) == 0)
+		{
+			EmitTriangle(chunk, triangle, corners);
+			continue;
+		}
+
+		// Behind the eye the perspective divide is meaningless and far outside the screen the positions no
+		// longer fit the fixed point edges, so cut out the part on the inside of those planes and draw it as
+		// a fan. The guard band is much wider than the screen, so few triangles reach it.
+		unsigned planes = 0;
+		for (int p = 0; p < ClipPlaneCount; p++)
+		{
+			for (int i = 0; i < 3; i++)
+			{
+				planes |= glm::dot(clipPlanes[p], triangle[i]->clip) < 0.0f ? 1u << p : 0u;
+			}
+		}
+		if (planes == 0)
+		{
+			EmitTriangle(chunk, triangle, corners);
+			continue;
+		}
+		RasterVertex polygon[3 + ClipPlaneCount];
+		RasterVertex clippedPolygon[3 + ClipPlaneCount];
+		int polygonSize = 3;
+		for (int i = 0; i < 3; i++)
+		{
+			polygon[i] = *triangle[i];
+		}
+		for (int p = 0; p < ClipPlaneCount && polygonSize >= 3; p++)
+		{
+			if ((planes & (1u << p)) == 0)
+			{
+				continue;
+			}
+			int clippedSize = 0;
+			for (int i = 0; i < polygonSize; i++)
+			{
+				const RasterVertex& a = polygon[i];
+				const RasterVertex& b = polygon[(i + 1) % polygonSize];
+				float da = glm::dot(clipPlanes[p], a.clip);
+				float db = glm::dot(clipPlanes[p], b.clip);
+				if (da >= 0.0f)
+				{
+					clippedPolygon[clippedSize++] = a;
+				}
+				if ((da >= 0.0f) != (db >= 0.0f))
+				{
+					float s = da / (da - db);
+					RasterVertex& cut = clippedPolygon[clippedSize++];
+					cut.clip = glm::mix(a.clip, b.clip, s);
+					cut.world = glm::mix(a.world, b.world, s);
+					cut.normal = glm::mix(a.normal, b.normal, s);
+				}
+			}
+			std::copy(clippedPolygon, clippedPolygon + clippedSize, polygon);
+			polygonSize = clippedSize;
+		}
+		for (int i = 1; i + 1 < polygonSize; i++)
+		{
+			uint32_t first = (uint32_t)chunk.clipped.size();
+			chunk.clipped.push_back(polygon[0]);
+			chunk.clipped.push_back(polygon[i]);
+			chunk.clipped.push_back(polygon[i + 1]);
+			const RasterVertex* fan[3] = { &polygon[0], &polygon[i], &polygon[i + 1] };
+			uint32_t references[3] = { first | ClippedVertex, (first + 1) | ClippedVertex, (first + 2) | ClippedVertex };
+			EmitTriangle(chunk, fan, references);
+		}
+	}
+
+	// Counting sort of the triangles by tile, a triangle goes into every tile its pixel bounds touch
+	size_t tileCount = (size_t)(tilesX * tilesY);
+	chunk.binStart.assign(tileCount + 1, 0);
+	for (const BinnedTriangle& triangle : chunk.triangles)
+	{
+		for (int ty = triangle.tileMin[1]; ty <= triangle.tileMax[1]; ty++)
+		{
+			for (int tx = triangle.tileMin[0]; tx <= triangle.tileMax[0]; tx++)
+			{
+				chunk.binStart[ty * tilesX + tx + 1]++;
+			}
+		}
+	}
+	for (size_t tile = 0; tile < tileCount; tile++)
+	{
+		chunk.binStart[tile + 1] += chunk.binStart[tile];
+	}
+	chunk.binTriangles.resize(chunk.binStart[tileCount]);
+	std::vector<uint32_t> cursors(chunk.binStart.begin(), chunk.binStart.end() - 1);
+	for (size_t i = 0; i < chunk.triangles.size(); i++)
+	{
+		const BinnedTriangle& triangle = chunk.triangles[i];
+		for (int ty = triangle.tileMin[1]; ty <= triangle.tileMax[1]; ty++)
+		{
+			for (int tx = triangle.tileMin[0]; tx <= triangle.tileMax[0]; tx++)
+			{
+				chunk.binTriangles[cursors[ty * tilesX + tx]++] = (uint32_t)i;
+			}
+		}
+	}
+}
+
+void SoftwareRasterizer::EmitTriangle(BinChunk& chunk, const RasterVertex* const* vertices, const uint32_t* references)
+{
+	glm::ivec2 subpixels[3];
+	for (int i = 0; i < 3; i++)
+	{
+		subpixels[i] = GetSubpixelPosition(vertices[i]->clip, width, height);
+	}
+	// Pixels whose center is inside the bounds, many small triangles of a dense mesh have none
+	int minX, minY, maxX, maxY;
+	if (!RasterKernels::GetPixelBounds(subpixels, minX, minY, maxX, maxY))
+	{
+		return;
+	}
+	minX = std::max(minX, 0);
+	minY = std::max(minY, 0);
+	maxX = std::min(maxX, width - 1);
+	maxY = std::min(maxY, height - 1);
+	if (minX > maxX || minY > maxY)
+	{
+		return;
+	}
+
+	BinnedTriangle triangle;
+	std::copy(references, references + 3, triangle.vertices);
+	triangle.tileMin[0] = (uint16_t)(minX / TileSize);
+	triangle.tileMin[1] = (uint16_t)(minY / TileSize);
+	triangle.tileMax[0] = (uint16_t)(maxX / TileSize);
+	triangle.tileMax[1] = (uint16_t)(maxY / TileSize);
+	chunk.triangles.push_back(triangle);
+}
+
+void SoftwareRasterizer::RasterizeTile(int tile, DepthRejections& rejections, RasterBlock* blocks)
+{
+	int tileX = tile % tilesX;
+	int tileY = tile / tilesX;
+	int tileMinX = tileX * TileSize;
+	int tileMinY = tileY * TileSize;
+	int tileMaxX = std::min(width, tileMinX + TileSize) - 1;
+	int tileMaxY = std::min(height, tileMinY + TileSize) - 1;
+	if (colorGenerations[tile] != clearGeneration)
+	{
+		for (int y = tileMinY; y <= tileMaxY; y++)
+		{
+			RasterKernels::FillColor(colorBuffer + ((size_t)y * width + tileMinX) * 3, tileMaxX - tileMinX + 1, clearColor);
+		}
+		colorGenerations[tile] = clearGeneration;
+	}
+	bool empty = true;
+	for (size_t c = 0; c < chunkCount && empty; c++)
+	{
+		empty = chunks[c].binStart[tile] == chunks[c].binStart[tile + 1];
+	}
+	if (empty)
+	{
+		return;
+	}
+	// Depth is only read under triangles, so a tile without any keeps the clear owed until it gets some
+	if (depthGenerations[tile] != clearGeneration)
+	{
+		for (int y = tileMinY; y <= tileMaxY; y++)
+		{
+			RasterKernels::FillDepth(depthBuffer + (size_t)y * width + tileMinX, tileMaxX - tileMinX + 1, INFINITY);
+		}
+		depthGenerations[tile] = clearGeneration;
+	}
+
+	// Farthest depth stored in each DepthBlock square of the tile, brought up to date after every triangle
+	// that wrote into it. A triangle that is nowhere nearer than that cannot pass the depth test there.
+	const int blocksPerSide = TileSize / DepthBlock;
+	float farthest[blocksPerSide * blocksPerSide];
+	for (int by = 0; by < blocksPerSide; by++)
+	{
+		for (int bx = 0; bx < blocksPerSide; bx++)
+		{
+			farthest[by * blocksPerSide + bx] = GetFarthestDepth(tileMinX + bx * DepthBlock, tileMinY + by * DepthBlock, tileMaxX, tileMaxY);
+		}
+	}
+	uint64_t written = 0;
+
+	for (size_t c = 0; c < chunkCount; c++)
+	{
+		const BinChunk& chunk = chunks[c];
+		const DrawState& draw = draws[chunk.draw];
+		for (uint32_t b = chunk.binStart[tile]; b < chunk.binStart[tile + 1]; b++)
+		{
+			const BinnedTriangle& triangle = chunk.triangles[chunk.binTriangles[b]];
+			const RasterVertex* vertices[3];
+			for (int i = 0; i < 3; i++)
+			{
+				uint32_t reference = triangle.vertices[i];
+				vertices[i] = (reference & ClippedVertex) != 0 ? &chunk.clipped[reference & ~ClippedVertex] : &draw.vertices[reference];
+			}
+
+			// Screen positions, depth and 1/w for the perspective correct attributes
+			glm::ivec2 subpixels[3];
+			glm::vec3 depth;
+			glm::vec3 inverseW;
+			for (int i = 0; i < 3; i++)
+			{
+				const glm::vec4& clip = vertices[i]->clip;
+				inverseW[i] = 1.0f / clip.w;
+				subpixels[i] = GetSubpixelPosition(clip, width, height);
+				depth[i] = clip.z * inverseW[i];
+			}
+			EdgeSetup setup;
+			if (!RasterKernels::SetupTriangle(subpixels, depth, tileMinX, tileMinY, tileMaxX, tileMaxY, setup))
+			{
+				continue;
+			}
+
+			float inverseArea = 1.0f / setup.area;
+			// Exact edges of the shaded pixels, set up once per row of blocks and stepped from pixel to pixel
+			int64_t edgeSteps[3];
+			for (int i = 0; i < 3; i++)
+			{
+				edgeSteps[i] = setup.stepX[i] * (int64_t)RasterKernels::SubpixelScale;
+			}
+			auto rasterize = [&](const EdgeSetup& rectangle)
+			{
+				size_t count = RasterKernels::Rasterize(kernel, rectangle, depthBuffer, width, blocks);
+				int edgeRow = rectangle.minY - 1;
+				int64_t rowEdges[3];
+				for (size_t k = 0; k < count; k++)
+				{
+					const RasterBlock& block = blocks[k];
+					written |= 1ull << ((block.y - tileMinY) / DepthBlock * blocksPerSide + (block.x - tileMinX) / DepthBlock);
+					if (block.y != edgeRow)
+					{
+						edgeRow = block.y;
+						for (int i = 0; i < 3; i++)
+						{
+							rowEdges[i] = setup.edges[i] + (int64_t)(block.y - setup.originY) * setup.stepY[i] * RasterKernels::SubpixelScale;
+						}
+					}
+					int64_t edges[3];
+					for (int i = 0; i < 3; i++)
+					{
+						edges[i] = rowEdges[i] + (int64_t)(block.x - setup.originX) * edgeSteps[i];
+					}
+					for (int i = 0; i < RasterBlock::Width; i++, edges[0] += edgeSteps[0], edges[1] += edgeSteps[1], edges[2] += edgeSteps[2])
+					{
+						if ((block.mask & (1u << i)) == 0)
+						{
+							continue;
+						}
+						// Barycentrics of the screen are not those of the surface, 1/w undoes the projection
+						glm::vec3 perspective = glm::vec3((float)edges[0], (float)edges[1], (float)edges[2]) * inverseArea * inverseW;
+						ShadePixel(draw, vertices, perspective / (perspective.x + perspective.y + perspective.z), &colorBuffer[(block.x + i + block.y * width) * 3]);
+					}
+				}
+			};
+			if (!hierarchicalDepth)
+			{
+				rasterize(setup);
+				continue;
+			}
+
+			// The kernels round the depth plane their own way, the slack keeps the rejection conservative
+			float magnitude = std::abs(setup.depth) + TileSize * (std::abs(setup.depthStepX) + std::abs(setup.depthStepY));
+			float slack = 16.0f * FLT_EPSILON * std::max(magnitude, std::max(std::abs(depth.x), std::max(std::abs(depth.y), std::abs(depth.z))));
+			float nearest = std::min(depth.x, std::min(depth.y, depth.z)) - slack;
+			int blockMinX = (setup.minX - tileMinX) / DepthBlock;
+			int blockMinY = (setup.minY - tileMinY) / DepthBlock;
+			int blockMaxX = (setup.maxX - tileMinX) / DepthBlock;
+			int blockMaxY = (setup.maxY - tileMinY) / DepthBlock;
+			float farthestStored = -INFINITY;
+			for (int by = blockMinY; by <= blockMaxY; by++)
+			{
+				for (int bx = blockMinX; bx <= blockMaxX; bx++)
+				{
+					farthestStored = std::max(farthestStored, farthest[by * blocksPerSide + bx]);
+				}
+			}
+			if (nearest >= farthestStored)
+			{
+				rejections.triangles++;
+				rejections.pixels += (size_t)(setup.maxX - setup.minX + 1) * (setup.maxY - setup.minY + 1);
+				continue;
+			}
+
+			// Rasterize the runs of blocks in each row of them where the triangle may be in front
+			EdgeSetup run = setup;
+			for (int by = blockMinY; by <= blockMaxY; by++)
+			{
+				run.minY = std::max(setup.minY, tileMinY + by * DepthBlock);
+				run.maxY = std::min(setup.maxY, tileMinY + by * DepthBlock + DepthBlock - 1);
+				int runStart = -1;
+				for (int bx = blockMinX; bx <= blockMaxX + 1; bx++)
+				{
+					bool visible = false;
+					if (bx <= blockMaxX)
+					{
+						int minX = std::max(setup.minX, tileMinX + bx * DepthBlock);
+						int maxX = std::min(setup.maxX, tileMinX + bx * DepthBlock + DepthBlock - 1);
+						// The plane is nearest at a corner of the block
+						float corner = setup.depth + (float)(run.minY - setup.originY) * setup.depthStepY + (float)(minX - setup.originX) * setup.depthStepX;
+						float blockNearest = corner + std::min(0.0f, (maxX - minX) * setup.depthStepX) + std::min(0.0f, (run.maxY - run.minY) * setup.depthStepY);
+						visible = std::max(nearest, blockNearest - slack) < farthest[by * blocksPerSide + bx];
+						if (!visible)
+						{
+							rejections.blocks++;
+							rejections.pixels += (size_t)(maxX - minX + 1) * (run.maxY - run.minY + 1);
+						}
+					}
+					if (visible && runStart < 0)
+					{
+						runStart = bx;
+					}
+					else if (!visible && runStart >= 0)
+					{
+						run.minX = std::max(setup.minX, tileMinX + runStart * DepthBlock);
+						run.maxX = std::min(setup.maxX, tileMinX + bx * DepthBlock - 1);
+						rasterize(run);
+						runStart = -1;
+					}
+				}
+			}
+
+			for (; written != 0; written &= written - 1)
+			{
+				int block = GetLowestBit(written);
+				int bx = block % blocksPerSide;
+				int by = block / blocksPerSide;
+				farthest[block] = GetFarthestDepth(tileMinX + bx * DepthBlock, tileMinY + by * DepthBlock, tileMaxX, tileMaxY);
+			}
+		}
+	}
+}
+
+float SoftwareRasterizer::GetFarthestDepth(int minX, int minY, int tileMaxX, int tileMaxY) const
+{
+	int maxX = std::min(tileMaxX, minX + DepthBlock - 1);
+	int maxY = std::min(tileMaxY, minY + DepthBlock - 1);
+	// One maximum per column, which vectorizes where a running maximum over all pixels would not
+	float columns[DepthBlock];
+	std::fill(columns, columns + DepthBlock, -INFINITY);
+	int count = maxX - minX + 1;
+	for (int y = minY; y <= maxY; y++)
+	{
+		const float* row = depthBuffer + (size_t)y * width + minX;
+		for (int i = 0; i < count; i++)
+		{
+			columns[i] = std::max(columns[i], row[i]);
+		}
+	}
+	return *std::max_element(columns, columns + DepthBlock);
+}
+
+void SoftwareRasterizer::ShadePixel(const DrawState& draw, const RasterVertex* const* vertices, const glm::vec3& weights, float* color) const
+{
+	glm::vec3 world = vertices[0]->world * weights.x + vertices[1]->world * weights.y + vertices[2]->world * weights.z;
+	glm::vec3 normal = vertices[0]->normal * weights.x + vertices[1]->normal * weights.y + vertices[2]->normal * weights.z;
+	float length = glm::length(normal);
+	if (length > 1e-12f)
+	{
+		normal /= length;
+	}
+	else
+	{
+		// A model without normals is shaded flat
+		normal = glm::cross(vertices[1]->world - vertices[0]->world, vertices[2]->world - vertices[0]->world);
+		float faceLength = glm::length(normal);
+		normal = faceLength > 0.0f ? normal / faceLength : glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+	glm::vec3 view = glm::normalize(lighting.eye - world);
+	if (glm::dot(normal, view) < 0.0f)
+	{
+		normal = -normal;
+	}
+
+	glm::vec3 shaded;
+	if (lighting.enabled)
+	{
+		glm::vec3 light = glm::normalize(lighting.position - world);
+		glm::vec3 reflected = glm::reflect(-light, normal);
+		float diffuse = std::max(glm::dot(normal, light), 0.0f);
+		float specular = std::pow(std::max(glm::dot(reflected, view), 0.0f), lighting.shininess);
+		shaded = lighting.ambient * draw.material.ambient + lighting.diffuse * draw.material.diffuse * diffuse +
+			lighting.specular * draw.material.specular * specular;
+	}
+	else
+	{
+		shaded = draw.material.color * (0.2f + 0.8f * glm::dot(normal, view));
+	}
+	shaded = glm::clamp(shaded, 0.0f, 1.0f);
+	color[0] = shaded.x;
+	color[1] = shaded.y;
+	color[2] = shaded.z;
+}
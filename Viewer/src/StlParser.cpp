@@ -0,0 +1,114 @@
+#include "StlParser.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+	const size_t TrianglesPerTask = 1 << 16;
+	const size_t HeaderSize = 84;
+	// Normal, three corners and a 16 bit attribute word
+	const size_t TriangleSize = 50;
+
+	// STL is little endian, like every machine the viewer runs on
+	inline glm::vec3 LoadVec3(const char* p)
+	{
+		glm::vec3 value;
+		std::memcpy(&value, p, sizeof(value));
+		return value;
+	}
+}
+
+bool StlParser::ParseFile(const std::string& filePath, ObjData& data, size_t* fileSize, ObjParseProgress* progress)
+{
+	MappedFile file;
+	if (!file.Open(filePath))
+	{
+		return false;
+	}
+
+	if (fileSize != nullptr)
+	{
+		*fileSize = file.GetSize();
+	}
+	return Parse(file.GetData(), file.GetData() + file.GetSize(), data, progress);
+}
+
+bool StlParser::Parse(const char* begin, const char* end, ObjData& data, ObjParseProgress* progress)
+{
+	data = ObjData();
+	size_t byteCount = end - begin;
+	uint32_t triangleCount = 0;
+	if (byteCount >= HeaderSize)
+	{
+		std::memcpy(&triangleCount, begin + 80, sizeof(triangleCount));
+	}
+	// ASCII files start with "solid", but so do some binary headers, the size is what tells them apart
+	if (byteCount < HeaderSize || byteCount < HeaderSize + (size_t)triangleCount * TriangleSize)
+	{
+		bool ascii = byteCount >= 5 && std::memcmp(begin, "solid", 5) == 0;
+		std::cerr << (ascii ? "ASCII STL is not supported, only binary" : "STL file is shorter than its triangle count") << std::endl;
+		return false;
+	}
+	if (progress != nullptr)
+	{
+		progress->bytesDone = 0;
+		progress->bytesTotal = byteCount;
+	}
+
+	data.vertices.resize((size_t)triangleCount * 3);
+	data.normals.resize(triangleCount);
+	std::vector<int> vertexIndices((size_t)triangleCount * 3);
+	std::vector<int> normalIndices((size_t)triangleCount * 3);
+	std::atomic<bool> zeroNormal{ false };
+	const char* triangles = begin + HeaderSize;
+	size_t taskCount = (triangleCount + TrianglesPerTask - 1) / TrianglesPerTask;
+	ThreadPool::Instance().ParallelFor(taskCount, [&](size_t task)
+	{
+		if (progress != nullptr && progress->cancelled)
+		{
+			return;
+		}
+		size_t first = task * TrianglesPerTask;
+		size_t last = std::min<size_t>(triangleCount, first + TrianglesPerTask);
+		bool zero = false;
+		for (size_t t = first; t < last; t++)
+		{
+			const char* p = triangles + t * TriangleSize;
+			glm::vec3 normal = LoadVec3(p);
+			data.normals[t] = normal;
+			zero = zero || (normal.x == 0.0f && normal.y == 0.0f && normal.z == 0.0f);
+			for (int corner = 0; corner < 3; corner++)
+			{
+				data.vertices[t * 3 + corner] = LoadVec3(p + 12 + corner * 12);
+				vertexIndices[t * 3 + corner] = (int)(t * 3 + corner) + 1;
+				normalIndices[t * 3 + corner] = (int)t + 1;
+			}
+		}
+		if (zero)
+		{
+			zeroNormal = true;
+		}
+		if (progress != nullptr)
+		{
+			progress->bytesDone += (last - first) * TriangleSize;
+		}
+	});
+	if (progress != nullptr && progress->cancelled)
+	{
+		data = ObjData();
+		return false;
+	}
+
+	if (zeroNormal)
+	{
+		std::vector<glm::vec3>().swap(data.normals);
+		std::vector<int>().swap(normalIndices);
+	}
+	data.faces.Assign(std::move(vertexIndices), std::vector<int>(), std::move(normalIndices));
+	return true;
+}
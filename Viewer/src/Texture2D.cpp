@@ -58,6 +58,37 @@ bool Texture2D::loadTexture(const string& fileName, bool generateMipMaps)
 		}
 	}
 
+	createTexture(imageData, width, height, generateMipMaps);
+	stbi_image_free(imageData);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Load a texture from an encoded image (PNG, JPEG, ...) in memory, e.g. one
+// embedded in a GLB file. The rows are kept in file order, glTF texture
+// coords start at the top of the image.
+//-----------------------------------------------------------------------------
+bool Texture2D::loadTexture(const unsigned char* data, size_t size, bool generateMipMaps)
+{
+	int width, height, components;
+	unsigned char* imageData = stbi_load_from_memory(data, (int)size, &width, &height, &components, STBI_rgb_alpha);
+
+	if (imageData == NULL)
+	{
+		std::cerr << "Error decoding embedded texture: " << stbi_failure_reason() << std::endl;
+		return false;
+	}
+
+	createTexture(imageData, width, height, generateMipMaps);
+	stbi_image_free(imageData);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Upload decoded RGBA rows into a new texture object
+//-----------------------------------------------------------------------------
+void Texture2D::createTexture(const unsigned char* imageData, int width, int height, bool generateMipMaps)
+{
 	glGenTextures(1, &mTexture);
 	glBindTexture(GL_TEXTURE_2D, mTexture); // all upcoming GL_TEXTURE_2D operations will affect our texture object (mTexture)
 
@@ -78,10 +109,7 @@ bool Texture2D::loadTexture(const string& fileName, bool generateMipMaps)
 	if (generateMipMaps)
 		glGenerateMipmap(GL_TEXTURE_2D);
 
-	stbi_image_free(imageData);
 	glBindTexture(GL_TEXTURE_2D, 0); // unbind texture when done so we don't accidentally mess up our mTexture
-
-	return true;
 }
 
 //-----------------------------------------------------------------------------
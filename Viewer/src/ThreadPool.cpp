@@ -0,0 +1,121 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace
+{
+	struct ParallelForState
+	{
+		std::function<void(size_t)> task;
+		size_t count;
+		std::atomic<size_t> next{ 0 };
+		std::atomic<size_t> done{ 0 };
+		std::mutex mutex;
+		std::condition_variable finished;
+
+		void Run()
+		{
+			size_t index;
+			while ((index = next.fetch_add(1)) < count)
+			{
+				task(index);
+				if (done.fetch_add(1) + 1 == count)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					finished.notify_all();
+				}
+			}
+		}
+	};
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) :
+	stopping(false)
+{
+	for (unsigned i = 0; i < std::max(threadCount, 1u); i++)
+	{
+		workers.emplace_back(&ThreadPool::WorkerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobAvailable.notify_all();
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+}
+
+ThreadPool& ThreadPool::Instance()
+{
+	static ThreadPool pool(std::max(std::thread::hardware_concurrency(), 1u));
+	return pool;
+}
+
+unsigned ThreadPool::GetThreadCount() const
+{
+	return static_cast<unsigned>(workers.size());
+}
+
+void ThreadPool::Enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	jobAvailable.notify_one();
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& task)
+{
+	if (count == 0)
+	{
+		return;
+	}
+	if (count == 1)
+	{
+		task(0);
+		return;
+	}
+
+	// The state is shared with helpers that may only start after we returned
+	auto state = std::make_shared<ParallelForState>();
+	state->task = task;
+	state->count = count;
+
+	size_t helpers = std::min<size_t>(workers.size(), count - 1);
+	for (size_t i = 0; i < helpers; i++)
+	{
+		Enqueue([state]() { state->Run(); });
+	}
+
+	state->Run();
+
+	std::unique_lock<std::mutex> lock(state->mutex);
+	state->finished.wait(lock, [&state]() { return state->done.load() == state->count; });
+}
+
+void ThreadPool::WorkerLoop()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping && jobs.empty())
+			{
+				return;
+			}
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
@@ -1,75 +1,324 @@
 #include <memory>
 #include <string>
 #include <iostream>
-#include <fstream>
-#include <sstream>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <cctype>
 
 #include "Utils.h"
+#include "AssetCache.h"
+#include "ObjParser.h"
+#include "PlyParser.h"
+#include "StlParser.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MemoryStats.h"
+#include "MeshSimplifier.h"
+#include "ThreadPool.h"
+#include "VertexWelder.h"
 
-glm::vec3 Utils::Vec3fFromStream(std::istream& issLine)
+namespace
 {
-	float x, y, z;
-	issLine >> x >> std::ws >> y >> std::ws >> z;
-	return glm::vec3(x, y, z);
-}
+	// Faces per streamed batch, small enough that the first one shows up quickly
+	const size_t StreamBatchFaces = 64 * 1024;
 
-glm::vec2 Utils::Vec2fFromStream(std::istream& issLine)
-{
-	float x, y;
-	issLine >> x >> std::ws >> y;
-	return glm::vec2(x, y);
+	// Identifies the level of detail settings in the mesh cache header, 0 means none
+	uint32_t GetLodKey(const std::vector<float>& triangleRatios)
+	{
+		if (triangleRatios.empty())
+		{
+			return 0;
+		}
+		uint32_t hash = 2166136261u;
+		for (float ratio : triangleRatios)
+		{
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&ratio);
+			for (size_t i = 0; i < sizeof(ratio); i++)
+			{
+				hash = (hash ^ bytes[i]) * 16777619u;
+			}
+		}
+		return hash == 0 ? 1 : hash;
+	}
+
+	// Identifies the normal generation and weld settings in the mesh cache header, 0 means none
+	uint32_t GetNormalKey(const MeshLoadOptions& options)
+	{
+		if (!options.generateNormals && !options.weldVertices)
+		{
+			return 0;
+		}
+		uint32_t hash = 2166136261u;
+		uint32_t values[4] = {};
+		if (options.generateNormals)
+		{
+			std::memcpy(&values[0], &options.creaseAngle, sizeof(float));
+			values[1] = (uint32_t)options.normalWeighting + 1;
+		}
+		if (options.weldVertices)
+		{
+			std::memcpy(&values[2], &options.weldTolerance, sizeof(float));
+			values[3] = 1;
+		}
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+		for (size_t i = 0; i < sizeof(values); i++)
+		{
+			hash = (hash ^ bytes[i]) * 16777619u;
+		}
+		return hash == 0 ? 1 : hash;
+	}
 }
 
 std::shared_ptr<MeshModel> Utils::LoadMeshModel(const std::string& filePath)
 {
-	std::vector<Face> faces;
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec3> normals;
-	std::vector<glm::vec2> textureCoords;
-	std::ifstream ifile(filePath.c_str());
+	std::shared_ptr<MeshModel> instance = AssetCache::Instance().CreateInstance(filePath);
+	if (instance)
+	{
+		return instance;
+	}
 
-	// while not end of file
-	while (!ifile.eof())
+	MeshCache cache;
+	std::shared_ptr<MeshModel> model = Utils::ReadMeshModel(filePath, cache);
+	if (!model)
 	{
-		// get line
-		std::string curLine;
-		std::getline(ifile, curLine);
+		return model;
+	}
 
-		// read the type of the line
-		std::istringstream issLine(curLine);
-		std::string lineType;
+	if (cache.GetVertices() != nullptr)
+	{
+		model->CreateBuffers(cache.GetVertexCount(), cache.GetIndexCount(), cache.GetIndexType());
+		model->UploadVertices(0, cache.GetVertexCount(), cache.GetVertices());
+		model->UploadIndices(0, cache.GetIndexCount(), cache.GetIndices());
+		if (cache.GetTangents() != nullptr)
+		{
+			model->UploadTangents(cache.GetTangents(), cache.GetVertexCount());
+		}
+	}
+	else
+	{
+		model->UploadToGpu();
+	}
+	AssetCache::Instance().Add(filePath, *model);
+	return model;
+}
+
+std::shared_ptr<MeshModel> Utils::ReadMeshModel(const std::string& filePath, MeshCache& cache, ObjParseProgress* progress, const MeshBatchCallback& onBatch, const MeshLoadOptions& options)
+{
+	std::string modelName = Utils::GetFileName(filePath);
+	auto start = std::chrono::steady_clock::now();
+	MemoryStats::ResetPeak();
+	size_t startResident = MemoryStats::GetResidentBytes();
+	uint64_t startAllocations = MemoryStats::GetAllocationCount();
+
+	// Warm load: the cached data is later handed to the GPU straight from the mapping
+	uint32_t cacheFlags = (options.optimize ? MeshCache::Optimized : 0) | (options.generateTangents ? MeshCache::Tangents : 0) |
+		(options.weldVertices ? MeshCache::Welded : 0);
+	uint32_t lodKey = GetLodKey(options.lodTriangleRatios);
+	uint32_t normalKey = GetNormalKey(options);
+	if (cache.Open(filePath, cacheFlags, lodKey, normalKey))
+	{
+		auto model = std::make_shared<MeshModel>(modelName);
+		model->SetBounds(cache.GetBoundsMin(), cache.GetBoundsMax());
+		model->GetGeometry().lods = cache.GetLods();
+		model->GetGeometry().cacheSource = { filePath, cacheFlags, lodKey, normalKey };
+		model->GetGeometry().sourcePath = filePath;
 
-		issLine >> std::ws >> lineType;
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		std::cout << "Loaded " << modelName << " from " << MeshCache::GetCachePath(filePath) << " in " << elapsed.count() * 1000.0 << " ms (warm)" << std::endl;
+		return model;
+	}
 
-		// based on the type parse data
-		if (lineType == "v")
+	ObjData data;
+	size_t fileSize = 0;
+	if (!ParseModelFile(filePath, data, &fileSize, progress))
+	{
+		if (progress == nullptr || !progress->cancelled)
 		{
-			vertices.push_back(Utils::Vec3fFromStream(issLine));
+			std::cerr << "Error opening model '" << filePath << "'" << std::endl;
 		}
-		else if (lineType == "vn")
+		return nullptr;
+	}
+	std::chrono::duration<double> parseTime = std::chrono::steady_clock::now() - start;
+
+	double megabytes = fileSize / (1024.0 * 1024.0);
+	std::cout << "Parsed " << modelName << ": " << megabytes << " MB in " << parseTime.count() * 1000.0 << " ms ("
+		<< (parseTime.count() > 0.0 ? megabytes / parseTime.count() : 0.0) << " MB/s)" << std::endl;
+	if (data.unknownLines > 0)
+	{
+		std::cout << "Skipped " << data.unknownLines << " lines of unknown type" << std::endl;
+	}
+
+	if (options.weldVertices)
+	{
+		auto weldStart = std::chrono::steady_clock::now();
+		size_t positionCount = data.vertices.size();
+		size_t merged = VertexWelder::Weld(data.vertices, data.faces.GetVertexIndices(), options.weldTolerance);
+		std::chrono::duration<double> weldTime = std::chrono::steady_clock::now() - weldStart;
+		std::cout << "Welded " << modelName << ": " << positionCount << " -> " << data.vertices.size() << " positions (" << merged << " merged) in "
+			<< weldTime.count() * 1000.0 << " ms" << std::endl;
+	}
+
+	MeshBuilder builder(data.faces, data.vertices, data.normals, data.textureCoords);
+	if (onBatch)
+	{
+		while (!builder.IsDone())
 		{
-			normals.push_back(Utils::Vec3fFromStream(issLine));
+			if (progress != nullptr && progress->cancelled)
+			{
+				return nullptr;
+			}
+			onBatch(builder.Build(StreamBatchFaces));
 		}
-		else if (lineType == "vt")
+	}
+	else
+	{
+		builder.Build(data.faces.GetFacesCount());
+	}
+
+	bool generateNormals = options.generateNormals && !builder.HasNormals();
+	if (generateNormals)
+	{
+		auto normalStart = std::chrono::steady_clock::now();
+		size_t builtVertexCount = builder.GetVertices().size();
+		NormalGenerator::Generate(builder.GetVertices(), builder.GetIndices(), builder.GetVertexPositions(), data.vertices.size(),
+			options.creaseAngle, options.normalWeighting);
+		std::chrono::duration<double> normalTime = std::chrono::steady_clock::now() - normalStart;
+		std::cout << "Generated normals for " << modelName << ": crease " << options.creaseAngle << " deg, " << builder.GetVertices().size() - builtVertexCount
+			<< " vertices split, " << builder.GetIndices().size() / 3 << " triangles in " << normalTime.count() * 1000.0 << " ms" << std::endl;
+	}
+
+	bool hasTextureCoords = builder.HasTextureCoords();
+	std::shared_ptr<MeshModel> model = std::make_shared<MeshModel>(std::move(data.faces), std::move(data.vertices), std::move(data.normals), std::move(data.textureCoords),
+		std::move(builder.GetVertices()), std::move(builder.GetIndices()), modelName);
+	model->GetGeometry().generatedNormals = generateNormals;
+	model->GetGeometry().sourcePath = filePath;
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "Loaded " << modelName << " in " << elapsed.count() * 1000.0 << " ms (cold)" << std::endl;
+
+	// Without indexing every face corner would be its own vertex
+	size_t cornerCount = model->GetIndexCount();
+	size_t expandedBytes = cornerCount * sizeof(Vertex);
+	size_t indexedBytes = model->GetVertexCount() * sizeof(Vertex) + cornerCount * model->GetIndexSize();
+	std::cout << "Indexed " << modelName << ": " << cornerCount << " corners -> " << model->GetVertexCount() << " vertices, "
+		<< expandedBytes / 1024 << " KB -> " << indexedBytes / 1024 << " KB" << std::endl;
+
+	if (options.optimize)
+	{
+		OptimizeMeshModel(*model);
+	}
+	if (!options.lodTriangleRatios.empty())
+	{
+		GenerateLods(*model, options.lodTriangleRatios);
+	}
+	if (options.generateTangents && hasTextureCoords)
+	{
+		// Last, so the split vertices are part of every level
+		MeshGeometry& geometry = model->GetGeometry();
+		auto tangentStart = std::chrono::steady_clock::now();
+		size_t builtVertexCount = geometry.modelVertices.size();
+		size_t baseIndexCount = geometry.lods.empty() ? geometry.modelIndices.size() : geometry.lods[0].indexCount;
+		NormalGenerator::GenerateTangents(geometry.modelVertices, geometry.modelIndices, baseIndexCount, geometry.modelTangents);
+		if (options.optimize && geometry.modelVertices.size() > builtVertexCount)
 		{
-			// TODO: Handle texture coordinates
-			textureCoords.push_back(Utils::Vec2fFromStream(issLine));
+			// The split vertices were appended, renumbering over every level puts them back in fetch order
+			MeshOptimizer::OptimizeVertexFetch(geometry.modelVertices, geometry.modelIndices, &geometry.modelTangents);
 		}
-		else if (lineType == "f")
+		geometry.vertexCount = geometry.modelVertices.size();
+		std::chrono::duration<double> tangentTime = std::chrono::steady_clock::now() - tangentStart;
+		std::cout << "Generated tangents for " << modelName << ": " << geometry.modelVertices.size() - builtVertexCount << " vertices split at mirrored texture seams in "
+			<< tangentTime.count() * 1000.0 << " ms" << std::endl;
+	}
+
+	const std::vector<Vertex>& vertices = model->GetModelVertices();
+	const std::vector<GLuint>& indices = model->GetModelIndices();
+	if (fileSize > 0)
+	{
+		if (MeshCache::Write(filePath, vertices.data(), vertices.size(), indices.data(), indices.size(), model->GetBoundsMin(), model->GetBoundsMax(), cacheFlags, lodKey, normalKey, model->GetGeometry().lods,
+			model->GetGeometry().modelTangents.empty() ? nullptr : model->GetGeometry().modelTangents.data()))
 		{
-			faces.push_back(Face(issLine));
+			model->GetGeometry().cacheSource = { filePath, cacheFlags, lodKey, normalKey };
 		}
-		else if (lineType == "#" || lineType == "")
+		else
 		{
-			// comment / empty line
+			std::cerr << "Could not write mesh cache '" << MeshCache::GetCachePath(filePath) << "'" << std::endl;
 		}
-		else
+	}
+
+	// Peak over the model's own size; the source file is mapped while it is parsed, so its pages count too
+	size_t peakResident = MemoryStats::GetPeakResidentBytes();
+	double peakGrowth = (peakResident > startResident ? peakResident - startResident : 0) / (1024.0 * 1024.0);
+	double modelMegabytes = model->GetCpuMemoryUsage() / (1024.0 * 1024.0);
+	std::cout << "Memory for " << modelName << ": peak RSS +" << peakGrowth << " MB for a " << modelMegabytes << " MB model ("
+		<< (modelMegabytes > 0.0 ? peakGrowth / modelMegabytes : 0.0) << "x, source " << megabytes << " MB), "
+		<< MemoryStats::GetAllocationCount() - startAllocations << " allocations" << std::endl;
+	return model;
+}
+
+void Utils::OptimizeMeshModel(MeshModel& model)
+{
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Vertex>& vertices = model.GetGeometry().modelVertices;
+	std::vector<GLuint>& indices = model.GetGeometry().modelIndices;
+	VertexCacheStats before = MeshOptimizer::AnalyzeVertexCache(indices, vertices.size());
+
+	MeshOptimizer::OptimizeVertexCache(indices, vertices.size());
+	MeshOptimizer::OptimizeOverdraw(indices, vertices);
+	MeshOptimizer::OptimizeVertexFetch(vertices, indices);
+
+	VertexCacheStats after = MeshOptimizer::AnalyzeVertexCache(indices, vertices.size());
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << "Optimized " << model.GetModelName() << ": ACMR " << before.acmr << " -> " << after.acmr
+		<< ", ATVR " << before.atvr << " -> " << after.atvr << " in " << elapsed.count() * 1000.0 << " ms" << std::endl;
+}
+
+void Utils::GenerateLods(MeshModel& model, const std::vector<float>& triangleRatios)
+{
+	auto start = std::chrono::steady_clock::now();
+	const std::vector<Vertex>& vertices = model.GetGeometry().modelVertices;
+	std::vector<GLuint>& indices = model.GetGeometry().modelIndices;
+	std::vector<LodLevel>& lods = model.GetGeometry().lods;
+	size_t baseIndexCount = lods.empty() ? indices.size() : lods[0].indexCount;
+	indices.resize(baseIndexCount);
+
+	// Every level starts from the full mesh, so they do not depend on each other
+	std::vector<std::vector<GLuint>> levels(triangleRatios.size());
+	std::vector<float> errors(triangleRatios.size());
+	ThreadPool::Instance().ParallelFor(triangleRatios.size(), [&](size_t level)
+	{
+		size_t targetIndexCount = (size_t)((float)(baseIndexCount / 3) * triangleRatios[level]) * 3;
+		errors[level] = MeshSimplifier::Simplify(vertices, indices, targetIndexCount, levels[level]);
+		MeshOptimizer::OptimizeVertexCache(levels[level], vertices.size());
+	});
+
+	lods.clear();
+	lods.push_back({ 0, baseIndexCount, 0.0f });
+	std::cout << "Levels of detail for " << model.GetModelName() << ": " << baseIndexCount / 3;
+	for (size_t level = 0; level < levels.size(); level++)
+	{
+		if (levels[level].empty() || levels[level].size() >= lods.back().indexCount)
 		{
-			std::cout << "Found unknown line Type \"" << lineType << "\"";
+			continue;
 		}
+		lods.push_back({ indices.size(), levels[level].size(), errors[level] });
+		indices.insert(indices.end(), levels[level].begin(), levels[level].end());
+		std::cout << " -> " << levels[level].size() / 3 << " (error " << errors[level] << ")";
 	}
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	std::cout << " triangles in " << elapsed.count() * 1000.0 << " ms" << std::endl;
+}
 
-	return std::make_shared<MeshModel>(faces, vertices, normals, textureCoords, Utils::GetFileName(filePath));
+bool Utils::PrintOptimizationReport(const std::string& filePath)
+{
+	ObjData data;
+	if (!ParseModelFile(filePath, data))
+	{
+		std::cerr << "Error opening model '" << filePath << "'" << std::endl;
+		return false;
+	}
+	MeshModel model(std::move(data.faces), std::move(data.vertices), std::move(data.normals), std::move(data.textureCoords), Utils::GetFileName(filePath));
+	OptimizeMeshModel(model);
+	return true;
 }
 
 std::string Utils::GetFileName(const std::string& filePath)
@@ -106,4 +355,30 @@ std::string Utils::GetFileName(const std::string& filePath)
 	}
 
 	return filePath.substr(index + 1, len - index);
+}
+
+std::string Utils::GetFileExtension(const std::string& filePath)
+{
+	std::string extension;
+	size_t dot = filePath.find_last_of('.');
+	if (dot != std::string::npos && filePath.find_first_of("/\\", dot) == std::string::npos)
+	{
+		extension = filePath.substr(dot + 1);
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	}
+	return extension;
+}
+
+bool Utils::ParseModelFile(const std::string& filePath, ObjData& data, size_t* fileSize, ObjParseProgress* progress)
+{
+	std::string extension = GetFileExtension(filePath);
+	if (extension == "ply")
+	{
+		return PlyParser::ParseFile(filePath, data, fileSize, progress);
+	}
+	if (extension == "stl")
+	{
+		return StlParser::ParseFile(filePath, data, fileSize, progress);
+	}
+	return ObjParser::ParseFile(filePath, data, fileSize, progress);
 }
\ No newline at end of file
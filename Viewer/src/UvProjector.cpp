@@ -0,0 +1,99 @@
+#include "UvProjector.h"
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/constants.hpp>
+#include "ThreadPool.h"
+
+namespace
+{
+	const size_t ItemsPerTask = 1 << 16;
+
+	const glm::vec3& At(const glm::vec3* base, size_t stride, size_t i)
+	{
+		return *reinterpret_cast<const glm::vec3*>(reinterpret_cast<const char*>(base) + i * stride);
+	}
+
+	// atan2 to about 1e-5 radians, selects instead of branches so a loop around it vectorizes
+	float FastAtan2(float y, float x)
+	{
+		float ax = std::fabs(x);
+		float ay = std::fabs(y);
+		float a = std::min(ax, ay) / std::max(std::max(ax, ay), 1e-30f);
+		float s = a * a;
+		float r = ((-0.0464964749f * s + 0.15931422f) * s - 0.327622764f) * s * a + a;
+		r = ay > ax ? glm::half_pi<float>() - r : r;
+		r = x < 0.0f ? glm::pi<float>() - r : r;
+		return y < 0.0f ? -r : r;
+	}
+}
+
+void UvProjector::Project(UvProjection mode, const glm::vec3* positions, const glm::vec3* normals, size_t stride, size_t count,
+	const glm::vec3& boundsMin, const glm::vec3& boundsMax, glm::vec2* uvs)
+{
+	glm::vec3 size = glm::max(boundsMax - boundsMin, glm::vec3(1e-12f));
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	// Planar and Box keep texels square, the largest side of the bounds maps to [0, 1]
+	float squareScale = 1.0f / std::max(size.x, std::max(size.y, size.z));
+	int thinAxis = size.x <= size.y && size.x <= size.z ? 0 : size.y <= size.z ? 1 : 2;
+	int uAxis = thinAxis == 0 ? 2 : 0;
+	int vAxis = thinAxis == 1 ? 2 : 1;
+	float inverseHeight = 1.0f / size.y;
+	const glm::vec3* directions = normals != nullptr ? normals : positions;
+	glm::vec3 directionOrigin = normals != nullptr ? glm::vec3(0.0f) : center;
+
+	size_t taskCount = (count + ItemsPerTask - 1) / ItemsPerTask;
+	ThreadPool::Instance().ParallelFor(taskCount, [&](size_t task)
+	{
+		size_t begin = task * ItemsPerTask;
+		size_t end = std::min(count, begin + ItemsPerTask);
+		switch (mode)
+		{
+		case UvProjection::Planar:
+			for (size_t i = begin; i < end; i++)
+			{
+				glm::vec3 q = (At(positions, stride, i) - boundsMin) * squareScale;
+				uvs[i] = glm::vec2(q[uAxis], q[vAxis]);
+			}
+			break;
+		case UvProjection::Cylindrical:
+			for (size_t i = begin; i < end; i++)
+			{
+				glm::vec3 d = At(positions, stride, i) - center;
+				uvs[i] = glm::vec2(FastAtan2(d.z, d.x) * glm::one_over_two_pi<float>() + 0.5f, (d.y + size.y * 0.5f) * inverseHeight);
+			}
+			break;
+		case UvProjection::Spherical:
+			for (size_t i = begin; i < end; i++)
+			{
+				glm::vec3 d = At(positions, stride, i) - center;
+				float latitude = FastAtan2(d.y, std::sqrt(d.x * d.x + d.z * d.z));
+				uvs[i] = glm::vec2(FastAtan2(d.z, d.x) * glm::one_over_two_pi<float>() + 0.5f, latitude * glm::one_over_pi<float>() + 0.5f);
+			}
+			break;
+		case UvProjection::Box:
+			for (size_t i = begin; i < end; i++)
+			{
+				glm::vec3 q = (At(positions, stride, i) - boundsMin) * squareScale;
+				glm::vec3 a = glm::abs(At(directions, stride, i) - directionOrigin);
+				bool alongX = a.x >= a.y && a.x >= a.z;
+				bool alongY = !alongX && a.y >= a.z;
+				uvs[i] = glm::vec2(alongX ? q.z : q.x, alongY ? q.z : q.y);
+			}
+			break;
+		default:
+			break;
+		}
+	});
+}
+
+const char* UvProjector::GetName(UvProjection mode)
+{
+	switch (mode)
+	{
+	case UvProjection::Planar: return "Plane";
+	case UvProjection::Cylindrical: return "Cylinder";
+	case UvProjection::Spherical: return "Sphere";
+	case UvProjection::Box: return "Box";
+	default: return "Model";
+	}
+}
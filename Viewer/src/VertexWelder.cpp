@@ -0,0 +1,210 @@
+#include "VertexWelder.h"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cstdint>
+#include <memory>
+#include "ThreadPool.h"
+
+namespace
+{
+	const size_t ItemsPerTask = 1 << 16;
+	// Cell size in tolerance radii. Only positions within a radius of a cell face look into the neighbour
+	// behind it, with wide cells most of them search their own cell alone.
+	const float CellRadii = 8.0f;
+	// Cells are never smaller than this fraction of the diagonal, so cell coordinates fit an int
+	const float MinCellFraction = 1e-7f;
+
+	struct Grid
+	{
+		glm::vec3 origin;
+		float inverseCellSize;
+		uint32_t mask;
+
+		glm::vec3 ToCells(const glm::vec3& position) const
+		{
+			return (position - origin) * inverseCellSize;
+		}
+
+		uint32_t GetBucket(const glm::ivec3& cell) const
+		{
+			uint32_t hash = (uint32_t)cell.x * 73856093u ^ (uint32_t)cell.y * 19349663u ^ (uint32_t)cell.z * 83492791u;
+			// Vertices on a regular grid have cell coordinates with common factors, mixing keeps them off the same low bits
+			hash ^= hash >> 16;
+			hash *= 0x85EBCA6Bu;
+			hash ^= hash >> 13;
+			return hash & mask;
+		}
+	};
+}
+
+size_t VertexWelder::Weld(std::vector<glm::vec3>& positions, std::vector<int>& vertexIndices, float tolerance)
+{
+	size_t count = positions.size();
+	if (count < 2)
+	{
+		return 0;
+	}
+	ThreadPool& pool = ThreadPool::Instance();
+	size_t taskCount = (count + ItemsPerTask - 1) / ItemsPerTask;
+
+	std::vector<glm::vec3> taskMin(taskCount, glm::vec3(FLT_MAX));
+	std::vector<glm::vec3> taskMax(taskCount, glm::vec3(-FLT_MAX));
+	pool.ParallelFor(taskCount, [&](size_t task)
+	{
+		size_t end = std::min(count, (task + 1) * ItemsPerTask);
+		for (size_t i = task * ItemsPerTask; i < end; i++)
+		{
+			taskMin[task] = glm::min(taskMin[task], positions[i]);
+			taskMax[task] = glm::max(taskMax[task], positions[i]);
+		}
+	});
+	glm::vec3 boundsMin = taskMin[0];
+	glm::vec3 boundsMax = taskMax[0];
+	for (size_t task = 1; task < taskCount; task++)
+	{
+		boundsMin = glm::min(boundsMin, taskMin[task]);
+		boundsMax = glm::max(boundsMax, taskMax[task]);
+	}
+
+	float diagonal = glm::length(boundsMax - boundsMin);
+	float radius = tolerance * diagonal;
+	float radiusSquared = radius * radius;
+	float cellSize = std::max(CellRadii * radius, diagonal * MinCellFraction);
+	Grid grid;
+	grid.origin = boundsMin;
+	grid.inverseCellSize = cellSize > 0.0f ? 1.0f / cellSize : 1.0f;
+	size_t bucketCount = 1;
+	while (bucketCount < count)
+	{
+		bucketCount *= 2;
+	}
+	grid.mask = (uint32_t)(bucketCount - 1);
+
+	// Counting sort of the positions by bucket: count, prefix sum, scatter.
+	// Collisions share a bucket, the distance test below tells them apart.
+	std::vector<uint32_t> bucketOf(count);
+	std::unique_ptr<std::atomic<uint32_t>[]> cursors(new std::atomic<uint32_t>[bucketCount]);
+	size_t bucketTasks = (bucketCount + ItemsPerTask - 1) / ItemsPerTask;
+	pool.ParallelFor(bucketTasks, [&](size_t task)
+	{
+		size_t end = std::min(bucketCount, (task + 1) * ItemsPerTask);
+		for (size_t b = task * ItemsPerTask; b < end; b++)
+		{
+			cursors[b].store(0, std::memory_order_relaxed);
+		}
+	});
+	pool.ParallelFor(taskCount, [&](size_t task)
+	{
+		size_t end = std::min(count, (task + 1) * ItemsPerTask);
+		for (size_t i = task * ItemsPerTask; i < end; i++)
+		{
+			bucketOf[i] = grid.GetBucket(glm::ivec3(glm::floor(grid.ToCells(positions[i]))));
+			cursors[bucketOf[i]].fetch_add(1, std::memory_order_relaxed);
+		}
+	});
+	std::vector<uint32_t> bucketStart(bucketCount + 1);
+	uint32_t total = 0;
+	for (size_t b = 0; b < bucketCount; b++)
+	{
+		bucketStart[b] = total;
+		total += cursors[b].load(std::memory_order_relaxed);
+		cursors[b].store(bucketStart[b], std::memory_order_relaxed);
+	}
+	bucketStart[bucketCount] = total;
+	std::vector<uint32_t> sorted(count);
+	pool.ParallelFor(taskCount, [&](size_t task)
+	{
+		size_t end = std::min(count, (task + 1) * ItemsPerTask);
+		for (size_t i = task * ItemsPerTask; i < end; i++)
+		{
+			sorted[cursors[bucketOf[i]].fetch_add(1, std::memory_order_relaxed)] = (uint32_t)i;
+		}
+	});
+	cursors.reset();
+	std::vector<uint32_t>().swap(bucketOf);
+	// A copy in bucket order, so the candidates of a cell are read from one place
+	std::vector<glm::vec3> sortedPositions(count);
+	pool.ParallelFor(taskCount, [&](size_t task)
+	{
+		size_t end = std::min(count, (task + 1) * ItemsPerTask);
+		for (size_t k = task * ItemsPerTask; k < end; k++)
+		{
+			sortedPositions[k] = positions[sorted[k]];
+		}
+	});
+
+	// Walking the vertices in bucket order keeps their own cell in cache. The order inside a bucket
+	// depends on the threads, taking the lowest index keeps the result deterministic.
+	std::vector<uint32_t> target(count);
+	pool.ParallelFor(taskCount, [&](size_t task)
+	{
+		size_t end = std::min(count, (task + 1) * ItemsPerTask);
+		for (size_t k = task * ItemsPerTask; k < end; k++)
+		{
+			const glm::vec3& position = sortedPositions[k];
+			glm::vec3 cells = grid.ToCells(position);
+			glm::ivec3 cell(glm::floor(cells));
+			glm::ivec3 low(cell), high(cell);
+			for (int axis = 0; axis < 3; axis++)
+			{
+				float offset = (cells[axis] - cell[axis]) * cellSize;
+				low[axis] -= offset <= radius ? 1 : 0;
+				high[axis] += cellSize - offset <= radius ? 1 : 0;
+			}
+			uint32_t best = sorted[k];
+			for (int z = low.z; z <= high.z; z++)
+			{
+				for (int y = low.y; y <= high.y; y++)
+				{
+					for (int x = low.x; x <= high.x; x++)
+					{
+						uint32_t bucket = grid.GetBucket(glm::ivec3(x, y, z));
+						for (uint32_t n = bucketStart[bucket]; n < bucketStart[bucket + 1]; n++)
+						{
+							glm::vec3 d = sortedPositions[n] - position;
+							if (sorted[n] < best && glm::dot(d, d) <= radiusSquared)
+							{
+								best = sorted[n];
+							}
+						}
+					}
+				}
+			}
+			target[sorted[k]] = best;
+		}
+	});
+
+	// Targets are never above their vertex, so one pass in index order resolves every chain
+	std::vector<int> remap(count);
+	size_t kept = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (target[i] == i)
+		{
+			remap[i] = (int)kept;
+			positions[kept++] = positions[i];
+		}
+		else
+		{
+			remap[i] = remap[target[i]];
+		}
+	}
+	positions.resize(kept);
+	positions.shrink_to_fit();
+
+	size_t indexTasks = (vertexIndices.size() + ItemsPerTask - 1) / ItemsPerTask;
+	pool.ParallelFor(indexTasks, [&](size_t task)
+	{
+		size_t end = std::min(vertexIndices.size(), (task + 1) * ItemsPerTask);
+		for (size_t i = task * ItemsPerTask; i < end; i++)
+		{
+			int index = vertexIndices[i];
+			if (index > 0 && (size_t)index <= count)
+			{
+				vertexIndices[i] = remap[index - 1] + 1;
+			}
+		}
+	});
+	return count - kept;
+}
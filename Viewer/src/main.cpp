@@ -10,7 +10,10 @@
 #include "Renderer.h"
 #include "Scene.h"
 #include "Utils.h"
+#include "ModelLoader.h"
+#include "UvProjector.h"
 #include <iostream>
+#include <set>
 
 
 bool local_axes, world_axes, is_ortho, is_boundingBox, is_normals = false;
@@ -25,7 +28,10 @@ ImGuiIO& SetupDearImgui(GLFWwindow* window);
 void StartFrame();
 void RenderFrame(GLFWwindow* window, Scene& scene, Renderer& renderer, ImGuiIO& io);
 void Cleanup(GLFWwindow* window);
-void DrawImguiMenus(ImGuiIO& io, Scene& scene);
+void DrawImguiMenus(ImGuiIO& io, Scene& scene, ModelLoader& loader);
+void DrawLoadingWindow(ModelLoader& loader);
+void DrawLodWindow(Scene& scene, ModelLoader& loader);
+void DrawMemoryWindow(Scene& scene, ModelLoader& loader);
 
 void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
@@ -35,6 +41,16 @@ void ScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 
 int main(int argc, char** argv)
 {
+	// Viewer --optimize-report file.obj ... prints vertex cache statistics without opening a window
+	if (argc > 1 && std::string(argv[1]) == "--optimize-report")
+	{
+		for (int i = 2; i < argc; i++)
+		{
+			Utils::PrintOptimizationReport(argv[i]);
+		}
+		return 0;
+	}
+
 	int windowWidth = 1900, windowHeight = 1100;
 	GLFWwindow* window = SetupGlfwWindow(windowWidth, windowHeight, "Mesh Viewer");
 	if (!window)
@@ -50,6 +66,7 @@ int main(int argc, char** argv)
 
 	Renderer renderer = Renderer(frameBufferWidth, frameBufferHeight);
 	Scene scene = Scene();
+	ModelLoader loader;
 	renderer.LoadShaders();
 	renderer.LoadTextures();
 	Camera camera;
@@ -64,7 +81,8 @@ int main(int argc, char** argv)
 		glViewport(0, 0, width, height);
 		glfwPollEvents();
 		StartFrame();
-		DrawImguiMenus(io, scene);
+		loader.Update(scene);
+		DrawImguiMenus(io, scene, loader);
 		RenderFrame(window, scene, renderer, io);
 	}
 
@@ -208,7 +226,7 @@ void Cleanup(GLFWwindow* window)
 	glfwTerminate();
 }
 
-void DrawImguiMenus(ImGuiIO& io, Scene& scene)
+void DrawImguiMenus(ImGuiIO& io, Scene& scene, ModelLoader& loader)
 {
 	/**
 	 * MeshViewer menu
@@ -223,10 +241,10 @@ void DrawImguiMenus(ImGuiIO& io, Scene& scene)
 			if (ImGui::MenuItem("Open", "CTRL+O"))
 			{
 				nfdchar_t* outPath = NULL;
-				nfdresult_t result = NFD_OpenDialog("obj;", NULL, &outPath);
+				nfdresult_t result = NFD_OpenDialog("obj,ply,stl,glb;obj;ply;stl;glb", NULL, &outPath);
 				if (result == NFD_OKAY)
 				{
-					scene.AddModel(Utils::LoadMeshModel(outPath));
+					loader.Load(outPath);
 					free(outPath);
 				}
 				else if (result == NFD_CANCEL)
@@ -237,6 +255,16 @@ void DrawImguiMenus(ImGuiIO& io, Scene& scene)
 				}
 
 			}
+			if (ImGui::MenuItem("Open normal map"))
+			{
+				nfdchar_t* outPath = NULL;
+				if (NFD_OpenDialog("png,jpg,tga,bmp", NULL, &outPath) == NFD_OKAY)
+				{
+					scene.normal_map_file = outPath;
+					scene.normal_map = true;
+					free(outPath);
+				}
+			}
 			ImGui::EndMenu();
 		}
 
@@ -246,11 +274,100 @@ void DrawImguiMenus(ImGuiIO& io, Scene& scene)
 
 	// Controls
 	ImGui::ColorEdit3("Clear Color", (float*)&clear_color);
+	ImGui::Checkbox("Stream models while loading", &loader.streaming);
+	ImGui::Checkbox("Quantize vertices (16 bytes)", &loader.quantizeVertices);
+	ImGui::Checkbox("Position stream for depth passes", &loader.positionStreams);
+	ImGui::Checkbox("Depth prepass", &scene.depth_prepass);
+	ImGui::Checkbox("Software rasterizer (CPU)", &scene.software_rendering);
+	if (scene.software_rendering)
+	{
+		const RasterStats& stats = scene.software_stats;
+		ImGui::Text("CPU frame: %.2f ms on %u threads (vertices %.2f, binning %.2f, tiles %.2f)", scene.software_frame_ms, stats.threads,
+			stats.vertexMs, stats.binMs, stats.rasterMs);
+		ImGui::Text("%zu triangles, %zu binned into %zu tile entries", stats.triangles, stats.binnedTriangles, stats.binEntries);
+		ImGui::Checkbox("Hierarchical depth", &scene.software_hierarchical_depth);
+		if (scene.software_hierarchical_depth)
+		{
+			ImGui::Text("Rejected early: %zu triangles, %zu 8x8 blocks, %zu pixels", stats.rejectedTriangles, stats.rejectedBlocks, stats.rejectedPixels);
+		}
+		const char* kernelNames[] = { RasterKernels::GetName(RasterKernel::Scalar), RasterKernels::GetName(RasterKernel::Sse41), RasterKernels::GetName(RasterKernel::Avx2) };
+		int kernel = (int)scene.software_kernel;
+		if (ImGui::Combo("Raster kernel", &kernel, kernelNames, IM_ARRAYSIZE(kernelNames)) && RasterKernels::IsSupported((RasterKernel)kernel))
+		{
+			scene.software_kernel = (RasterKernel)kernel;
+		}
+		if (ImGui::Button("Benchmark raster kernels"))
+		{
+			scene.benchmark_raster_kernels = true;
+		}
+		for (int i = 0; i < IM_ARRAYSIZE(kernelNames); i++)
+		{
+			if (scene.raster_kernel_mpixels[i] > 0.0)
+			{
+				ImGui::Text("%s: %.0f Mpixels/s", kernelNames[i], scene.raster_kernel_mpixels[i]);
+			}
+		}
+		if (ImGui::Button("Test watertightness"))
+		{
+			scene.test_raster_watertight = true;
+		}
+		const WatertightResult& watertight = scene.raster_watertight;
+		if (watertight.frames > 0)
+		{
+			ImGui::Text("%zu pixels drawn twice, %zu missed of %zu in %d frames", watertight.drawnTwice, watertight.missed,
+				watertight.pixels + watertight.drawnTwice + watertight.missed, watertight.frames);
+		}
+	}
+	if (scene.GetModelCount())
+	{
+		MeshModel& model = scene.GetActiveModel();
+		bool positionStream = model.HasPositionStream();
+		if (ImGui::Checkbox("Model has a position stream", &positionStream))
+		{
+			model.SetPositionStream(positionStream);
+		}
+		if (ImGui::Button("Benchmark depth pass"))
+		{
+			scene.benchmark_depth_pass = true;
+		}
+		if (scene.depth_pass_ms_full > 0.0)
+		{
+			ImGui::Text("Depth pass: %.3f ms full vertex, %.3f ms positions only", scene.depth_pass_ms_full, scene.depth_pass_ms_positions);
+		}
+	}
+	// The order is baked into the buffers, so the active model is read again with the new setting
+	if (ImGui::Checkbox("Optimize triangle order (reloads the active model)", &loader.meshOptions.optimize) && scene.GetModelCount())
+	{
+		loader.Reload(scene.GetActiveModelPointer());
+	}
+	ImGui::Checkbox("Generate tangents (normal mapping)", &loader.meshOptions.generateTangents);
+	ImGui::Checkbox("Weld duplicate vertices", &loader.meshOptions.weldVertices);
+	if (loader.meshOptions.weldVertices)
+	{
+		ImGui::InputFloat("Weld tolerance (of diagonal)", &loader.meshOptions.weldTolerance, 0.0f, 0.0f, "%g");
+		loader.meshOptions.weldTolerance = glm::clamp(loader.meshOptions.weldTolerance, 0.0f, 0.01f);
+	}
+	ImGui::Checkbox("Generate missing normals", &loader.meshOptions.generateNormals);
+	if (loader.meshOptions.generateNormals)
+	{
+		const char* weightingNames[] = { "Area weighted", "Angle weighted" };
+		int weighting = (int)loader.meshOptions.normalWeighting;
+		ImGui::SliderFloat("Crease angle", &loader.meshOptions.creaseAngle, 0.0f, 180.0f, "%.0f deg");
+		if (ImGui::Combo("Normal weighting", &weighting, weightingNames, IM_ARRAYSIZE(weightingNames)))
+		{
+			loader.meshOptions.normalWeighting = (NormalWeighting)weighting;
+		}
+	}
+	ImGui::Text("%.3f ms/frame", 1000.0f / io.Framerate);
 	// TODO: Add more controls as needed
 	ImGui::End();
 	if (show_demo_window)
 		ImGui::ShowDemoWindow(&show_demo_window);
 
+	DrawLoadingWindow(loader);
+	DrawLodWindow(scene, loader);
+	DrawMemoryWindow(scene, loader);
+
 	// Transformation window
 	{
 		ImGui::SetNextWindowSize(ImVec2(400, 430));
@@ -481,16 +598,154 @@ void DrawImguiMenus(ImGuiIO& io, Scene& scene)
 	if (shading == 1) { scene.flat_shading = true; scene.phong = false; }
 	if (shading == 2) { scene.flat_shading = false; scene.phong = true; }
 
-	static int tex_mapping = 0;
-	ImGui::Text("Choose Texture");
-	ImGui::RadioButton("Plane", &tex_mapping, 1); ImGui::SameLine();
-	ImGui::RadioButton("Cylinder", &tex_mapping, 2); ImGui::SameLine();
-	ImGui::RadioButton("Sphere", &tex_mapping, 3);
-
-	if (tex_mapping == 1) { scene.GetActiveModel().SetPlane(); ImGui::SameLine(); }
+	if (scene.GetModelCount())
+	{
+		// Projected only when the choice changes, drawing reuses the stream
+		MeshModel& model = scene.GetActiveModel();
+		int tex_mapping = (int)model.GetUvProjection();
+		ImGui::Text("Choose Texture");
+		for (int mode = (int)UvProjection::None; mode <= (int)UvProjection::Box; mode++)
+		{
+			if (mode != (int)UvProjection::None) ImGui::SameLine();
+			ImGui::RadioButton(UvProjector::GetName((UvProjection)mode), &tex_mapping, mode);
+		}
+		if (tex_mapping != (int)model.GetUvProjection())
+		{
+			model.SetUvProjection((UvProjection)tex_mapping);
+		}
+	}
 
 	ImGui::Checkbox("Texture", &scene.use_texture);
+	ImGui::Checkbox("Normal map (models with tangents)", &scene.normal_map);
 	ImGui::Checkbox("Toon Shading", &scene.toon_shading);
 	ImGui::SliderFloat("colors of shades:", &scene.levels, 0, 20);
 	ImGui::End();
-}
\ No newline at end of file
+}
+
+void DrawLoadingWindow(ModelLoader& loader)
+{
+	if (loader.GetJobCount() == 0)
+	{
+		return;
+	}
+
+	ImGui::Begin("Loading");
+	for (size_t i = 0; i < loader.GetJobCount(); i++)
+	{
+		const ModelLoader::LoadJob& job = loader.GetJob(i);
+		ImGui::PushID((int)i);
+		ImGui::Text("%s (%s)", job.modelName.c_str(), ModelLoader::GetStateName(job));
+		ImGui::ProgressBar(ModelLoader::GetProgress(job), ImVec2(200, 0));
+		ImGui::SameLine();
+		if (ImGui::Button("Cancel"))
+		{
+			loader.Cancel(i);
+		}
+		ImGui::PopID();
+	}
+	ImGui::End();
+}
+
+void DrawLodWindow(Scene& scene, ModelLoader& loader)
+{
+	ImGui::Begin("Level of detail");
+	ImGui::Checkbox("Use level of detail", &scene.use_lod);
+
+	// Level i+1 is chosen below thresholds[i] pixels, its triangle budget is ratios[i] of the full mesh
+	std::vector<float>& ratios = loader.meshOptions.lodTriangleRatios;
+	for (size_t i = 0; i < scene.lod_thresholds.size(); i++)
+	{
+		ImGui::PushID((int)i);
+		ImGui::Text("Level %d", (int)i + 1);
+		ImGui::SliderFloat("Switch below (px)", &scene.lod_thresholds[i], 1.0f, 2000.0f, "%.0f");
+		if (i < ratios.size())
+		{
+			ImGui::SliderFloat("Triangle budget", &ratios[i], 0.01f, 1.0f, "%.2f");
+		}
+		ImGui::PopID();
+	}
+	// New models get no levels until a budget is added, the thresholds still serve models that have them
+	if (ImGui::Button("Add level"))
+	{
+		ratios.push_back(ratios.empty() ? 0.5f : ratios.back() * 0.5f);
+		if (scene.lod_thresholds.size() < ratios.size())
+		{
+			scene.lod_thresholds.push_back(scene.lod_thresholds.empty() ? 400.0f : scene.lod_thresholds.back() * 0.5f);
+		}
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Remove level") && !ratios.empty())
+	{
+		ratios.pop_back();
+	}
+	ImGui::Text("Triangle budgets apply to models loaded from now on");
+
+	if (scene.GetModelCount() > 0)
+	{
+		const std::vector<LodLevel>& lods = scene.GetActiveModel().GetGeometry().lods;
+		ImGui::Separator();
+		for (size_t i = 0; i < lods.size(); i++)
+		{
+			ImGui::Text("%s %d: %d triangles, error %g", (int)i == scene.lod_level_drawn ? ">" : " ", (int)i, (int)(lods[i].indexCount / 3), lods[i].error);
+		}
+		ImGui::Text("Screen size %.0f px, drawing level %d", scene.lod_screen_size, scene.lod_level_drawn);
+	}
+	ImGui::End();
+}
+
+void DrawMemoryWindow(Scene& scene, ModelLoader& loader)
+{
+	const char* residencyNames[] = { "Full", "Compact (positions + indices)", "GPU only" };
+
+	ImGui::Begin("Memory");
+	int newResidency = (int)loader.residency;
+	if (ImGui::Combo("New models keep", &newResidency, residencyNames, IM_ARRAYSIZE(residencyNames)))
+	{
+		loader.residency = (MeshResidency)newResidency;
+	}
+	ImGui::Separator();
+
+	// Shared geometry is counted once, every further instance of it is memory a copy would have cost
+	std::set<const MeshGeometry*> counted;
+	std::shared_ptr<MeshModel> newInstance;
+	size_t totalCpu = 0;
+	size_t totalGpu = 0;
+	size_t savedBytes = 0;
+	for (int i = 0; i < scene.GetModelCount(); i++)
+	{
+		MeshModel& model = scene.GetModel(i);
+		ImGui::PushID(i);
+		ImGui::Text("%s: CPU %.1f KB, GPU %.1f KB, %ld instance(s)", model.GetModelName().c_str(), model.GetCpuMemoryUsage() / 1024.0, model.GetGpuMemoryUsage() / 1024.0,
+			model.GetInstanceCount());
+		int residency = (int)model.GetResidency();
+		if (ImGui::Combo("Keep", &residency, residencyNames, IM_ARRAYSIZE(residencyNames)))
+		{
+			model.SetResidency((MeshResidency)residency);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Add instance"))
+		{
+			newInstance = std::make_shared<MeshModel>(model.GetSharedGeometry(), model.GetModelName());
+		}
+		ImGui::PopID();
+
+		size_t modelBytes = model.GetCpuMemoryUsage() + model.GetGpuMemoryUsage();
+		if (counted.insert(&model.GetGeometry()).second)
+		{
+			totalCpu += model.GetCpuMemoryUsage();
+			totalGpu += model.GetGpuMemoryUsage();
+		}
+		else
+		{
+			savedBytes += modelBytes;
+		}
+	}
+	if (newInstance)
+	{
+		scene.AddModel(newInstance);
+	}
+	ImGui::Separator();
+	ImGui::Text("Total: CPU %.1f MB, GPU %.1f MB", totalCpu / (1024.0 * 1024.0), totalGpu / (1024.0 * 1024.0));
+	ImGui::Text("%d models over %d meshes, sharing saves %.1f MB", scene.GetModelCount(), (int)counted.size(), savedBytes / (1024.0 * 1024.0));
+	ImGui::End();
+}